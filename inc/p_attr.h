@@ -0,0 +1,43 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+void           p_attr_init(void);
+struct attr_t *p_attr_get(uint8_t as4, uint8_t origin, uint32_t nexthop4, uint8_t nexthop6[16],
+                          void *aspath,         uint16_t aspathlen,
+                          void *community,      uint16_t communitylen,
+                          void *extcommunity4,  uint16_t extcommunitylen4,
+                          void *extcommunity6,  uint16_t extcommunitylen6,
+                          void *largecommunity, uint16_t largecommunitylen );
+void           p_attr_ref(struct attr_t *attr);
+void           p_attr_release(struct attr_t *attr);
+void           p_attr_stats(uint32_t *count, uint64_t *bytes);
+
+/* entry sizes of the attribute arrays, those of the dump records */
+#define ATTR_ASPATH_LEN         sizeof(((struct dump_announce_aspath*)0)->data[0])
+#define ATTR_COMMUNITY_LEN      sizeof(((struct dump_announce_community*)0)->data[0])
+#define ATTR_LARGECOMMUNITY_LEN sizeof(((struct dump_announce_largecommunity*)0)->data[0])
+#define ATTR_EXTCOMMUNITY4_LEN  sizeof(((struct dump_announce_extcommunity4*)0)->data[0])
+#define ATTR_EXTCOMMUNITY6_LEN  sizeof(((struct dump_announce_extcommunity6*)0)->data[0])
+
+/* accessors to the attribute arrays stored in attr_t.data */
+#define ATTR_ASPATH(a)         ((uint32_t*)(a)->data)
+#define ATTR_COMMUNITY(a)      ((uint16_t*)(ATTR_ASPATH(a) + (a)->aspathlen))
+#define ATTR_LARGECOMMUNITY(a) ((uint32_t*)(ATTR_COMMUNITY(a) + (a)->communitylen * 2))
+#define ATTR_EXTCOMMUNITY4(a)  ((uint8_t*)(ATTR_LARGECOMMUNITY(a) + (a)->largecommunitylen * 3))
+#define ATTR_EXTCOMMUNITY6(a)  ((uint8_t*)(ATTR_EXTCOMMUNITY4(a) + (a)->extcommunitylen4 * 8))
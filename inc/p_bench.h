@@ -0,0 +1,73 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#define BENCH_MAXPATH     255
+#define BENCH_MAXCOMM     500
+
+struct bench_session_t
+{
+	int       id;
+	int       sock;
+	int       state;            /* 0 connecting, 1 established, -1 failed */
+	int       phase;            /* last phase sent */
+	int       stat;             /* index in the statistics segment, -1 unknown */
+	struct sockaddr_storage src;
+	char      name[INET6_ADDRSTRLEN];
+	uint64_t  prefixes;         /* announces and withdrawns sent */
+	uint64_t  base;             /* collector update counter before the first phase */
+	struct speaker_queue_t queue; /* UPDATE messages sent */
+	pthread_t thread;
+};
+
+struct bench_t
+{
+	int       sessions;
+	int       af;
+	uint32_t  as;
+	uint32_t  prefixes;
+	int       group;            /* prefixes per UPDATE */
+	int       pathlen;
+	int       communities;
+	int       churn;            /* churn rounds */
+	int       percent;          /* prefixes changed per churn round */
+	int       timeout;
+	char      *statsfile;
+	struct sockaddr_storage dst;
+	struct sockaddr_storage src;
+	struct stats_t *stats;
+	int       phase;
+	int       stop;
+	struct bench_session_t *session;
+};
+
+int      main(int argc, char *argv[]);
+void     syntax(char *prog);
+int      p_bench_addr(char *str, int port, struct sockaddr_storage *addr);
+void     p_bench_addr_add(struct sockaddr_storage *addr, uint32_t n);
+void    *p_bench_session(void *data);
+void     p_bench_table(struct bench_session_t *s);
+void     p_bench_churn(struct bench_session_t *s, int round);
+int      p_bench_update(struct bench_session_t *s, uint32_t first, int step, int round, int withdraw, uint8_t *buf, int *len);
+int      p_bench_prefix(uint32_t i, uint8_t *prefix);
+void     p_bench_queue(struct bench_session_t *s, uint8_t *msg, int len, int flush);
+struct stats_t *p_bench_stats_open(char *file);
+int      p_bench_stats_peer(struct stats_t *stats, struct bench_session_t *s);
+int      p_bench_ingest(void);
+double   p_bench_cpu(uint64_t pid);
+void     p_bench_report(char *phase, double send, double ingest, uint64_t prefixes, uint64_t updates, uint64_t bytes, double cpu);
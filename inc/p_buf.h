@@ -0,0 +1,26 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+void p_buf_cap   (uint32_t mb);
+int  p_buf_init  (struct buf_t *buf);
+int  p_buf_grow  (struct buf_t *buf, int len, int force);
+void p_buf_shrink(struct buf_t *buf, int len);
+void p_buf_free  (struct buf_t *buf);
+void p_buf_stats (uint32_t *used, uint64_t *bytes, uint64_t *denied);
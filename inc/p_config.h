@@ -17,5 +17,11 @@
 /*******************************************************************************/
 
 
+extern pthread_mutex_t config_lock;
+
 int  p_config_load(struct config_t *config, struct peer_t *peer, uint32_t mytime);
+int  p_config_reload(struct config_t *config, struct peer_t *peer, uint32_t mytime);
 void p_config_add_peer(struct peer_t *peer, uint8_t af, struct in_addr *peer_ip4, struct in6_addr *peer_ip6, uint32_t as, char *key, uint32_t mytime);
+int  p_config_find_peer(struct peer_t *peer, char *ip);
+int  p_config_add_dynamic(struct config_t *config, struct peer_t *peer, uint8_t af, uint8_t *addr, uint32_t mytime);
+int  p_config_match_peer(struct peer_t *peer, uint8_t af, struct in_addr *ip4, struct in6_addr *ip6);
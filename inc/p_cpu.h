@@ -0,0 +1,24 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+int  p_cpu_parse(struct cpus_t *cpus, char *s);
+void p_cpu_init (void);
+int  p_cpu_pin  (struct cpus_t *cpus, int index);
+int  p_cpu_node (void);
@@ -35,7 +35,9 @@
 #define P_VER_MI "1"
 #define P_VER_PL "2"
 
+#ifndef MAX_PEERS
 #define MAX_PEERS 128
+#endif
 
 #ifndef DUMPINTERVAL
 #define DUMPINTERVAL 60
@@ -59,15 +61,60 @@
 #  endif
 #endif
 
+/* no SIGPIPE from send() to a closed socket, where the flag is missing */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 #define LOGFILE    PATH "/var/piranha.log"
 #define STATUSFILE PATH "/var/piranha.status"
 #define STATUSTEMP PATH "/var/piranha.status.temp"
 #define PIDFILE    PATH "/var/piranha.pid"
+#define STATSFILE  PATH "/var/piranha.stats"
 #define DUMPDIR    PATH "/var/dump"
-
-#define INPUT_BUFFER  1048576
-#define OUTPUT_BUFFER 65536
-#define TEMP_BUFFER   65536
+#define CONTROLFILE PATH "/var/piranha.sock"
+#define FEEDFILE   PATH "/var/piranha.feed"
+#define FEEDTEMP   PATH "/var/piranha.feed.temp"
+#define STREAMFILE PATH "/var/piranha.stream"
+
+#define INPUT_BUFFER  131072   /* receive buffer borrowed from the pool while bursting */
+#define INPUT_SMALL   8192     /* steady state receive buffer, two BGP messages */
+#define OUTPUT_BUFFER 4096     /* OPEN, KEEPALIVE and ROUTE-REFRESH only */
+#define TEMP_BUFFER   65536    /* largest single recv() */
+#define BUFFER_POOL   64       /* default receive buffer pool cap (MB) */
+#define BUFFER_SPARE  4        /* free pool buffers kept for the next burst */
+#define DUMP_BUFFER   1048576  /* dump file buffer until End-of-RIB, or a file not filling it */
+
+/* hugepages backing of the large buffers and route state, see p_mem.c */
+#define HUGE_PAGE         2097152
+#define HUGEPAGES_OFF     0
+#define HUGEPAGES_THP     1    /* madvise(MADV_HUGEPAGE) */
+#define HUGEPAGES_HUGETLB 2    /* MAP_HUGETLB, transparent ones once none is left */
+
+/* live feed of the dump records (FEEDFILE), see p_feed.c */
+#define FEED_MAGIC   0x50495246  /* PIRF */
+#define FEED_VERSION 1
+#define FEED_MIN     1           /* smallest ring (MB) */
+#define FEED_MAX     4096        /* largest ring (MB) */
+#define FEED_RECORD  0
+#define FEED_WRAP    1           /* rest of the ring unused, next record at offset 0 */
+#define FEED_LOST    2           /* stream server only, seq is the number of records not sent */
+#define FEED_WAIT    1000        /* reader sleep (us) when idle */
+#define FEED_ALIGN(x) ( ( (x) + 7 ) & ~7 )
+
+#define STATUS_ASCII    0
+#define STATUS_JSON     1
+#define STATUS_TSV      2
+#define STATUS_INTERVAL 10     /* default status file rewrite interval */
+
+#define MAX_SHARDS      16     /* listening sockets per address family */
+#define REUSEPORT_OFF    0
+#define REUSEPORT_ON     1     /* port shared with other processes */
+#define REUSEPORT_SOURCE 2     /* and peers steered by source address */
+
+#define LOG_QUEUE_SIZE 4096    /* log lines queued, power of 2 */
+#define LOG_LINE_LEN   256
+#define LOG_WAIT       50000   /* logger thread sleep (us) when idle */
 
 #define BGP_HEADER_LEN  19
 #define BGP_OPEN_LEN    10
@@ -79,6 +126,30 @@
 #define BGP_UPDATE		2
 #define BGP_ERROR		3
 #define BGP_KEEPALIVE	4
+#define BGP_REFRESH		5
+
+#define BGP_REFRESH_LEN 4
+
+#define BGP_CAPA_MP				1
+#define BGP_CAPA_REFRESH		2
+#define BGP_CAPA_GR				64
+#define BGP_CAPA_AS4			65
+#define BGP_CAPA_EREFRESH		70
+
+#define BGP_REFRESH_REQUEST		0
+#define BGP_REFRESH_BORR		1
+#define BGP_REFRESH_EORR		2
+
+#define BGP_GR_RESTART			0x8000 /* restart state bit */
+#define BGP_GR_TIME				0x0fff /* restart time mask */
+#define BGP_GR_MAXTIME			4095
+
+#define GR_CAPA          0x01  /* peer supports graceful restart, RFC4724 */
+#define GR_PEER_RESTART  0x02  /* peer restarted (restart state bit received) */
+#define GR_LOCAL_RESTART 0x04  /* we restarted (restart state bit sent) */
+
+#define REFRESH_CAPA     0x01  /* peer supports route refresh, RFC2918 */
+#define REFRESH_ENHANCED 0x02  /* peer supports enhanced route refresh, RFC7313 */
 
 #define BGP_ATTR_ORIGIN				1
 #define BGP_ATTR_AS_PATH			2
@@ -113,9 +184,24 @@
 #define EXPORT_LARGECOMMUNITY 0x10
 #define EXPORT_NEXT_HOP       0x20
 
+/* cpu_peers and cpu_aux thread placement, see p_cpu.c */
+#define MAX_CPUS  1024
+#define MAX_NODES 16           /* NUMA nodes */
+
+/* tcp_* options, TCP_UNSET keeps the kernel default (global) or the
+   global value (neighbor_option) */
+#define TCP_UNSET -1
+
+#define DUPLICATE_KEEP  0  /* dump every announce */
+#define DUPLICATE_COUNT 1  /* dump a duplicate counter instead of unchanged announces */
+#define DUPLICATE_DROP  2  /* do not dump unchanged announces at all */
+
 #define DUMP_OPEN        10
 #define DUMP_CLOSE       11
 #define DUMP_KEEPALIVE   12
+#define DUMP_DUPLICATE   13
+#define DUMP_EOR         14
+#define DUMP_REFRESH     15
 
 #define DUMP_HEADER4     40
 #define DUMP_ANNOUNCE4   41
@@ -176,6 +262,17 @@ struct bgp_param_capa
 };
 #endif
 
+struct bgp_refresh
+{
+	uint16_t afi;
+	uint8_t  subtype;
+	uint8_t  safi;
+#ifdef CC_GCC
+} __attribute__((packed));
+#else
+};
+#endif
+
 struct bgp_error
 {
 	uint8_t code;
@@ -334,6 +431,46 @@ struct dump_announce_extcommunity6
 };
 #endif
 
+struct dump_open
+{
+	uint8_t  gr;
+	uint16_t grtime;
+#ifdef CC_GCC
+} __attribute__((packed));
+#else
+};
+#endif
+
+struct dump_eor
+{
+	uint16_t afi;
+	uint32_t count;            /* prefixes announced before End-of-RIB */
+	uint32_t duration;         /* milliseconds since established */
+#ifdef CC_GCC
+} __attribute__((packed));
+#else
+};
+#endif
+
+struct dump_refresh
+{
+	uint16_t afi;
+	uint8_t  subtype;          /* BGP_REFRESH_BORR or BGP_REFRESH_EORR */
+#ifdef CC_GCC
+} __attribute__((packed));
+#else
+};
+#endif
+
+struct dump_duplicate
+{
+	uint32_t count;
+#ifdef CC_GCC
+} __attribute__((packed));
+#else
+};
+#endif
+
 struct dump_full_msg
 {
 	struct dump_msg msg;
@@ -344,6 +481,10 @@ struct dump_full_msg
 		struct dump_announce6  announce6;
 		struct dump_withdrawn4 withdrawn4;
 		struct dump_withdrawn6 withdrawn6;
+		struct dump_duplicate  duplicate;
+		struct dump_open       open;
+		struct dump_eor        eor;
+		struct dump_refresh    refresh;
 	};
 	struct dump_announce_aspath         aspath;
 	struct dump_announce_community      community;
@@ -356,6 +497,343 @@ struct dump_full_msg
 };
 #endif
 
+/* shared memory statistics (STATSFILE), see p_stats.c. the layout only
+   grows at the end, readers must check magic, version and size */
+#define STATS_MAGIC   0x50495241  /* PIRA */
+#define STATS_VERSION 3
+
+/* log-linear latency histograms in microseconds, 2^HIST_SUB linear buckets
+   per power of two, the last bucket takes everything above ~33s */
+#define HIST_SUB       2
+#define HIST_BUCKETS   96
+
+#define HIST_WAIT      0   /* kernel receive to recv() */
+#define HIST_DECODE    1   /* recv() to first dump record of the message */
+#define HIST_SERIALIZE 2   /* first dump record to message done */
+#define HIST_FLUSH     3   /* oldest buffered dump record to disk write */
+#define HIST_ROTATION  4   /* dump file rotation */
+#define HIST_STAGES    5
+
+struct stats_hist_t
+{
+	uint64_t count;
+	uint64_t sum;              /* microseconds */
+	uint64_t max;
+	uint64_t bucket[HIST_BUCKETS];
+};
+
+struct stats_peer_t
+{
+	uint8_t  allow;
+	uint8_t  status;           /* 0 offline, 1 connected, 2 established */
+	uint8_t  af;
+	uint8_t  held;             /* prefixes is valid */
+	uint32_t as;
+	uint8_t  ip[16];           /* IPv4 in the first 4 bytes */
+	uint64_t cts;              /* last state change */
+	uint64_t uts;              /* last update received */
+	uint64_t sessions;         /* counters below are never reset */
+	uint64_t msgs_recv;
+	uint64_t msgs_sent;
+	uint64_t bytes_recv;
+	uint64_t updates;
+	uint64_t announces;
+	uint64_t withdrawns;
+	uint64_t duplicates;
+	uint64_t errors;           /* decoding errors */
+	uint64_t dump_bytes;       /* accounted when the dump file is closed */
+	uint64_t dump_files;
+	uint32_t ibuf;             /* input buffer bytes waiting to be decoded */
+	uint32_t obuf;             /* output buffer bytes waiting to be sent */
+	uint32_t prefixes;         /* routes held, duplicate suppression only */
+	uint32_t reserved;
+	struct stats_hist_t hist[HIST_STAGES];
+};
+
+struct stats_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;             /* sizeof(struct stats_t) */
+	uint32_t maxpeers;
+	uint64_t pid;
+	uint64_t started;
+	uint64_t updated;          /* last sample of the main loop */
+	uint64_t attr_count;       /* interned path attributes */
+	uint64_t attr_bytes;
+	uint64_t log_queue;        /* log lines waiting for the logger thread */
+	uint64_t log_drops;
+	uint64_t rotations;        /* dump files rotated */
+	uint64_t rotation_ns;      /* total, last and max rotation time */
+	uint64_t rotation_ns_last;
+	uint64_t rotation_ns_max;
+	uint64_t buf_used;         /* receive buffers borrowed from the pool */
+	uint64_t buf_bytes;        /* pool memory, borrowed and spare */
+	uint64_t buf_denied;       /* bursts served by the small buffer, pool full */
+	struct stats_peer_t peer[MAX_PEERS];
+};
+
+/* OpenMetrics exporter response buffer */
+#define METRICS_BUFFER  65536
+#define METRICS_TIMEOUT 2      /* client send/receive timeout (s) */
+
+/* control socket, see p_control.c */
+#define CONTROL_LINE    512
+#define CONTROL_TIMEOUT 10     /* client idle timeout and peer request wait (s) */
+
+/* stream server, see p_stream.c */
+#define STREAM_CLIENTS   64      /* subscribers, one bit each in the compiled filters */
+#define STREAM_LINE      4096    /* filter line */
+#define STREAM_TIMEOUT   10      /* time to send the filter (s) */
+#define STREAM_BUFFER    4194304 /* client output, events are dropped above */
+#define STREAM_FORMAT    1048576 /* largest JSON event */
+#define STREAM_BATCH     1024    /* feed records between two polls */
+#define STREAM_HASH      4096    /* origin and community buckets */
+#define STREAM_JSON      0
+#define STREAM_BINARY    1
+#define STREAM_ORIGIN    0
+#define STREAM_COMMUNITY 1
+#define STREAM_LARGE     2
+
+/* binary upgrade, see p_handoff.c */
+#define PIRANHA_BIN     PATH "/bin/piranha"
+#define HANDOFF_ENV     "PIRANHA_HANDOFF"  /* descriptor of the upgrade channel */
+#define HANDOFF_FD      3
+#define HANDOFF_MAGIC   0x50484f46         /* PHOF */
+#define HANDOFF_VERSION 2
+#define HANDOFF_TIMEOUT 30     /* new process start up (s) */
+#define HANDOFF_MAXFD   2      /* descriptors per message */
+
+#define HANDOFF_MSG_LISTEN4 1  /* listening socket of a shard */
+#define HANDOFF_MSG_LISTEN6 2
+#define HANDOFF_MSG_CONTROL 3
+#define HANDOFF_MSG_METRICS 4
+#define HANDOFF_MSG_PEER    5  /* session and dump file, handoff_peer_t and buffers */
+#define HANDOFF_MSG_END     6
+#define HANDOFF_MSG_ACK     7  /* new process ready, sent back */
+#define HANDOFF_MSG_STREAM  8  /* stream server socket, shard 0 TCP, 1 unix */
+
+#define HANDOFF_REQ     1      /* peer_t.handoff, asked to the peer thread */
+#define HANDOFF_READY   2      /* state saved, the peer thread waits */
+#define HANDOFF_DONE    3      /* taken over, the peer thread exits */
+#define HANDOFF_RESUME  4      /* received, the peer thread is to be started */
+
+struct handoff_msg_t
+{
+	uint32_t magic;
+	uint8_t  version;
+	uint8_t  type;             /* HANDOFF_MSG_* */
+	uint8_t  nfd;              /* descriptors attached */
+	uint8_t  shard;
+	uint32_t len;              /* data following */
+};
+
+/* session state, followed by ilen input and olen output buffer bytes */
+struct handoff_peer_t
+{
+	uint8_t  af;
+	uint8_t  ip[16];
+	uint32_t as;
+	uint8_t  as4;
+	uint8_t  refresh;
+	uint8_t  gr;
+	uint8_t  eor;
+	uint8_t  fbulk;
+	uint8_t  empty;
+	uint8_t  export;
+	uint16_t grtime;
+	uint16_t rhold;
+	uint16_t shold;
+	uint32_t icount[2];
+	uint32_t rmsg;
+	uint32_t smsg;
+	uint32_t ucount;
+	uint32_t dcount;
+	uint64_t cts;
+	uint64_t rts;
+	uint64_t sts;
+	uint64_t ests;
+	uint64_t filets;
+	uint64_t rbytes;
+	uint64_t uts;
+	char     filename[1024];   /* empty without dump file */
+	int32_t  ilen;
+	int32_t  olen;
+};
+
+struct metrics_buf_t
+{
+	char  *data;
+	size_t len;
+	size_t size;
+};
+
+/* peer receive buffer, INPUT_SMALL or INPUT_BUFFER borrowed from the pool */
+struct buf_t
+{
+	char *data;
+	int   size;
+	char *small;               /* steady state buffer, kept while borrowing */
+	int   node;                /* NUMA node of the pool buffer */
+};
+
+/* log line queued for the logger thread */
+struct log_entry_t
+{
+	uint64_t seq;              /* queue sequence, see p_log.c */
+	time_t   ts;
+	char     line[LOG_LINE_LEN];
+};
+
+/* interned path attributes, shared by all peers (see p_attr.c) */
+#define ATTR_BUCKETS 65536
+#define ATTR_LOCKS   256
+
+struct attr_t
+{
+	struct attr_t *next;       /* hash bucket chain */
+	uint32_t hash;
+	uint32_t ref;              /* reference count, protected by the bucket lock */
+	uint32_t id;               /* attribute id, unique while referenced */
+	uint32_t len;              /* length of data[] in octets */
+	/* everything from here to data[] is part of the key */
+	uint8_t  origin;
+	uint32_t nexthop4;         /* host order */
+	uint8_t  nexthop6[16];
+	uint16_t aspathlen;        /* number of ASN        (uint32_t big endian) */
+	uint16_t communitylen;     /* number of COMMUNITY  (2x uint16_t big endian) */
+	uint16_t largecommunitylen;/* number of LARGE_COM  (3x uint32_t big endian) */
+	uint16_t extcommunitylen4; /* number of EXT_COM4   (8 octets, raw) */
+	uint16_t extcommunitylen6; /* number of EXT_COM6   (20 octets, raw) */
+	uint32_t data[];           /* aspath, community, largecommunity, extcommunity4, extcommunity6,
+	                              laid out as in the dump file announces */
+};
+
+/* per peer table of the routes currently held (see p_rib.c) */
+#define RIB_INITIAL_SIZE 1024
+#define RIB_CHUNK_MIN    65536 /* first entry arena, doubling up to HUGE_PAGE */
+
+struct rib_entry_t
+{
+	struct rib_entry_t *next;
+	struct attr_t      *attr;
+	uint8_t             af;
+	uint8_t             mask;
+	uint8_t             stale;   /* not announced again since a BoRR */
+	uint8_t             prefix[16];
+};
+
+/* entry arena, followed by the entries */
+struct rib_chunk_t
+{
+	struct rib_chunk_t *next;
+	size_t              len;
+};
+
+struct rib_t
+{
+	struct rib_entry_t **bucket;
+	uint32_t             size;
+	uint32_t             count;
+	struct rib_entry_t  *free;   /* withdrawn entries, linked through next */
+	struct rib_chunk_t  *chunk;  /* arenas, the first one is being carved */
+	size_t               used;   /* octets carved from the first arena */
+};
+
+/* output of ptoa and the stream server, see p_format.c */
+enum PTOA_MODE { PTOA_NONE, PTOA_HUMAN, PTOA_JSON, PTOA_MACHINE };
+
+/* FEEDFILE layout, the header is followed by the ring. Writers reserve
+ * space under a lock, zero the seq of the record and advance reserve,
+ * then copy the record and store its seq last. A reader at absolute
+ * position pos waits for reserve > pos and a non zero seq, the record
+ * was not overwritten while it was read if reserve <= pos + size after. */
+struct feed_t
+{
+	uint32_t magic;            /* stored last by the writer */
+	uint32_t version;
+	uint64_t size;             /* ring bytes */
+	uint64_t started;
+	uint64_t reserve;          /* ring bytes handed out, the position is reserve % size */
+	uint64_t seq;              /* sequence of the next record, the first is 1 */
+	uint64_t reserved[11];
+};
+
+/* 8 bytes aligned in the ring, followed by the dump record (struct dump_msg
+ * and its payload, as in the dump files). A record never wraps, less than a
+ * struct feed_rec_t left at the end of the ring is skipped without a
+ * FEED_WRAP record */
+struct feed_rec_t
+{
+	uint64_t seq;              /* consecutive, a FEED_WRAP has the seq of the next record */
+	uint32_t len;              /* dump record bytes */
+	uint16_t id;               /* neighbor slot */
+	uint8_t  af;
+	uint8_t  type;             /* FEED_* */
+	uint32_t as;
+	uint32_t reserved;
+	uint8_t  ip[16];           /* IPv4 in the first 4 bytes */
+};
+
+/* feed reader, see p_undump_feed_*() */
+struct feed_ctx
+{
+	char file[PATH_MAX];
+	struct feed_t *feed;
+	uint8_t *ring;
+	size_t   map;              /* mapping length */
+	ino_t    ino;              /* a new piranha process replaces the file */
+	uint64_t pos;              /* absolute position of the next record */
+	uint64_t seq;              /* its expected seq */
+	uint64_t lost;             /* records overwritten before they were read */
+};
+
+/* stream server filters of all the subscribers, compiled together (see
+ * p_filter.c). Each subscriber has a bit, an event is evaluated once and
+ * sent to the subscribers whose bit is set in the result */
+struct stream_node_t
+{
+	struct stream_node_t *child[2];
+	uint64_t mask;             /* subscribers of the prefix ending here */
+};
+
+struct stream_match_t
+{
+	struct stream_match_t *next;
+	uint8_t  type;             /* STREAM_ORIGIN, STREAM_COMMUNITY or STREAM_LARGE */
+	uint32_t key[3];
+	uint64_t mask;
+};
+
+struct stream_filter_t
+{
+	struct stream_node_t  *peer[2];    /* neighbor tries, IPv4 and IPv6 */
+	struct stream_node_t  *prefix[2];  /* a prefix matches itself and more specifics */
+	struct stream_match_t *match[STREAM_HASH];
+	uint64_t peer_any;         /* subscribers without peer filter */
+	uint64_t prefix_any;
+	uint64_t origin_any;
+	uint64_t community_any;
+	uint64_t binary;           /* subscribers of the binary records */
+};
+
+struct stream_client_t
+{
+	int      sock;             /* -1 for a free slot */
+	uint8_t  running;          /* filter received */
+	uint8_t  format;           /* STREAM_JSON or STREAM_BINARY */
+	time_t   cts;
+	char     line[STREAM_LINE];
+	size_t   llen;
+	char    *out;              /* output not sent yet, from osent to olen */
+	size_t   osize;
+	size_t   olen;
+	size_t   osent;
+	uint64_t sent;             /* events */
+	uint64_t lost;             /* events not sent since the last FEED_LOST */
+	uint64_t dropped;          /* events not sent, output full */
+};
+
 struct dump_file_ctx
 {
 	char file[PATH_MAX];
@@ -368,22 +846,91 @@ struct dump_file_ctx
 
 
 
+/* neighbor_range entries, a binary trie per address family gives the *
+ * longest prefix match of a connecting address, see p_range.c         */
+struct range_entry_t
+{
+	uint8_t  af;
+	uint8_t  prefix[16];       /* network byte order, IPv4 in the first 4 bytes */
+	uint8_t  len;
+	uint32_t as;               /* 0 for any, learned from the OPEN */
+	char     key[MAX_KEY_LEN]; /* MD5 authentication of the whole range */
+	struct range_entry_t *next;
+};
+
+struct range_node_t
+{
+	struct range_node_t  *child[2];
+	struct range_entry_t *entry;
+};
+
+struct range_t
+{
+	struct range_node_t  *root[2];   /* IPv4, IPv6 */
+	struct range_entry_t *list;
+};
+
+struct cpus_t
+{
+	uint16_t count;            /* 0, the scheduler places the threads */
+	uint16_t cpu[MAX_CPUS];
+};
+
+struct tcpopt_t
+{
+	int rcvbuf;                /* SO_RCVBUF (bytes) */
+	int sndbuf;                /* SO_SNDBUF (bytes) */
+	int nodelay;               /* TCP_NODELAY (0/1) */
+	int busypoll;              /* SO_BUSY_POLL (us) */
+	int usertimeout;           /* TCP_USER_TIMEOUT (ms) */
+	int keepidle;              /* SO_KEEPALIVE probes (s) */
+	int keepintvl;
+	int keepcnt;
+};
+
 struct config_t
 {
 	struct {
 		struct sockaddr_in  listen;
-		int sock;
+		int sock[MAX_SHARDS];
 		int enabled;
 	} ip4;
 	struct {
 		struct sockaddr_in6 listen;
-		int sock;
+		int sock[MAX_SHARDS];
 		int enabled;
 	} ip6;
+	uint8_t  shards;           /* listen_shards, one accept thread each */
+	uint8_t  reuseport;        /* REUSEPORT_* */
+	uint16_t group;            /* sockets in the reuseport group, 0 for shards */
+	struct {
+		struct sockaddr_storage listen;
+		int sock;
+		int enabled;
+	} metrics;                 /* OpenMetrics exporter, see p_metrics.c */
+	struct {
+		struct sockaddr_storage listen;
+		int sock;
+		int enabled;
+		int lsock;             /* STREAMFILE */
+		int local;
+	} stream;                  /* stream server, see p_stream.c */
+	int control;               /* control socket, see p_control.c */
+	struct range_t *range;     /* neighbor_range, see p_range.c */
 	uint8_t export;
 	uint32_t as;
 	uint32_t routerid;
 	uint16_t holdtime;
+	uint16_t grtime;           /* graceful restart time, 0 disabled */
+	uint16_t status_interval;  /* status file rewrite interval, 0 on change only */
+	uint32_t bufpool;          /* receive buffer pool cap (MB), see p_buf.c */
+	struct tcpopt_t tcp;       /* session socket options, see p_socket_tune() */
+	struct cpus_t cpu_peers;   /* peer threads affinity */
+	struct cpus_t cpu_aux;     /* main, accept, logger, metrics and control threads */
+	uint8_t  cpu_spread;       /* a peer thread is pinned to one cpu of cpu_peers */
+	uint8_t  hugepages;        /* HUGEPAGES_* */
+	uint32_t feed;             /* live feed ring (MB), 0 disabled, see p_feed.c */
+	uint8_t  status_format;    /* STATUS_* */
 	uid_t    uid;
 	gid_t    gid;
 	char     *file;
@@ -395,6 +942,7 @@ struct peer_t
 	uint8_t  allow;
 	uint8_t  newallow;         /* to avoid peer drop during reconfiguration */
 	uint8_t  status;           /* 0 offline, 1 connected, 2 authed */
+	uint8_t  thread;           /* a peer thread owns the slot, until its hold is over */
 	uint8_t  type;             /* iBGP/eBGP */
 	uint32_t ucount;           /* bgp updates count */
 	union {
@@ -412,13 +960,43 @@ struct peer_t
 	uint16_t rhold;
 	uint16_t shold;
 	uint8_t  as4;              /* neighbor 4 bytes AS advertised capability support. */
+	uint8_t  refresh;          /* neighbor route refresh capabilities, REFRESH_* */
+	uint8_t  refreshreq;       /* route refresh requested, sent by the peer thread */
+	uint8_t  rotatereq;        /* dump file rotation requested on the control socket */
+	uint8_t  flushreq;         /* dump file flush requested on the control socket */
+	uint8_t  handoff;          /* HANDOFF_* state during a binary upgrade */
+	uint8_t  gr;               /* graceful restart state, GR_* */
+	uint16_t grtime;           /* neighbor graceful restart time */
+	uint8_t  eor;              /* End-of-RIB received, bit 0 IPv4, bit 1 IPv6 */
+	uint32_t icount[2];        /* IPv4/IPv6 prefixes announced before End-of-RIB */
+	uint64_t ests;             /* established time in ms */
+	uint64_t rxts;             /* last recv() with data, monotonic us */
+	uint64_t serts;            /* first dump record of the current message */
+	uint64_t fts;              /* oldest dump record not written to disk */
+	size_t   fpending;         /* dump bytes buffered at the last record */
 	FILE     *fh;
+	char     *fbuf;            /* dump file buffer, initial table only */
+	uint8_t  fbulk;            /* no dump file of the session was smaller than its buffer yet */
+	struct feed_rec_t *feedrec;/* live feed record being written */
+	uint8_t  *feedptr;         /* next byte of its dump record */
+	uint32_t feedleft;         /* dump record bytes still to copy */
+	uint64_t feedpos;          /* its absolute ring position */
+	uint64_t feedseq;          /* stored once it is complete */
 	uint8_t  empty;
 	char     filename[1024];
 	uint64_t filets;
 	int      ilen;
 	int      olen;
 	int      sock;
+	uint8_t  duplicate;        /* DUPLICATE_* mode */
+	struct tcpopt_t tcp;       /* neighbor_option tcp_*, over the global ones */
+	uint8_t  export;           /* EXPORT_* of the current dump file */
+	uint8_t  dynamic;          /* instantiated from a neighbor_range on accept */
+	uint32_t dcount;           /* duplicates suppressed in the current dump file */
+	struct rib_t *rib;         /* routes held, only with duplicate suppression */
+	uint32_t prefixes;         /* routes held, only with duplicate suppression */
+	uint64_t rbytes;           /* bytes received */
+	uint64_t uts;              /* last update received */
 };
 
 #endif
@@ -17,15 +17,26 @@
 /*******************************************************************************/
 
 
+void p_dump_export        (uint8_t export);
 void p_dump_open_file     (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_add_open      (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_add_close     (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_add_keepalive (struct peer_t *peer, int id, struct timeval *ts);
+void p_dump_add_duplicate (struct peer_t *peer, int id, struct timeval *ts);
+void p_dump_add_eor       (struct peer_t *peer, int id, struct timeval *ts,
+                           uint16_t afi, uint32_t count, uint32_t duration);
+void p_dump_add_refresh   (struct peer_t *peer, int id, struct timeval *ts,
+                           uint16_t afi, uint8_t subtype);
 void p_dump_add_header4   (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_add_header6   (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_add_footer    (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_check_file    (struct peer_t *peer, int id, struct timeval *ts);
 void p_dump_close_file    (struct peer_t *peer, int id);
+void p_dump_rotate        (struct peer_t *peer, int id, struct timeval *ts);
+void p_dump_flush         (struct peer_t *peer, int id);
+int  p_dump_detach_file   (struct peer_t *peer, int id);
+void p_dump_adopt_file    (struct peer_t *peer, int id, int fd);
+void p_dump_msg           (struct peer_t *peer, int id, struct dump_msg *msg);
 
 void p_dump_add_withdrawn4 (struct peer_t *peer, int id, struct timeval *ts,
                            uint32_t prefix, uint8_t mask);
@@ -34,16 +45,9 @@ void p_dump_add_withdrawn6 (struct peer_t *peer, int id, struct timeval *ts,
 
 void p_dump_add_announce4 (struct peer_t *peer, int id, struct timeval *ts,
                            uint32_t prefix,      uint8_t mask,
-						   uint8_t origin,       uint32_t nexthop,
-                           void *aspath,         uint16_t aspathlen,
-                           void *community,      uint16_t communitylen,
-                           void *extcommunity4,  uint16_t extcommunitylen4,
-                           void *largecommunity, uint16_t largecommunitylen );
+                           struct attr_t *attr);
 
 void p_dump_add_announce6 (struct peer_t *peer, int id, struct timeval *ts,
                            uint8_t prefix[16],   uint8_t mask,
-						   uint8_t origin,       uint8_t nexthop[16],
-                           void *aspath,         uint16_t aspathlen,
-                           void *community,      uint16_t communitylen,
-                           void *extcommunity6,  uint16_t extcommunitylen6,
-                           void *largecommunity, uint16_t largecommunitylen );
+                           struct attr_t *attr);
+
@@ -0,0 +1,29 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+void p_format_msg           (FILE *out, int mode, struct dump_full_msg *msg, struct feed_rec_t *rec);
+void p_format_origin        (FILE *out, int mode, uint8_t origin);
+void p_format_nexthop4      (FILE *out, int mode, uint32_t nexthop);
+void p_format_nexthop6      (FILE *out, int mode, uint8_t nexthop[16]);
+void p_format_aspath        (FILE *out, int mode, struct dump_announce_aspath *aspath, uint8_t len);
+void p_format_community     (FILE *out, int mode, struct dump_announce_community *community, uint16_t len);
+void p_format_extcommunity4 (FILE *out, int mode, struct dump_announce_extcommunity4 *com, uint16_t len);
+void p_format_extcommunity6 (FILE *out, int mode, struct dump_announce_extcommunity6 *com, uint16_t len);
+void p_format_largecommunity(FILE *out, int mode, struct dump_announce_largecommunity *com, uint16_t len);
@@ -0,0 +1,26 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+int  p_handoff_busy   (void);
+int  p_handoff_upgrade(struct config_t *config, struct peer_t *peer, int sessions, char *err, size_t errlen);
+int  p_handoff_peer   (struct peer_t *peer, int id, char *ibuf, char *obuf);
+int  p_handoff_receive(struct config_t *config, struct peer_t *peer, int chan, uint32_t mytime);
+int  p_handoff_ack    (uint32_t mytime);
+void p_handoff_restore(struct peer_t *peer, int id, struct buf_t *ibuf, char *obuf);
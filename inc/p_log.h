@@ -20,5 +20,9 @@
 
 void p_log_pid(void);
 void p_log_add(time_t mytime, char *line);
+void p_log_start(void);
+void p_log_reopen(void);
+void p_log_flush(void);
+uint32_t p_log_queue(uint32_t *dropped);
 void p_log_easytime(time_t mytime, char *timestr, int timestrlen);
 void p_log_status(struct config_t *config, struct peer_t *peer, time_t mytime);
@@ -18,15 +18,27 @@
 
 
 int   main(int argc, char *argv[]);
-int   p_main_loop(void);
+int   p_main_loop(int shard);
+void *p_main_accept(void *data);
 void *p_main_peer(void *data);
+void *p_main_peer_resume(void *data);
+void  p_main_peer_session(void *data, int sock, int peerid);
 void  p_main_peer_exit(void *data, int sock);
 void  p_main_peer_work(char *ibuf, char *obuf, int id);
+int   p_main_peer_recv(int id, char *buf, int len);
+void  p_main_peer_latency(int id);
+int   p_main_peer_duplicate(int id, int duplicate);
 void p_main_peer_open(int id, char *obuf);
+void  p_main_peer_capa(struct bgp_param *param, uint8_t type, void *data, uint8_t len);
+void  p_main_peer_refresh(int id, char *obuf);
+void  p_main_peer_eor(int id, uint16_t afi, struct timeval *msgtime);
+void  p_main_peer_rrmarker(int id, struct bgp_refresh *refresh, struct timeval *msgtime);
 void  p_main_peer_send(int id, char *obuf);
 void  p_main_peer_loop(int id);
 void  p_main_syntax(char *prog);
 void  p_main_sighup(int sig);
+void  p_main_reload(void);
+void  p_main_sigusr1(int sig);
 int   mydaemon(int nochdir, int noclose);
 int   mychown(char *path, uid_t uid, gid_t gid, int depth);
 
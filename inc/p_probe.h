@@ -0,0 +1,42 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+/* USDT probes (provider "piranha"), compiled in with ./configure --usdt,
+ * they are a nop instruction until a tracer attaches. Without --usdt
+ * they expand to nothing.
+ *
+ *   message       (id, type, len)        complete BGP message received
+ *   update_start  (id, len)              UPDATE decoding starts
+ *   update_end    (id, len)              UPDATE decoded and dumped
+ *   announce4     (id, prefix, plen)     IPv4 announce dumped, host order
+ *   announce6     (id, prefix*, plen)
+ *   withdrawn4    (id, prefix, plen)     IPv4 withdrawn dumped, host order
+ *   withdrawn6    (id, prefix*, plen)
+ *   rotate        (id, ns)               dump file rotated
+ *   state         (id, status, af)       session state changed
+ */
+
+#ifdef USDT
+#include <sys/sdt.h>
+#define PROBE2(name, a, b)    DTRACE_PROBE2(piranha, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(piranha, name, a, b, c)
+#else
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#endif
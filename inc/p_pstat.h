@@ -0,0 +1,27 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+enum PSTAT_MODE { PSTAT_HUMAN, PSTAT_JSON };
+
+
+int   main(int argc, char *argv[]);
+void  syntax(char *prog);
+char *peer_ip(struct stats_peer_t *peer, char *str, int len);
+void  print_human(struct stats_t *stats, time_t now);
+void  print_json(struct stats_t *stats, time_t now);
+void  print_json_latency(struct stats_peer_t *peer);
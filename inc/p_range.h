@@ -0,0 +1,26 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+struct range_t       *p_range_new   (void);
+void                  p_range_free  (struct range_t *range);
+int                   p_range_parse (char *str, uint8_t *af, uint8_t prefix[16], uint8_t *len);
+int                   p_range_add   (struct range_t *range, uint8_t af, uint8_t prefix[16], uint8_t len, uint32_t as, char *key);
+struct range_entry_t *p_range_lookup(struct range_t *range, uint8_t af, uint8_t *addr);
+struct range_entry_t *p_range_find  (struct range_t *range, struct range_entry_t *entry);
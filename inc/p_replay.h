@@ -0,0 +1,64 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#define REPLAY_NONE       0
+#define REPLAY_ANNOUNCE4  1
+#define REPLAY_ANNOUNCE6  2
+#define REPLAY_WITHDRAWN4 3
+#define REPLAY_WITHDRAWN6 4
+
+/* records of the same time and attributes are sent as one UPDATE */
+struct replay_update_t
+{
+	int      kind;              /* REPLAY_* */
+	uint64_t ts;                /* record time in us */
+	uint8_t  attr[SPEAKER_MAXLEN];
+	int      alen;
+	uint8_t  nexthop6[16];
+	uint8_t  nlri[SPEAKER_MAXLEN];
+	int      nlen;
+};
+
+struct replay_t
+{
+	int      sock;
+	double   speedup;           /* 0 sends as fast as possible */
+	double   start;             /* time the first record was sent */
+	uint64_t first;             /* time of the first record in us */
+	struct sockaddr_storage src;
+	uint8_t  sbuf[SPEAKER_SEND_BUFFER];
+	struct speaker_queue_t queue; /* UPDATE messages sent */
+	uint64_t records;
+	uint64_t announces;
+	uint64_t withdrawns;
+	uint64_t skipped;           /* too large for a BGP message */
+	struct replay_update_t update;
+};
+
+int    main(int argc, char *argv[]);
+void   syntax(char *prog);
+int    p_replay_addr(char *str, int port, struct sockaddr_storage *addr);
+int    p_replay_file(char *file);
+void   p_replay_record(struct dump_full_msg *fmsg);
+int    p_replay_attr(struct dump_full_msg *fmsg, uint8_t *attr);
+void   p_replay_add(int kind, uint64_t ts, uint8_t *attr, int alen, uint8_t *nexthop6, uint8_t *prefix, uint8_t plen);
+void   p_replay_eor(uint16_t afi, uint64_t ts);
+void   p_replay_flush(void);
+void   p_replay_wait(uint64_t ts);
+void   p_replay_queue(uint8_t *msg, int len, int flush);
@@ -0,0 +1,27 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+struct rib_t *p_rib_new       (void);
+void          p_rib_free      (struct rib_t *rib);
+int           p_rib_announce4 (struct rib_t *rib, uint32_t prefix,   uint8_t mask, struct attr_t *attr);
+int           p_rib_announce6 (struct rib_t *rib, uint8_t prefix[16], uint8_t mask, struct attr_t *attr);
+void          p_rib_withdrawn4(struct rib_t *rib, uint32_t prefix,   uint8_t mask);
+void          p_rib_withdrawn6(struct rib_t *rib, uint8_t prefix[16], uint8_t mask);
+void          p_rib_stale     (struct rib_t *rib, uint8_t af);
+uint32_t      p_rib_purge     (struct rib_t *rib, uint8_t af);
@@ -18,4 +18,10 @@
 
 
 int p_socket_start(struct config_t *config, struct peer_t *peer);
-int p_socket_accept(struct config_t *config);
+int p_socket_keys(struct config_t *config, struct peer_t *peer);
+int p_socket_listen(struct config_t *config, int af, int shard);
+int p_socket_steer(int sock, int af, uint16_t group);
+int p_socket_accept(struct config_t *config, int shard);
+void p_socket_tune(struct config_t *config, struct peer_t *peer, int id, int sock);
+int p_socket_md5(struct config_t *config, struct peer_t *peer, int id);
+int p_socket_md5_range(struct config_t *config, struct range_entry_t *range, char *key);
@@ -0,0 +1,51 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+/* minimal BGP speaker, used by the benchmark and replay tools */
+
+#define SPEAKER_MAXLEN 4096    /* BGP message size limit, RFC4271 */
+#define SPEAKER_HOLD   90
+#define SPEAKER_SEND_BUFFER 65536
+
+#define SPEAKER_FLUSH     1    /* p_speaker_queue() sends the queued messages */
+#define SPEAKER_KEEPALIVE 2    /* and a keepalive in front of them */
+
+/* messages batched in large writes */
+struct speaker_queue_t
+{
+	uint8_t  *buf;              /* SPEAKER_SEND_BUFFER bytes */
+	int      len;
+	uint64_t msgs;              /* messages queued, keepalives excluded */
+	uint64_t bytes;
+	double   sent;              /* last write, for the keepalives */
+};
+
+int  p_speaker_connect  (struct sockaddr_storage *src, struct sockaddr_storage *dst);
+int  p_speaker_send     (int sock, const void *buf, int len);
+int  p_speaker_msg      (uint8_t *buf, uint8_t type, uint16_t len);
+int  p_speaker_open     (int sock, int af, uint32_t as, uint32_t routerid);
+int  p_speaker_establish(int sock, int timeout);
+int  p_speaker_keepalive(int sock);
+int  p_speaker_drain    (int sock);
+int  p_speaker_attr     (uint8_t *buf, uint8_t flags, uint8_t code, const void *data, uint16_t len);
+int  p_speaker_prefix   (uint8_t *buf, const uint8_t *prefix, uint8_t plen);
+int  p_speaker_update   (uint8_t *buf, const uint8_t *withdrawn, uint16_t wlen,
+                         const uint8_t *attr, uint16_t alen, const uint8_t *nlri, uint16_t nlen);
+int  p_speaker_queue    (int sock, struct speaker_queue_t *queue, const uint8_t *msg, int len, int flush);
+double p_speaker_now    (void);
@@ -0,0 +1,29 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+extern struct stats_t *stats;
+
+/* counters are updated with relaxed atomics, readers never lock */
+#define STATS_ADD(x, n) __atomic_add_fetch(&(x), (n), __ATOMIC_RELAXED)
+#define STATS_SET(x, n) __atomic_store_n(&(x), (n), __ATOMIC_RELAXED)
+
+int  p_stats_init    (void);
+void p_stats_update  (struct config_t *config, struct peer_t *peer, time_t mytime);
+void p_stats_reset   (int id);
+void p_stats_rotation(int id, uint64_t ns);
@@ -20,3 +20,8 @@
 struct dump_file_ctx *p_undump_open(char *file);
 int                   p_undump_close(struct dump_file_ctx *ctx);
 int                   p_undump_readmsg(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg);
+int                   p_undump_record(uint8_t *record, uint32_t len, struct dump_full_msg *fmsg);
+struct feed_ctx      *p_undump_feed_open(char *file);
+int                   p_undump_feed_close(struct feed_ctx *ctx);
+int                   p_undump_feed_replaced(struct feed_ctx *ctx);
+int                   p_undump_feed_next(struct feed_ctx *ctx, struct feed_rec_t *rec, uint8_t *record);
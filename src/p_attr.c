@@ -0,0 +1,194 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <p_defs.h>
+#include <p_attr.h>
+
+/* Path attributes are interned in a global hash table shared by all peer
+ * threads. Identical tuples received from any peer resolve to the same
+ * attr_t, so holders only keep a pointer (equality is a pointer compare)
+ * and the attribute data is stored only once. The table is protected by
+ * striped locks, a bucket uses lock (bucket % ATTR_LOCKS). */
+
+static struct attr_t   *attr_table[ATTR_BUCKETS];
+static pthread_mutex_t  attr_lock[ATTR_LOCKS];
+static uint32_t         attr_id    = 0;
+static uint32_t         attr_count = 0;
+static uint64_t         attr_bytes = 0;
+
+#define ATTR_KEY_OFF offsetof(struct attr_t, origin)
+#define ATTR_KEY_LEN (offsetof(struct attr_t, data) - ATTR_KEY_OFF)
+
+/* init the locks, must be called before any peer thread is started */
+void p_attr_init(void)
+{
+	int i;
+	for(i=0; i<ATTR_LOCKS; i++)
+		pthread_mutex_init(&attr_lock[i], NULL);
+}
+
+/* FNV-1a */
+static uint32_t p_attr_hash(uint8_t *data, size_t len, uint32_t hash)
+{
+	size_t i;
+	for(i=0; i<len; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+/* decode the raw (wire format) attributes and return the matching
+ * interned attribute, the caller owns one reference on it */
+struct attr_t *p_attr_get(uint8_t as4, uint8_t origin, uint32_t nexthop4, uint8_t nexthop6[16],
+                          void *aspath,         uint16_t aspathlen,
+                          void *community,      uint16_t communitylen,
+                          void *extcommunity4,  uint16_t extcommunitylen4,
+                          void *extcommunity6,  uint16_t extcommunitylen6,
+                          void *largecommunity, uint16_t largecommunitylen )
+{
+	struct attr_t *attr;
+	struct attr_t *cur;
+	uint32_t len;
+	uint32_t bucket;
+	int i;
+
+	len = aspathlen * ATTR_ASPATH_LEN + communitylen * ATTR_COMMUNITY_LEN + largecommunitylen * ATTR_LARGECOMMUNITY_LEN
+	    + extcommunitylen4 * ATTR_EXTCOMMUNITY4_LEN + extcommunitylen6 * ATTR_EXTCOMMUNITY6_LEN;
+
+	/* calloc, padding bytes are part of the key */
+	if ( ( attr = calloc(1, sizeof(struct attr_t) + len) ) == NULL )
+		return NULL;
+
+	attr->len               = len;
+	attr->origin            = origin;
+	attr->nexthop4          = nexthop4;
+	attr->aspathlen         = aspathlen;
+	attr->communitylen      = communitylen;
+	attr->largecommunitylen = largecommunitylen;
+	attr->extcommunitylen4  = extcommunitylen4;
+	attr->extcommunitylen6  = extcommunitylen6;
+	memcpy(attr->nexthop6, nexthop6, sizeof(attr->nexthop6));
+
+	/* kept in dump file (big endian) order, announces are written out as is */
+	if ( as4 && aspathlen > 0 )
+		memcpy(ATTR_ASPATH(attr), aspath, aspathlen * ATTR_ASPATH_LEN);
+	else
+		for(i=0; i<aspathlen; i++)
+			ATTR_ASPATH(attr)[i] = htobe32(be16toh(*((uint16_t*)aspath+i)));
+
+	if ( communitylen > 0 )
+		memcpy(ATTR_COMMUNITY(attr), community, communitylen * ATTR_COMMUNITY_LEN);
+
+	if ( largecommunitylen > 0 )
+		memcpy(ATTR_LARGECOMMUNITY(attr), largecommunity, largecommunitylen * ATTR_LARGECOMMUNITY_LEN);
+
+	if ( extcommunitylen4 > 0 )
+		memcpy(ATTR_EXTCOMMUNITY4(attr), extcommunity4, extcommunitylen4 * ATTR_EXTCOMMUNITY4_LEN);
+
+	if ( extcommunitylen6 > 0 )
+		memcpy(ATTR_EXTCOMMUNITY6(attr), extcommunity6, extcommunitylen6 * ATTR_EXTCOMMUNITY6_LEN);
+
+	attr->hash = p_attr_hash((uint8_t*)attr + ATTR_KEY_OFF, ATTR_KEY_LEN, 2166136261u);
+	attr->hash = p_attr_hash((uint8_t*)attr->data, len, attr->hash);
+	bucket     = attr->hash % ATTR_BUCKETS;
+
+	pthread_mutex_lock(&attr_lock[bucket % ATTR_LOCKS]);
+
+	for(cur = attr_table[bucket]; cur != NULL; cur = cur->next)
+	{
+		if ( cur->hash == attr->hash && cur->len == attr->len &&
+		     memcmp((uint8_t*)cur + ATTR_KEY_OFF, (uint8_t*)attr + ATTR_KEY_OFF, ATTR_KEY_LEN) == 0 &&
+		     memcmp(cur->data, attr->data, len) == 0 )
+		{
+			cur->ref++;
+			pthread_mutex_unlock(&attr_lock[bucket % ATTR_LOCKS]);
+			free(attr);
+			return cur;
+		}
+	}
+
+	attr->ref  = 1;
+	attr->id   = __sync_add_and_fetch(&attr_id, 1);
+	attr->next = attr_table[bucket];
+	attr_table[bucket] = attr;
+
+	pthread_mutex_unlock(&attr_lock[bucket % ATTR_LOCKS]);
+
+	__sync_add_and_fetch(&attr_count, 1);
+	__sync_add_and_fetch(&attr_bytes, sizeof(struct attr_t) + len);
+
+	return attr;
+}
+
+/* take an additional reference */
+void p_attr_ref(struct attr_t *attr)
+{
+	uint32_t bucket = attr->hash % ATTR_BUCKETS;
+
+	pthread_mutex_lock(&attr_lock[bucket % ATTR_LOCKS]);
+	attr->ref++;
+	pthread_mutex_unlock(&attr_lock[bucket % ATTR_LOCKS]);
+}
+
+/* drop a reference, the last one frees the attribute */
+void p_attr_release(struct attr_t *attr)
+{
+	uint32_t bucket;
+
+	if ( attr == NULL ) { return; }
+
+	bucket = attr->hash % ATTR_BUCKETS;
+
+	pthread_mutex_lock(&attr_lock[bucket % ATTR_LOCKS]);
+
+	if ( --attr->ref > 0 )
+	{
+		pthread_mutex_unlock(&attr_lock[bucket % ATTR_LOCKS]);
+		return;
+	}
+
+	{
+		struct attr_t **cur = &attr_table[bucket];
+		while(*cur != attr)
+			cur = &(*cur)->next;
+		*cur = attr->next;
+	}
+
+	pthread_mutex_unlock(&attr_lock[bucket % ATTR_LOCKS]);
+
+	__sync_sub_and_fetch(&attr_count, 1);
+	__sync_sub_and_fetch(&attr_bytes, sizeof(struct attr_t) + attr->len);
+
+	free(attr);
+}
+
+/* number of interned attributes and memory used */
+void p_attr_stats(uint32_t *count, uint64_t *bytes)
+{
+	*count = __sync_add_and_fetch(&attr_count, 0);
+	*bytes = __sync_add_and_fetch(&attr_bytes, 0);
+}
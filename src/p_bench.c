@@ -0,0 +1,672 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_speaker.h>
+#include <p_bench.h>
+
+/* Synthetic BGP speaker to benchmark a local piranha: opens N sessions,
+ * sends a generated table as fast as the collector takes it, then churn
+ * rounds. The collector side (ingest, CPU, dump bytes) is read from its
+ * statistics file. */
+
+static struct bench_t bench;
+
+int main(int argc, char *argv[])
+{
+	char *dst = NULL;
+	char *src = NULL;
+	int port = 179;
+	int ready = 0;
+	int a, opt;
+	double t0;
+	uint64_t dump_bytes = 0;
+	uint64_t dump_files = 0;
+
+	bench.sessions    = 1;
+	bench.af          = 4;
+	bench.as          = 65001;
+	bench.prefixes    = 100000;
+	bench.group       = 10;
+	bench.pathlen     = 4;
+	bench.communities = 2;
+	bench.churn       = 0;
+	bench.percent     = 10;
+	bench.timeout     = 60;
+	bench.statsfile   = STATSFILE;
+
+	while ( ( opt = getopt(argc, argv, "6n:d:s:p:a:P:g:l:c:C:w:t:f:") ) != -1 )
+	{
+		switch(opt)
+		{
+			case '6': bench.af          = 6;            break;
+			case 'n': bench.sessions    = atoi(optarg); break;
+			case 'd': dst               = optarg;       break;
+			case 's': src               = optarg;       break;
+			case 'p': port              = atoi(optarg); break;
+			case 'a': bench.as          = strtoul(optarg, NULL, 10); break;
+			case 'P': bench.prefixes    = strtoul(optarg, NULL, 10); break;
+			case 'g': bench.group       = atoi(optarg); break;
+			case 'l': bench.pathlen     = atoi(optarg); break;
+			case 'c': bench.communities = atoi(optarg); break;
+			case 'C': bench.churn       = atoi(optarg); break;
+			case 'w': bench.percent     = atoi(optarg); break;
+			case 't': bench.timeout     = atoi(optarg); break;
+			case 'f': bench.statsfile   = optarg;       break;
+			default:  syntax(argv[0]);
+		}
+	}
+
+	if ( optind != argc || bench.sessions < 1 || bench.group < 1 || bench.pathlen < 1 ||
+		bench.pathlen > BENCH_MAXPATH || bench.communities < 0 || bench.communities > BENCH_MAXCOMM ||
+		bench.percent < 1 || bench.percent > 100 || bench.timeout < 1 || bench.as == 0 )
+		syntax(argv[0]);
+
+	if ( dst == NULL ) dst = bench.af == 4 ? "127.0.0.1" : "::1";
+	if ( src == NULL ) src = bench.af == 4 ? "127.0.0.2" : "::1";
+
+	if ( p_bench_addr(dst, port, &bench.dst) == -1 || p_bench_addr(src, 0, &bench.src) == -1 ||
+		bench.dst.ss_family != bench.src.ss_family || bench.dst.ss_family != ( bench.af == 4 ? AF_INET : AF_INET6 ) )
+	{
+		fprintf(stderr, "invalid or mixed address families '%s' '%s'\n", dst, src);
+		return 1;
+	}
+
+	if ( ( bench.stats = p_bench_stats_open(bench.statsfile) ) == NULL )
+		fprintf(stderr, "no statistics from '%s', collector figures not available\n", bench.statsfile);
+
+	if ( ( bench.session = calloc(bench.sessions, sizeof(struct bench_session_t)) ) == NULL )
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	/* sessions, one source address each */
+	t0 = p_speaker_now();
+
+	for(a=0; a<bench.sessions; a++)
+	{
+		struct bench_session_t *s = &bench.session[a];
+
+		s->id   = a;
+		s->sock = -1;
+		s->stat = -1;
+		memcpy(&s->src, &bench.src, sizeof(s->src));
+		p_bench_addr_add(&s->src, a);
+
+		if ( s->src.ss_family == AF_INET )
+			inet_ntop(AF_INET, &((struct sockaddr_in*)&s->src)->sin_addr, s->name, sizeof(s->name));
+		else
+			inet_ntop(AF_INET6, &((struct sockaddr_in6*)&s->src)->sin6_addr, s->name, sizeof(s->name));
+
+		if ( ( s->queue.buf = malloc(SPEAKER_SEND_BUFFER) ) == NULL ||
+			pthread_create(&s->thread, NULL, p_bench_session, s) != 0 )
+		{
+			fprintf(stderr, "cannot start session %s\n", s->name);
+			return 1;
+		}
+	}
+
+	for(;;)
+	{
+		int pending = 0;
+
+		for(ready=0, a=0; a<bench.sessions; a++)
+		{
+			int state = __atomic_load_n(&bench.session[a].state, __ATOMIC_ACQUIRE);
+			if ( state == 0 ) pending++;
+			if ( state == 1 ) ready++;
+		}
+
+		if ( pending == 0 )
+			break;
+
+		usleep(10000);
+	}
+
+	for(a=0; a<bench.sessions; a++)
+		if ( bench.session[a].state == -1 )
+			fprintf(stderr, "session %s failed, is it a neighbor with AS %u?\n", bench.session[a].name, bench.as);
+
+	printf("%d/%d sessions established in %.2fs\n", ready, bench.sessions, p_speaker_now() - t0);
+
+	if ( ready == 0 )
+		return 1;
+
+	/* collector counters before the first phase */
+	if ( bench.stats != NULL )
+	{
+		usleep(200000);
+
+		for(a=0; a<bench.sessions; a++)
+		{
+			struct bench_session_t *s = &bench.session[a];
+
+			if ( s->state != 1 )
+				continue;
+
+			if ( ( s->stat = p_bench_stats_peer(bench.stats, s) ) == -1 )
+			{
+				fprintf(stderr, "session %s not found in the statistics\n", s->name);
+				continue;
+			}
+
+			s->base     = bench.stats->peer[s->stat].updates;
+			dump_bytes += bench.stats->peer[s->stat].dump_bytes;
+			dump_files += bench.stats->peer[s->stat].dump_files;
+		}
+	}
+
+	printf("%-10s %10s %10s %12s %9s %9s %12s %8s %6s\n",
+		"phase", "prefixes", "updates", "bytes", "send(s)", "ingest(s)", "prefixes/s", "cpu(s)", "cpu%");
+
+	for(a=1; a<=bench.churn+1; a++)
+	{
+		uint64_t prefixes = 0, updates = 0, bytes = 0;
+		double cpu = bench.stats != NULL ? p_bench_cpu(bench.stats->pid) : -1;
+		double send, ingest = -1;
+		char phase[32];
+		int b, done;
+
+		for(b=0; b<bench.sessions; b++)
+		{
+			prefixes -= bench.session[b].prefixes;
+			updates  -= bench.session[b].queue.msgs;
+			bytes    -= bench.session[b].queue.bytes;
+		}
+
+		t0 = p_speaker_now();
+		__atomic_store_n(&bench.phase, a, __ATOMIC_RELEASE);
+
+		do
+		{
+			usleep(1000);
+			for(done=0, b=0; b<bench.sessions; b++)
+				if ( __atomic_load_n(&bench.session[b].phase, __ATOMIC_ACQUIRE) == a ||
+					__atomic_load_n(&bench.session[b].state, __ATOMIC_ACQUIRE) != 1 )
+					done++;
+		}
+		while ( done < bench.sessions );
+
+		send = p_speaker_now() - t0;
+
+		if ( bench.stats != NULL && p_bench_ingest() == 0 )
+			ingest = p_speaker_now() - t0;
+
+		if ( cpu >= 0 )
+			cpu = p_bench_cpu(bench.stats->pid) - cpu;
+
+		for(b=0; b<bench.sessions; b++)
+		{
+			prefixes += bench.session[b].prefixes;
+			updates  += bench.session[b].queue.msgs;
+			bytes    += bench.session[b].queue.bytes;
+		}
+
+		if ( a == 1 )
+			snprintf(phase, sizeof(phase), "table");
+		else
+			snprintf(phase, sizeof(phase), "churn %d", a - 1);
+
+		p_bench_report(phase, send, ingest, prefixes, updates, bytes, cpu);
+	}
+
+	/* closing the sessions closes the dump files, their size is accounted */
+	__atomic_store_n(&bench.stop, 1, __ATOMIC_RELEASE);
+
+	for(a=0; a<bench.sessions; a++)
+		pthread_join(bench.session[a].thread, NULL);
+
+	if ( bench.stats != NULL )
+	{
+		double end = p_speaker_now() + bench.timeout;
+		int up;
+
+		do
+		{
+			usleep(10000);
+			for(up=0, a=0; a<bench.sessions; a++)
+				if ( bench.session[a].stat != -1 && bench.stats->peer[bench.session[a].stat].status == 2 )
+					up++;
+		}
+		while ( up > 0 && p_speaker_now() < end );
+
+		for(a=0; a<bench.sessions; a++)
+		{
+			if ( bench.session[a].stat == -1 )
+				continue;
+			dump_bytes -= bench.stats->peer[bench.session[a].stat].dump_bytes;
+			dump_files -= bench.stats->peer[bench.session[a].stat].dump_files;
+		}
+
+		printf("dump %llu bytes in %llu files\n", (unsigned long long)-dump_bytes, (unsigned long long)-dump_files);
+	}
+
+	return 0;
+}
+
+void syntax(char *prog)
+{
+	printf("Piranha v%s.%s.%s benchmark speaker, Copyright(c) 2004-2017 Pascal Gloor\n",P_VER_MA,P_VER_MI,P_VER_PL);
+	printf("syntax: %s [-6] [-n sessions] [-d collector] [-p port] [-s source] [-a asn]\n", prog);
+	printf("        [-P prefixes] [-g prefixes per update] [-l path length] [-c communities]\n");
+	printf("        [-C churn rounds] [-w churn percent] [-t timeout] [-f statistics file]\n");
+	printf("\n");
+	printf("-6 IPv6 sessions and prefixes (default IPv4)\n");
+	printf("-n sessions, each from the next source address (default 1)\n");
+	printf("-d collector address (default 127.0.0.1 or ::1), -p port (default 179)\n");
+	printf("-s first source address (default 127.0.0.2 or ::1)\n");
+	printf("-a neighbor AS (default 65001)\n");
+	printf("-P prefixes per session (default 100000), -g per UPDATE (default 10)\n");
+	printf("-l AS path length (default 4), -c communities per UPDATE (default 2)\n");
+	printf("-C churn rounds (default 0), each withdraws and announces again -w percent of the prefixes (default 10)\n");
+	printf("-t timeout in seconds (default 60)\n");
+	printf("-f statistics file of the collector (default %s)\n", STATSFILE);
+	exit(1);
+}
+
+int p_bench_addr(char *str, int port, struct sockaddr_storage *addr)
+{
+	struct sockaddr_in  *addr4 = (struct sockaddr_in*)addr;
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6*)addr;
+
+	memset(addr, 0, sizeof(*addr));
+
+	if ( inet_pton(AF_INET, str, &addr4->sin_addr) == 1 )
+	{
+		addr4->sin_family = AF_INET;
+		addr4->sin_port   = htons(port);
+		return 0;
+	}
+
+	if ( inet_pton(AF_INET6, str, &addr6->sin6_addr) == 1 )
+	{
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port   = htons(port);
+		return 0;
+	}
+
+	return -1;
+}
+
+/* add n to the lowest 32 bits of the address */
+void p_bench_addr_add(struct sockaddr_storage *addr, uint32_t n)
+{
+	uint32_t low;
+	uint8_t *ip = addr->ss_family == AF_INET ?
+		(uint8_t*)&((struct sockaddr_in*)addr)->sin_addr :
+		((struct sockaddr_in6*)addr)->sin6_addr.s6_addr + 12;
+
+	memcpy(&low, ip, 4);
+	low = htonl(ntohl(low) + n);
+	memcpy(ip, &low, 4);
+}
+
+void *p_bench_session(void *data)
+{
+	struct bench_session_t *s = data;
+
+	if ( ( s->sock = p_speaker_connect(&s->src, &bench.dst) ) == -1 ||
+		p_speaker_open(s->sock, bench.af, bench.as, 0x0a000001 + s->id) == -1 ||
+		p_speaker_establish(s->sock, bench.timeout) == -1 )
+	{
+		if ( s->sock != -1 )
+			close(s->sock);
+		__atomic_store_n(&s->state, -1, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	__atomic_store_n(&s->state, 1, __ATOMIC_RELEASE);
+	s->queue.sent = p_speaker_now();
+
+	while ( ! __atomic_load_n(&bench.stop, __ATOMIC_ACQUIRE) && s->state == 1 )
+	{
+		int phase = __atomic_load_n(&bench.phase, __ATOMIC_ACQUIRE);
+
+		if ( phase > s->phase )
+		{
+			if ( phase == 1 )
+				p_bench_table(s);
+			else
+				p_bench_churn(s, phase - 1);
+
+			__atomic_store_n(&s->phase, phase, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		if ( p_speaker_drain(s->sock) == -1 )
+		{
+			__atomic_store_n(&s->state, -1, __ATOMIC_RELEASE);
+			break;
+		}
+
+		if ( p_speaker_now() - s->queue.sent > SPEAKER_HOLD / 3 )
+			p_bench_queue(s, NULL, 0, SPEAKER_KEEPALIVE);
+
+		usleep(10000);
+	}
+
+	close(s->sock);
+
+	return NULL;
+}
+
+/* the whole table then End-of-RIB */
+void p_bench_table(struct bench_session_t *s)
+{
+	uint8_t msg[SPEAKER_MAXLEN];
+	uint32_t i = 0;
+	int len;
+
+	while ( i < bench.prefixes && s->state == 1 )
+	{
+		int n = p_bench_update(s, i, 1, 0, 0, msg, &len);
+
+		p_bench_queue(s, msg, len, 0);
+		s->prefixes += n;
+		i += n;
+	}
+
+	if ( bench.af == 4 )
+		len = p_speaker_update(msg, NULL, 0, NULL, 0, NULL, 0);
+	else
+	{
+		uint8_t afi[3] = { 0, 2, 1 };
+		uint8_t attr[8];
+		int alen = p_speaker_attr(attr, 0x80, BGP_ATTR_MP_UNREACH_NLRI, afi, sizeof(afi));
+
+		len = p_speaker_update(msg, NULL, 0, attr, alen, NULL, 0);
+	}
+
+	p_bench_queue(s, msg, len, SPEAKER_FLUSH);
+}
+
+/* withdraw every step-th prefix, then announce them with a new path */
+void p_bench_churn(struct bench_session_t *s, int round)
+{
+	uint8_t msg[SPEAKER_MAXLEN];
+	int step = 100 / bench.percent;
+	int withdraw;
+	int len;
+
+	for(withdraw=1; withdraw>=0; withdraw--)
+	{
+		uint32_t i = round % step;
+
+		while ( i < bench.prefixes && s->state == 1 )
+		{
+			int n = p_bench_update(s, i, step, round, withdraw, msg, &len);
+
+			p_bench_queue(s, msg, len, 0);
+			s->prefixes += n;
+			i += n * step;
+		}
+	}
+
+	p_bench_queue(s, msg, 0, SPEAKER_FLUSH);
+}
+
+/* the i-th prefix of the table, a /24 from 1.0.0.0 or a /48 from 2a00:: */
+int p_bench_prefix(uint32_t i, uint8_t *prefix)
+{
+	uint32_t p;
+
+	memset(prefix, 0, 16);
+
+	if ( bench.af == 4 )
+	{
+		p = htonl(0x01000000 + ( ( i << 8 ) % 0xdf000000 ));
+		memcpy(prefix, &p, 4);
+		return 24;
+	}
+
+	prefix[0] = 0x2a;
+	p = htonl(i);
+	memcpy(prefix + 2, &p, 4);
+	return 48;
+}
+
+/* one UPDATE with up to bench.group prefixes from first, every step-th,
+ * sharing the attributes. returns the number of prefixes */
+int p_bench_update(struct bench_session_t *s, uint32_t first, int step, int round, int withdraw, uint8_t *buf, int *len)
+{
+	uint8_t attr[SPEAKER_MAXLEN];
+	uint8_t nlri[SPEAKER_MAXLEN];
+	uint8_t data[SPEAKER_MAXLEN];
+	uint32_t key = first / bench.group + round * 7919;
+	int alen = 0;
+	int nlen = 0;
+	int count = 0;
+	int room;
+	uint32_t i;
+	int a;
+
+	if ( ! withdraw )
+	{
+		data[0] = 0;
+		alen += p_speaker_attr(attr + alen, 0x40, BGP_ATTR_ORIGIN, data, 1);
+
+		/* AS_SEQUENCE starting with the neighbor */
+		data[0] = 2;
+		data[1] = bench.pathlen;
+		for(a=0; a<bench.pathlen; a++)
+		{
+			uint32_t as = htonl( a == 0 ? bench.as : 64512 + ( key * 31 + a * 7 ) % 1000 );
+			memcpy(data + 2 + a * 4, &as, 4);
+		}
+		alen += p_speaker_attr(attr + alen, 0x40, BGP_ATTR_AS_PATH, data, 2 + bench.pathlen * 4);
+
+		if ( bench.af == 4 )
+			alen += p_speaker_attr(attr + alen, 0x40, BGP_ATTR_NEXT_HOP, &((struct sockaddr_in*)&s->src)->sin_addr, 4);
+
+		for(a=0; a<bench.communities; a++)
+		{
+			uint16_t c[2];
+			c[0] = htons(bench.as & 0xffff);
+			c[1] = htons(( key * 13 + a ) & 0xffff);
+			memcpy(data + a * 4, c, 4);
+		}
+		if ( bench.communities > 0 )
+			alen += p_speaker_attr(attr + alen, 0xc0, BGP_ATTR_COMMUNITY, data, bench.communities * 4);
+	}
+
+	/* header, the two length fields and the MP_(UN)REACH_NLRI overhead */
+	room = SPEAKER_MAXLEN - BGP_HEADER_LEN - 4 - alen - ( bench.af == 4 ? 0 : withdraw ? 7 : 25 );
+
+	for(i=first; i<bench.prefixes && count<bench.group; i+=step)
+	{
+		uint8_t prefix[16];
+		uint8_t plen = p_bench_prefix(i, prefix);
+
+		if ( nlen + 1 + ( plen + 7 ) / 8 > room )
+			break;
+
+		nlen += p_speaker_prefix(nlri + nlen, prefix, plen);
+		count++;
+	}
+
+	if ( bench.af == 4 )
+	{
+		if ( withdraw )
+			*len = p_speaker_update(buf, nlri, nlen, NULL, 0, NULL, 0);
+		else
+			*len = p_speaker_update(buf, NULL, 0, attr, alen, nlri, nlen);
+		return count;
+	}
+
+	/* IPv6 unicast, RFC4760 */
+	data[0] = 0;
+	data[1] = 2;
+	data[2] = 1;
+
+	if ( withdraw )
+	{
+		memcpy(data + 3, nlri, nlen);
+		alen = p_speaker_attr(attr, 0x80, BGP_ATTR_MP_UNREACH_NLRI, data, 3 + nlen);
+	}
+	else
+	{
+		data[3] = 16;
+		memcpy(data + 4, &((struct sockaddr_in6*)&s->src)->sin6_addr, 16);
+		data[20] = 0;
+		memcpy(data + 21, nlri, nlen);
+		alen += p_speaker_attr(attr + alen, 0x80, BGP_ATTR_MP_REACH_NLRI, data, 21 + nlen);
+	}
+
+	*len = p_speaker_update(buf, NULL, 0, attr, alen, NULL, 0);
+
+	return count;
+}
+
+/* batch the messages in large writes */
+void p_bench_queue(struct bench_session_t *s, uint8_t *msg, int len, int flush)
+{
+	if ( p_speaker_queue(s->sock, &s->queue, msg, len, flush) == -1 )
+		__atomic_store_n(&s->state, -1, __ATOMIC_RELEASE);
+}
+
+struct stats_t *p_bench_stats_open(char *file)
+{
+	struct stats_t *stats;
+	struct stat sb;
+	int fd;
+
+	if ( ( fd = open(file, O_RDONLY) ) == -1 )
+		return NULL;
+
+	if ( fstat(fd, &sb) == -1 || sb.st_size < sizeof(struct stats_t) ||
+		( stats = mmap(NULL, sizeof(struct stats_t), PROT_READ, MAP_SHARED, fd, 0) ) == MAP_FAILED )
+	{
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	if ( __atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+		stats->version != STATS_VERSION || stats->size < sizeof(struct stats_t) || stats->maxpeers != MAX_PEERS )
+	{
+		munmap(stats, sizeof(struct stats_t));
+		return NULL;
+	}
+
+	return stats;
+}
+
+/* the neighbor entry of the session */
+int p_bench_stats_peer(struct stats_t *stats, struct bench_session_t *s)
+{
+	uint8_t ip[16];
+	int a;
+
+	memset(ip, 0, sizeof(ip));
+
+	if ( s->src.ss_family == AF_INET )
+		memcpy(ip, &((struct sockaddr_in*)&s->src)->sin_addr, 4);
+	else
+		memcpy(ip, &((struct sockaddr_in6*)&s->src)->sin6_addr, 16);
+
+	for(a=0; a<MAX_PEERS; a++)
+		if ( stats->peer[a].allow && stats->peer[a].af == bench.af && memcmp(stats->peer[a].ip, ip, sizeof(ip)) == 0 )
+			return a;
+
+	return -1;
+}
+
+/* wait until the collector decoded every UPDATE sent */
+int p_bench_ingest()
+{
+	double end = p_speaker_now() + bench.timeout;
+
+	while ( p_speaker_now() < end )
+	{
+		int pending = 0;
+		int a;
+
+		for(a=0; a<bench.sessions; a++)
+		{
+			struct bench_session_t *s = &bench.session[a];
+
+			if ( s->state == 1 && s->stat != -1 &&
+				__atomic_load_n(&bench.stats->peer[s->stat].updates, __ATOMIC_RELAXED) < s->base + s->queue.msgs )
+				pending++;
+		}
+
+		if ( pending == 0 )
+			return 0;
+
+		usleep(1000);
+	}
+
+	return -1;
+}
+
+/* user and system time of the collector, Linux only */
+double p_bench_cpu(uint64_t pid)
+{
+	char path[64];
+	char buf[1024];
+	unsigned long utime, stime;
+	FILE *fh;
+	char *pos;
+	size_t len;
+
+	snprintf(path, sizeof(path), "/proc/%llu/stat", (unsigned long long)pid);
+
+	if ( ( fh = fopen(path, "r") ) == NULL )
+		return -1;
+
+	len = fread(buf, 1, sizeof(buf) - 1, fh);
+	fclose(fh);
+	buf[len] = '\0';
+
+	if ( ( pos = strrchr(buf, ')') ) == NULL ||
+		sscanf(pos + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2 )
+		return -1;
+
+	return (double)( utime + stime ) / sysconf(_SC_CLK_TCK);
+}
+
+void p_bench_report(char *phase, double send, double ingest, uint64_t prefixes, uint64_t updates, uint64_t bytes, double cpu)
+{
+	char ingest_str[16], rate_str[16], cpu_str[16], pct_str[16];
+	double elapsed = ingest >= 0 ? ingest : send;
+
+	snprintf(ingest_str, sizeof(ingest_str), ingest >= 0 ? "%.3f" : "-", ingest);
+	snprintf(rate_str,   sizeof(rate_str),   "%.0f", elapsed > 0 ? prefixes / elapsed : 0);
+	snprintf(cpu_str,    sizeof(cpu_str),    cpu >= 0 ? "%.2f" : "-", cpu);
+	snprintf(pct_str,    sizeof(pct_str),    cpu >= 0 && elapsed > 0 ? "%.1f" : "-", cpu * 100 / elapsed);
+
+	printf("%-10s %10llu %10llu %12llu %9.3f %9s %12s %8s %6s\n",
+		phase, (unsigned long long)prefixes, (unsigned long long)updates, (unsigned long long)bytes,
+		send, ingest_str, rate_str, cpu_str, pct_str);
+}
@@ -0,0 +1,221 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <p_defs.h>
+#include <p_buf.h>
+#include <p_cpu.h>
+#include <p_mem.h>
+
+/* Receive buffers. A session normally reads into its own INPUT_SMALL
+ * buffer, a BGP message is at most 4096 bytes so a whole message always
+ * fits. A read filling the space offered means the peer is bursting (table
+ * transfer), the session then borrows an INPUT_BUFFER from the pool shared
+ * by all peer threads and gives it back once idle. The pool memory, borrowed
+ * and spare, is capped with buffer_pool, a session denied a buffer carries
+ * on with its small one. Free buffers are linked through their first bytes,
+ * one list per NUMA node, a session takes a spare buffer from its own node
+ * first and from another node only when the cap is reached. With hugepages
+ * the buffers are carved from huge page slabs and always kept as spare, the
+ * cap then only limits the growth of the pool. */
+
+#define BUF_SLAB ( HUGE_PAGE / INPUT_BUFFER )
+
+static pthread_mutex_t buf_lock   = PTHREAD_MUTEX_INITIALIZER;
+static char           *buf_free[MAX_NODES];
+static uint32_t        buf_spare  = 0;
+static uint32_t        buf_used   = 0;
+static uint64_t        buf_denied = 0;
+static uint64_t        buf_cap    = (uint64_t)BUFFER_POOL * 1048576;
+
+/* pool cap in MB, spare buffers above it are released */
+void p_buf_cap(uint32_t mb)
+{
+	int node;
+
+	pthread_mutex_lock(&buf_lock);
+
+	buf_cap = (uint64_t)mb * 1048576;
+
+	for(node=0; node<MAX_NODES && ! p_mem_huge(); node++)
+	{
+		while ( buf_free[node] != NULL && (uint64_t)(buf_used + buf_spare) * INPUT_BUFFER > buf_cap )
+		{
+			char *next = *(char**)buf_free[node];
+			free(buf_free[node]);
+			buf_free[node] = next;
+			buf_spare--;
+		}
+	}
+
+	pthread_mutex_unlock(&buf_lock);
+}
+
+/* session start, the steady state buffer */
+int p_buf_init(struct buf_t *buf)
+{
+	/* p_buf_free() is safe after a failure */
+	memset(buf, 0, sizeof(*buf));
+
+	if ( ( buf->small = malloc(INPUT_SMALL) ) == NULL )
+		return -1;
+
+	buf->data = buf->small;
+	buf->size = INPUT_SMALL;
+	buf->node = 0;
+
+	return 0;
+}
+
+/* a spare buffer of the node, NULL if none, buf_lock held */
+static char *p_buf_take(int node)
+{
+	char *data = buf_free[node];
+
+	if ( data != NULL )
+	{
+		buf_free[node] = *(char**)data;
+		buf_spare--;
+	}
+
+	return data;
+}
+
+/* a new huge page slab, the first buffer is returned and the others are *
+ * spare ones of the node, buf_lock held                                 */
+static char *p_buf_slab(int node)
+{
+	char *slab;
+	int a;
+
+	if ( ( slab = p_mem_alloc(HUGE_PAGE) ) == NULL )
+		return NULL;
+
+	for(a=BUF_SLAB-1; a>0; a--)
+	{
+		*(char**)(slab + a * INPUT_BUFFER) = buf_free[node];
+		buf_free[node] = slab + a * INPUT_BUFFER;
+		buf_spare++;
+	}
+
+	return slab;
+}
+
+/* borrow a pool buffer keeping the len bytes received, force ignores the cap */
+int p_buf_grow(struct buf_t *buf, int len, int force)
+{
+	char *data = NULL;
+	int node = p_cpu_node();
+	int other;
+
+	if ( buf->data != buf->small )
+		return 0;
+
+	pthread_mutex_lock(&buf_lock);
+
+	if ( ( data = p_buf_take(node) ) == NULL )
+	{
+		/* a new buffer is placed on this node when first written */
+		if ( p_mem_huge() && ( force || (uint64_t)(buf_used + buf_spare + BUF_SLAB) * INPUT_BUFFER <= buf_cap ) )
+			data = p_buf_slab(node);
+		else if ( ! p_mem_huge() && ( force || (uint64_t)(buf_used + buf_spare + 1) * INPUT_BUFFER <= buf_cap ) )
+			data = malloc(INPUT_BUFFER);
+		else
+			for(other=0; data == NULL && other<MAX_NODES; other++)
+				if ( ( data = p_buf_take(other) ) != NULL )
+					node = other;
+	}
+
+	if ( data == NULL )
+	{
+		buf_denied++;
+		pthread_mutex_unlock(&buf_lock);
+		return -1;
+	}
+
+	buf_used++;
+	buf->node = node;
+
+	pthread_mutex_unlock(&buf_lock);
+
+	#ifdef DEBUG
+	printf("DEBUG: receive buffer borrowed, %u in use\n", buf_used);
+	#endif
+
+	memcpy(data, buf->data, len);
+	buf->data = data;
+	buf->size = INPUT_BUFFER;
+
+	return 0;
+}
+
+/* back to the small buffer if the len bytes left fit, the pool buffer is
+   kept as spare or released */
+void p_buf_shrink(struct buf_t *buf, int len)
+{
+	char *data = buf->data;
+
+	if ( data == buf->small || len > INPUT_SMALL )
+		return;
+
+	memcpy(buf->small, data, len);
+	buf->data = buf->small;
+	buf->size = INPUT_SMALL;
+
+	pthread_mutex_lock(&buf_lock);
+
+	buf_used--;
+
+	if ( p_mem_huge() || ( buf_spare < BUFFER_SPARE && (uint64_t)(buf_used + buf_spare + 1) * INPUT_BUFFER <= buf_cap ) )
+	{
+		*(char**)data = buf_free[buf->node];
+		buf_free[buf->node] = data;
+		buf_spare++;
+		data = NULL;
+	}
+
+	pthread_mutex_unlock(&buf_lock);
+
+	free(data);
+}
+
+/* session end */
+void p_buf_free(struct buf_t *buf)
+{
+	p_buf_shrink(buf, 0);
+	free(buf->small);
+	buf->data  = NULL;
+	buf->small = NULL;
+	buf->size  = 0;
+}
+
+/* buffers borrowed, pool memory and denied requests */
+void p_buf_stats(uint32_t *used, uint64_t *bytes, uint64_t *denied)
+{
+	pthread_mutex_lock(&buf_lock);
+	*used   = buf_used;
+	*bytes  = (uint64_t)(buf_used + buf_spare) * INPUT_BUFFER;
+	*denied = buf_denied;
+	pthread_mutex_unlock(&buf_lock);
+}
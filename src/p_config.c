@@ -26,10 +26,103 @@
 #include <pwd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <p_defs.h>
 #include <p_config.h>
 #include <p_tools.h>
+#include <p_socket.h>
+#include <p_log.h>
+#include <p_range.h>
+#include <p_buf.h>
+#include <p_cpu.h>
+
+/* held while the neighbor table is changed, by a reload or the control socket */
+pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* tcp_* options, all unset */
+static void p_config_tcp_init(struct tcpopt_t *tcp)
+{
+	tcp->rcvbuf      = TCP_UNSET;
+	tcp->sndbuf      = TCP_UNSET;
+	tcp->nodelay     = TCP_UNSET;
+	tcp->busypoll    = TCP_UNSET;
+	tcp->usertimeout = TCP_UNSET;
+	tcp->keepidle    = TCP_UNSET;
+	tcp->keepintvl   = TCP_UNSET;
+	tcp->keepcnt     = TCP_UNSET;
+}
+
+/* a tcp_* option and its value(s), global or neighbor_option, -1 if unknown */
+static int p_config_tcp(struct tcpopt_t *tcp, char *opt, char *s)
+{
+	if ( !strcmp(opt, "tcp_rcvbuf") )
+		tcp->rcvbuf = atoi(s);
+	else if ( !strcmp(opt, "tcp_sndbuf") )
+		tcp->sndbuf = atoi(s);
+	else if ( !strcmp(opt, "tcp_nodelay") )
+		tcp->nodelay = !strcmp(s, "yes") ? 1 : 0;
+	else if ( !strcmp(opt, "tcp_busy_poll") )
+		tcp->busypoll = atoi(s);
+	else if ( !strcmp(opt, "tcp_user_timeout") )
+		tcp->usertimeout = atoi(s);
+	else if ( !strcmp(opt, "tcp_keepalive") )
+	{
+		/* <idle> [<interval> <count>] */
+		char *intvl = strtok(NULL, " ");
+		char *cnt   = strtok(NULL, " ");
+
+		tcp->keepidle = atoi(s);
+
+		if ( intvl != NULL && cnt != NULL )
+		{
+			CHOMP(cnt);
+			tcp->keepintvl = atoi(intvl);
+			tcp->keepcnt   = atoi(cnt);
+		}
+	}
+	else
+		return -1;
+
+	#ifdef DEBUG
+	printf("DEBUG: config %s %s\n", opt, s);
+	#endif
+
+	return 0;
+}
+
+/* <ipv4>:<port> or [<ipv6>]:<port> */
+static int p_config_listen(struct sockaddr_storage *listen, char *s)
+{
+	struct sockaddr_in  *sin  = (struct sockaddr_in*)listen;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)listen;
+	char *port;
+
+	if ( ( port = strrchr(s, ':') ) == NULL )
+		return -1;
+
+	*port++ = '\0';
+	memset(listen, 0, sizeof(*listen));
+
+	if ( s[0] == '[' && s[strlen(s)-1] == ']' )
+	{
+		s[strlen(s)-1] = '\0';
+		if ( inet_pton(AF_INET6, s+1, &sin6->sin6_addr) == 1 )
+		{
+			sin6->sin6_family = AF_INET6;
+			sin6->sin6_port   = htons(atoi(port));
+			return 0;
+		}
+	}
+	else if ( inet_pton(AF_INET, s, &sin->sin_addr) == 1 )
+	{
+		sin->sin_family = AF_INET;
+		sin->sin_port   = htons(atoi(port));
+		return 0;
+	}
+
+	return -1;
+}
 
 /* reading configuration file */
 
@@ -49,6 +142,24 @@ int p_config_load(struct config_t *config, struct peer_t *peer, uint32_t mytime)
 
 	config->uid = -1;
 	config->gid = -1;
+	config->grtime = 0;
+	config->status_interval = STATUS_INTERVAL;
+	config->status_format   = STATUS_ASCII;
+	config->shards          = 1;
+	config->reuseport       = REUSEPORT_OFF;
+	config->group           = 0;
+	config->bufpool         = BUFFER_POOL;
+	p_config_tcp_init(&config->tcp);
+	config->cpu_peers.count = 0;
+	config->cpu_aux.count   = 0;
+	config->cpu_spread      = 0;
+	config->hugepages       = HUGEPAGES_OFF;
+	config->feed            = 0;
+	config->stream.sock     = -1;
+	config->stream.lsock    = -1;
+
+	if ( config->range == NULL && ( config->range = p_range_new() ) == NULL )
+		return -1;
 
 	if ( ( fd = fopen(config->file, "r") ) == NULL )
 	{
@@ -161,6 +272,40 @@ int p_config_load(struct config_t *config, struct peer_t *peer, uint32_t mytime)
 				}
 			}
 		}
+		else if ( !strcmp(s,"listen_shards"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 4 )
+			{
+				config->shards = atoi(s) < 1 ? 1 : atoi(s) > MAX_SHARDS ? MAX_SHARDS : atoi(s);
+				#ifdef DEBUG
+				printf("DEBUG: config listen_shards %s",s);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"listen_reuseport"))
+		{
+			/* no, yes or source [group size] */
+			s = strtok(NULL, " ");
+			if ( s != NULL )
+			{
+				char *group = strtok(NULL, " ");
+
+				CHOMP(s);
+				if ( !strcmp(s, "no") )
+					config->reuseport = REUSEPORT_OFF;
+				else if ( !strcmp(s, "yes") )
+					config->reuseport = REUSEPORT_ON;
+				else if ( !strcmp(s, "source") )
+					config->reuseport = REUSEPORT_SOURCE;
+
+				if ( group != NULL && strlen(group) <= 6 )
+					config->group = atoi(group);
+				#ifdef DEBUG
+				printf("DEBUG: config listen_reuseport %s group %u\n", s, config->group);
+				#endif
+			}
+		}
 		else if ( !strcmp(s,"bgp_holdtime"))
 		{
 			s = strtok(NULL, " ");
@@ -172,6 +317,100 @@ int p_config_load(struct config_t *config, struct peer_t *peer, uint32_t mytime)
 				#endif
 			}
 		}
+		else if ( !strcmp(s,"bgp_graceful_restart"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 5 )
+			{
+				config->grtime = atoi(s) > BGP_GR_MAXTIME ? BGP_GR_MAXTIME : atoi(s);
+				#ifdef DEBUG
+				printf("DEBUG: config bgp_graceful_restart %s",s);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"metrics_listen"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 55 )
+			{
+				CHOMP(s);
+				if ( p_config_listen(&config->metrics.listen, s) == 0 )
+					config->metrics.enabled = 1;
+				#ifdef DEBUG
+				printf("DEBUG: config metrics_listen %s enabled %i\n", s, config->metrics.enabled);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"stream_listen"))
+		{
+			/* may be given twice, for a TCP and the unix socket */
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 55 )
+			{
+				CHOMP(s);
+				if ( !strcmp(s, "unix") )
+					config->stream.local = 1;
+				else if ( p_config_listen(&config->stream.listen, s) == 0 )
+					config->stream.enabled = 1;
+				#ifdef DEBUG
+				printf("DEBUG: config stream_listen %s enabled %i unix %i\n", s, config->stream.enabled, config->stream.local);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"status_interval"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 5 )
+			{
+				config->status_interval = atoi(s);
+				#ifdef DEBUG
+				printf("DEBUG: config status_interval %s",s);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"buffer_pool"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 6 )
+			{
+				config->bufpool = atoi(s);
+				#ifdef DEBUG
+				printf("DEBUG: config buffer_pool %s",s);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"feed"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL && strlen(s) > 0 && strlen(s) <= 6 )
+			{
+				config->feed = atoi(s);
+				if ( config->feed > 0 && config->feed < FEED_MIN )
+					config->feed = FEED_MIN;
+				if ( config->feed > FEED_MAX )
+					config->feed = FEED_MAX;
+				#ifdef DEBUG
+				printf("DEBUG: config feed %s",s);
+				#endif
+			}
+		}
+		else if ( !strcmp(s,"status_format"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL )
+			{
+				CHOMP(s);
+				if ( !strcmp(s, "ascii") )
+					config->status_format = STATUS_ASCII;
+				else if ( !strcmp(s, "json") )
+					config->status_format = STATUS_JSON;
+				else if ( !strcmp(s, "tsv") )
+					config->status_format = STATUS_TSV;
+				#ifdef DEBUG
+				printf("DEBUG: config status_format %s\n",s);
+				#endif
+			}
+		}
 		else if ( !strcmp(s, "export"))
 		{
 			s = strtok(NULL, " ");
@@ -200,6 +439,132 @@ int p_config_load(struct config_t *config, struct peer_t *peer, uint32_t mytime)
 				#endif
 			}
 		}
+		else if ( !strcmp(s,"cpu_peers") || !strcmp(s,"cpu_aux") )
+		{
+			struct cpus_t *cpus = !strcmp(s,"cpu_peers") ? &config->cpu_peers : &config->cpu_aux;
+			char *mode;
+
+			s    = strtok(NULL, " ");
+			mode = strtok(NULL, " ");
+
+			if ( s != NULL )
+			{
+				CHOMP(s);
+				if ( p_cpu_parse(cpus, s) == -1 )
+					cpus->count = 0;
+			}
+
+			if ( cpus == &config->cpu_peers && mode != NULL )
+			{
+				CHOMP(mode);
+				config->cpu_spread = !strcmp(mode, "spread");
+			}
+
+			#ifdef DEBUG
+			printf("DEBUG: config cpu set of %u cpu(s)\n", cpus->count);
+			#endif
+		}
+		else if ( !strcmp(s,"hugepages"))
+		{
+			s = strtok(NULL, " ");
+			if ( s != NULL )
+			{
+				CHOMP(s);
+				if ( !strcmp(s, "no") )
+					config->hugepages = HUGEPAGES_OFF;
+				else if ( !strcmp(s, "thp") )
+					config->hugepages = HUGEPAGES_THP;
+				else if ( !strcmp(s, "hugetlb") )
+					config->hugepages = HUGEPAGES_HUGETLB;
+				#ifdef DEBUG
+				printf("DEBUG: config hugepages %s\n", s);
+				#endif
+			}
+		}
+		else if ( !strncmp(s,"tcp_",4))
+		{
+			char *opt = s;
+
+			s = strtok(NULL, " ");
+			if ( s != NULL )
+			{
+				CHOMP(s);
+				p_config_tcp(&config->tcp, opt, s);
+			}
+		}
+		else if ( !strcmp(s,"neighbor_option"))
+		{
+			int id = -1;
+			char *opt;
+
+			s = strtok(NULL, " ");
+			if ( s != NULL )
+				id = p_config_find_peer(peer, s);
+
+			opt = strtok(NULL, " ");
+			s   = strtok(NULL, " ");
+
+			if ( id == -1 || opt == NULL || s == NULL )
+			{
+				#ifdef DEBUG
+				printf("DEBUG: config neighbor_option, unknown neighbor or missing value\n");
+				#endif
+				continue;
+			}
+
+			CHOMP(s);
+
+			#ifdef DEBUG
+			printf("DEBUG: config neighbor_option %i %s %s\n", id, opt, s);
+			#endif
+
+			if ( !strcmp(opt, "duplicate") )
+			{
+				if ( !strcmp(s, "keep") )
+					peer[id].duplicate = DUPLICATE_KEEP;
+				else if ( !strcmp(s, "count") )
+					peer[id].duplicate = DUPLICATE_COUNT;
+				else if ( !strcmp(s, "drop") )
+					peer[id].duplicate = DUPLICATE_DROP;
+			}
+			else if ( !strncmp(opt, "tcp_", 4) )
+				p_config_tcp(&peer[id].tcp, opt, s);
+			#ifdef DEBUG
+			else
+				printf("DEBUG: Unknown neighbor_option %s\n", opt);
+			#endif
+		}
+		else if ( !strcmp(s,"neighbor_range"))
+		{
+			/* <prefix>/<len> <as|any> [key] */
+			char *prefix = strtok(NULL, " ");
+			char *as     = strtok(NULL, " ");
+			char *key    = strtok(NULL, " ");
+			uint8_t net[16];
+			uint8_t af, len;
+
+			if ( prefix == NULL || as == NULL )
+				continue;
+
+			CHOMP(as);
+			if ( key != NULL ) { CHOMP(key); }
+
+			if ( p_range_parse(prefix, &af, net, &len) == -1 ||
+				( strcmp(as, "any") != 0 && strtoul(as, NULL, 10) == 0 ) ||
+				( key != NULL && strlen(key) >= MAX_KEY_LEN ) )
+			{
+				#ifdef DEBUG
+				printf("DEBUG: config neighbor_range, invalid %s %s\n", prefix, as);
+				#endif
+				continue;
+			}
+
+			#ifdef DEBUG
+			printf("DEBUG: config neighbor_range %s as %s\n", prefix, as);
+			#endif
+
+			p_range_add(config->range, af, net, len, strcmp(as, "any") == 0 ? 0 : strtoul(as, NULL, 10), key != NULL ? key : "");
+		}
 		else if ( !strcmp(s,"neighbor"))
 		{
 			s = strtok(NULL, " ");
@@ -319,7 +684,229 @@ int p_config_load(struct config_t *config, struct peer_t *peer, uint32_t mytime)
 	return 0;
 }
 
-/* add, update of peers */
+/* reload, the file is parsed into a scratch table and only the differences *
+ * are applied, the running configuration is kept if the file is invalid    */
+int p_config_reload(struct config_t *config, struct peer_t *peer, uint32_t mytime)
+{
+	struct config_t newconfig;
+	struct peer_t *newpeer;
+	char logline[100 + INET6_ADDRSTRLEN];
+	int relisten;
+	int a, b;
+
+	if ( ( newpeer = calloc(MAX_PEERS, sizeof(struct peer_t)) ) == NULL )
+		return -1;
+
+	memset(&newconfig, 0, sizeof(newconfig));
+	newconfig.file = config->file;
+
+	if ( p_config_load(&newconfig, newpeer, mytime) == -1 )
+	{
+		p_range_free(newconfig.range);
+		free(newpeer);
+		return -1;
+	}
+
+	/* the listening sockets are only re-created if their address or options changed */
+	relisten =
+		newconfig.ip4.enabled != config->ip4.enabled ||
+		newconfig.ip6.enabled != config->ip6.enabled ||
+		( newconfig.ip4.enabled && memcmp(&newconfig.ip4.listen, &config->ip4.listen, sizeof(config->ip4.listen)) != 0 ) ||
+		( newconfig.ip6.enabled && memcmp(&newconfig.ip6.listen, &config->ip6.listen, sizeof(config->ip6.listen)) != 0 ) ||
+		newconfig.reuseport != config->reuseport ||
+		newconfig.group != config->group ||
+		newconfig.tcp.rcvbuf != config->tcp.rcvbuf ||
+		newconfig.tcp.sndbuf != config->tcp.sndbuf;
+
+	if ( newconfig.shards != config->shards )
+		p_log_add(mytime, "listen_shards change ignored, restart needed\n");
+
+	if ( newconfig.metrics.enabled != config->metrics.enabled ||
+		memcmp(&newconfig.metrics.listen, &config->metrics.listen, sizeof(config->metrics.listen)) != 0 )
+		p_log_add(mytime, "metrics_listen change ignored, restart needed\n");
+
+	if ( newconfig.stream.enabled != config->stream.enabled || newconfig.stream.local != config->stream.local ||
+		memcmp(&newconfig.stream.listen, &config->stream.listen, sizeof(config->stream.listen)) != 0 )
+		p_log_add(mytime, "stream_listen change ignored, restart needed\n");
+
+	if ( newconfig.uid != config->uid || newconfig.gid != config->gid )
+		p_log_add(mytime, "user change ignored, restart needed\n");
+
+	if ( newconfig.cpu_aux.count != config->cpu_aux.count ||
+		memcmp(newconfig.cpu_aux.cpu, config->cpu_aux.cpu, config->cpu_aux.count * sizeof(config->cpu_aux.cpu[0])) != 0 )
+		p_log_add(mytime, "cpu_aux change ignored, restart needed\n");
+
+	if ( newconfig.hugepages != config->hugepages )
+		p_log_add(mytime, "hugepages change ignored, restart needed\n");
+
+	if ( newconfig.feed != config->feed )
+		p_log_add(mytime, "feed change ignored, restart needed\n");
+
+	/* used by the sessions opened and the dump files rotated from now on */
+	config->as              = newconfig.as;
+	config->routerid        = newconfig.routerid;
+	config->holdtime        = newconfig.holdtime;
+	config->grtime          = newconfig.grtime;
+	config->export          = newconfig.export;
+	config->status_interval = newconfig.status_interval;
+	config->status_format   = newconfig.status_format;
+	config->tcp             = newconfig.tcp;
+	config->cpu_peers       = newconfig.cpu_peers;
+	config->cpu_spread      = newconfig.cpu_spread;
+
+	if ( newconfig.bufpool != config->bufpool )
+	{
+		config->bufpool = newconfig.bufpool;
+		p_buf_cap(config->bufpool);
+	}
+
+	for(a=0; a<MAX_PEERS; a++)
+		peer[a].newallow = 0;
+
+	for(b=0; b<MAX_PEERS; b++)
+	{
+		char *ip;
+
+		if ( newpeer[b].newallow == 0 )
+			continue;
+
+		ip = newpeer[b].af == 4 ? p_tools_ip4str(MAX_PEERS, &newpeer[b].ip4) : p_tools_ip6str(MAX_PEERS, &newpeer[b].ip6);
+
+		if ( ( a = p_config_match_peer(peer, newpeer[b].af, &newpeer[b].ip4, &newpeer[b].ip6) ) == -1 )
+		{
+			p_config_add_peer(peer, newpeer[b].af, &newpeer[b].ip4, &newpeer[b].ip6, newpeer[b].as, newpeer[b].key, mytime);
+
+			if ( ( a = p_config_match_peer(peer, newpeer[b].af, &newpeer[b].ip4, &newpeer[b].ip6) ) == -1 )
+			{
+				snprintf(logline, sizeof(logline), "%s neighbor not added, no free slot\n", ip);
+				p_log_add(mytime, logline);
+				continue;
+			}
+
+			peer[a].duplicate = newpeer[b].duplicate;
+			peer[a].tcp       = newpeer[b].tcp;
+
+			if ( ! relisten && peer[a].key[0] != '\0' )
+				p_socket_md5(config, peer, a);
+
+			snprintf(logline, sizeof(logline), "%s neighbor added\n", ip);
+			p_log_add(mytime, logline);
+			continue;
+		}
+
+		peer[a].newallow = 1;
+		peer[a].dynamic  = 0;
+
+		if ( peer[a].as != newpeer[b].as )
+		{
+			snprintf(logline, sizeof(logline), "%s neighbor AS changed to %u, session reset\n", ip, newpeer[b].as);
+			p_log_add(mytime, logline);
+
+			peer[a].as     = newpeer[b].as;
+			peer[a].cts    = mytime;
+			peer[a].status = 0;
+		}
+
+		if ( strcmp(peer[a].key, newpeer[b].key) != 0 )
+		{
+			snprintf(logline, sizeof(logline), "%s neighbor password changed\n", ip);
+			p_log_add(mytime, logline);
+
+			strcpy(peer[a].key, newpeer[b].key);
+			if ( ! relisten )
+				p_socket_md5(config, peer, a);
+		}
+
+		if ( peer[a].duplicate != newpeer[b].duplicate )
+		{
+			snprintf(logline, sizeof(logline), "%s neighbor duplicate mode changed\n", ip);
+			p_log_add(mytime, logline);
+
+			peer[a].duplicate = newpeer[b].duplicate;
+		}
+
+		/* used from the next session on */
+		if ( memcmp(&peer[a].tcp, &newpeer[b].tcp, sizeof(peer[a].tcp)) != 0 )
+		{
+			snprintf(logline, sizeof(logline), "%s neighbor tcp options changed\n", ip);
+			p_log_add(mytime, logline);
+
+			peer[a].tcp = newpeer[b].tcp;
+		}
+	}
+
+	free(newpeer);
+
+	/* no more allowed peers, their threads close the sessions, *
+	 * dynamic ones stay while a range still contains them      */
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		struct range_entry_t *range;
+
+		if ( peer[a].allow == 0 || peer[a].newallow == 1 )
+			continue;
+
+		if ( peer[a].dynamic &&
+			( range = p_range_lookup(newconfig.range, peer[a].af, peer[a].af == 4 ? (uint8_t*)&peer[a].ip4 : peer[a].ip6.s6_addr) ) != NULL &&
+			( range->as == 0 || range->as == peer[a].as ) )
+		{
+			peer[a].newallow = 1;
+			continue;
+		}
+
+		snprintf(logline, sizeof(logline), "%s neighbor removed\n",
+			peer[a].af == 4 ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6));
+		p_log_add(mytime, logline);
+
+		if ( peer[a].key[0] != '\0' )
+		{
+			peer[a].key[0] = '\0';
+			if ( ! relisten )
+				p_socket_md5(config, peer, a);
+		}
+
+		peer[a].allow  = 0;
+	}
+
+	for(a=0; a<MAX_PEERS; a++)
+		peer[a].type = peer[a].as == config->as ? BGP_TYPE_IBGP : BGP_TYPE_EBGP;
+
+	/* range keys, the removed ones first in case only the key changed */
+	if ( ! relisten )
+	{
+		struct range_entry_t *range;
+
+		for(range = config->range->list; range != NULL; range = range->next)
+			if ( range->key[0] != '\0' && p_range_find(newconfig.range, range) == NULL )
+				p_socket_md5_range(config, range, "");
+
+		for(range = newconfig.range->list; range != NULL; range = range->next)
+			if ( range->key[0] != '\0' && p_range_find(config->range, range) == NULL )
+				p_socket_md5_range(config, range, range->key);
+	}
+
+	p_range_free(config->range);
+	config->range = newconfig.range;
+
+	if ( relisten )
+	{
+		p_log_add(mytime, "listening address or options changed, re-creating the sockets\n");
+
+		config->ip4.enabled = newconfig.ip4.enabled;
+		config->ip6.enabled = newconfig.ip6.enabled;
+		memcpy(&config->ip4.listen, &newconfig.ip4.listen, sizeof(config->ip4.listen));
+		memcpy(&config->ip6.listen, &newconfig.ip6.listen, sizeof(config->ip6.listen));
+		config->reuseport = newconfig.reuseport;
+		config->group     = newconfig.group;
+
+		if ( p_socket_start(config, peer) == -1 )
+			return -2;
+	}
+
+	return 0;
+}
+
+/* add, update of peers, an AS change resets the session */
 void p_config_add_peer(struct peer_t *peer, uint8_t af, struct in_addr *ip4, struct in6_addr *ip6, uint32_t as, char *key, uint32_t mytime)
 {
 	int a;
@@ -332,36 +919,28 @@ void p_config_add_peer(struct peer_t *peer, uint8_t af, struct in_addr *ip4, str
 	if ( af == 6 && p_tools_ip6zero(ip6) == 1 )
 		return;
 
-	for(a = 0; a<MAX_PEERS; a++)
+	if ( ( a = p_config_match_peer(peer, af, ip4, ip6) ) != -1 )
 	{
-		if ( peer[a].af == af )
+		if ( peer[a].as != as )
 		{
-			if (
-				( af == 4 && p_tools_sameip4(ip4, &peer[a].ip4) && peer[a].allow == 1 ) ||
-				( af == 6 && p_tools_sameip6(ip6, &peer[a].ip6) && peer[a].allow == 1 )
-			) {
-			
-				if ( peer[a].as != as )
-				{
-					peer[a].as     = as;
-					peer[a].cts    = mytime;
-					peer[a].status = 0;
-				}
-				if ( strcmp(peer[a].key, key) != 0 )
-				{
-					strcpy(peer[a].key, key);
-					peer[a].cts    = mytime;
-					peer[a].status = 0;
-				}
-				peer[a].newallow = 1;
-				return;
-			}
+			peer[a].as     = as;
+			peer[a].cts    = mytime;
+			peer[a].status = 0;
 		}
+		/* the listening sockets and the session get it with p_socket_md5() */
+		strcpy(peer[a].key, key);
+
+		peer[a].dynamic   = 0;
+		peer[a].newallow  = 1;
+		peer[a].duplicate = DUPLICATE_KEEP;
+		p_config_tcp_init(&peer[a].tcp);
+		return;
 	}
 
+	/* a removed peer thread still owns its slot until its hold is over */
 	for(a = 0; a<MAX_PEERS; a++)
 	{
-		if ( peer[a].allow == 0 )
+		if ( peer[a].allow == 0 && peer[a].thread == 0 )
 		{
 			if ( af == 4 )
 				memcpy(&peer[a].ip4, ip4, sizeof(*ip4) );
@@ -375,8 +954,91 @@ void p_config_add_peer(struct peer_t *peer, uint8_t af, struct in_addr *ip4, str
 			peer[a].status   = 0;
 			peer[a].sock     = 0;
 			peer[a].cts      = mytime;
+			peer[a].duplicate = DUPLICATE_KEEP;
+			p_config_tcp_init(&peer[a].tcp);
+			peer[a].dynamic  = 0;
 			strcpy(peer[a].key, key);
 			return;
 		}
 	}
 }
+
+/* instantiate a neighbor for a connection from inside a neighbor_range, *
+ * returns the peer id, -1 if no range contains it, -2 if no slot is free */
+int p_config_add_dynamic(struct config_t *config, struct peer_t *peer, uint8_t af, uint8_t *addr, uint32_t mytime)
+{
+	struct range_entry_t *range;
+	int a;
+
+	if ( ( range = p_range_lookup(config->range, af, addr) ) == NULL )
+		return -1;
+
+	for(a = 0; a<MAX_PEERS; a++)
+	{
+		if ( peer[a].allow == 0 && peer[a].thread == 0 )
+		{
+			if ( af == 4 )
+				memcpy(&peer[a].ip4, addr, sizeof(peer[a].ip4));
+			else
+				memcpy(&peer[a].ip6, addr, sizeof(peer[a].ip6));
+
+			/* the range key is on the listening sockets */
+			peer[a].af       = af;
+			peer[a].as       = range->as;
+			peer[a].allow    = 1;
+			peer[a].newallow = 1;
+			peer[a].status   = 0;
+			peer[a].sock     = 0;
+			peer[a].cts      = mytime;
+			peer[a].duplicate = DUPLICATE_KEEP;
+			p_config_tcp_init(&peer[a].tcp);
+			peer[a].dynamic  = 1;
+			peer[a].key[0]   = '\0';
+			peer[a].type     = peer[a].as == config->as ? BGP_TYPE_IBGP : BGP_TYPE_EBGP;
+			return a;
+		}
+	}
+
+	return -2;
+}
+
+/* find an allowed peer by its binary address, returns the peer id or -1 */
+int p_config_match_peer(struct peer_t *peer, uint8_t af, struct in_addr *ip4, struct in6_addr *ip6)
+{
+	int a;
+
+	for(a = 0; a<MAX_PEERS; a++)
+	{
+		if ( peer[a].allow == 1 && peer[a].af == af && (
+			( af == 4 && p_tools_sameip4(ip4, &peer[a].ip4) ) ||
+			( af == 6 && p_tools_sameip6(ip6, &peer[a].ip6) ) ) )
+			return a;
+	}
+
+	return -1;
+}
+
+/* find an allowed peer by its address, returns the peer id or -1 */
+int p_config_find_peer(struct peer_t *peer, char *ip)
+{
+	struct in_addr  ip4;
+	struct in6_addr ip6;
+	int a;
+
+	CHOMP(ip);
+
+	if ( inet_pton(AF_INET, ip, &ip4) == 1 )
+	{
+		for(a=0; a<MAX_PEERS; a++)
+			if ( peer[a].newallow && peer[a].af == 4 && p_tools_sameip4(&ip4, &peer[a].ip4) )
+				return a;
+	}
+	else if ( inet_pton(AF_INET6, ip, &ip6) == 1 )
+	{
+		for(a=0; a<MAX_PEERS; a++)
+			if ( peer[a].newallow && peer[a].af == 6 && p_tools_sameip6(&ip6, &peer[a].ip6) )
+				return a;
+	}
+
+	return -1;
+}
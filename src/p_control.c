@@ -0,0 +1,515 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_config.h>
+#include <p_socket.h>
+#include <p_log.h>
+#include <p_tools.h>
+#include <p_control.h>
+#include <p_handoff.h>
+
+/* The control socket takes one command per line and answers with
+ * optional data lines followed by "ok" or "error: <reason>". Neighbor
+ * changes only touch the neighbor concerned, the configuration file is
+ * not parsed nor written, a reload reverts them. */
+
+static const char *control_status[] = { "down", "temp", "up", };
+static const char *control_duplicate[] = { "keep", "count", "drop", };
+
+static void *p_control_thread  (void *data);
+static void  p_control_client  (struct config_t *config, int sock);
+static void  p_control_command (struct config_t *config, int sock, char *line);
+static void  p_control_printf  (int sock, const char *fmt, ...);
+static void  p_control_show    (struct config_t *config, int sock, char *ip);
+static void  p_control_neighbor(struct config_t *config, int sock, int argc, char **argv);
+static void  p_control_request (struct config_t *config, int sock, char *cmd, char *ip);
+static char *p_control_ip      (struct peer_t *peer, int id);
+
+/* bind the control socket, before the privileges are dropped */
+int p_control_init(struct config_t *config)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if ( strlen(CONTROLFILE) >= sizeof(addr.sun_path) )
+		return -1;
+
+	strcpy(addr.sun_path, CONTROLFILE);
+
+	if ( ( config->control = socket(AF_UNIX, SOCK_STREAM, 0) ) == -1 )
+		return -1;
+
+	/* left over by a previous instance */
+	unlink(CONTROLFILE);
+
+	/* the daemon user and its group only */
+	if ( bind(config->control, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+		chown(CONTROLFILE, config->uid, config->gid) == -1 ||
+		chmod(CONTROLFILE, 0660) == -1 ||
+		listen(config->control, 16) == -1 )
+	{
+		close(config->control);
+		config->control = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* start the control thread, after daemonization */
+void p_control_start(struct config_t *config)
+{
+	pthread_t thread;
+
+	if ( config->control == -1 )
+		return;
+
+	if ( pthread_create(&thread, NULL, p_control_thread, config) == 0 )
+		pthread_detach(thread);
+}
+
+static void *p_control_thread(void *data)
+{
+	struct config_t *config = data;
+
+	for(;;)
+	{
+		struct timeval timeout;
+		int client;
+
+		if ( ( client = accept(config->control, NULL, NULL) ) == -1 )
+		{
+			usleep(100000);
+			continue;
+		}
+
+		timeout.tv_sec  = CONTROL_TIMEOUT;
+		timeout.tv_usec = 0;
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		p_control_client(config, client);
+		close(client);
+	}
+
+	return NULL;
+}
+
+/* commands are run in order until the client closes or goes idle */
+static void p_control_client(struct config_t *config, int sock)
+{
+	char buf[CONTROL_LINE];
+	int len = 0;
+
+	for(;;)
+	{
+		char *eol;
+		int r;
+
+		while ( ( eol = memchr(buf, '\n', len) ) != NULL )
+		{
+			int llen = eol - buf + 1;
+
+			*eol = '\0';
+			p_control_command(config, sock, buf);
+
+			len -= llen;
+			memmove(buf, buf + llen, len);
+		}
+
+		if ( len == sizeof(buf) - 1 )
+		{
+			p_control_printf(sock, "error: line too long\n");
+			return;
+		}
+
+		if ( ( r = recv(sock, buf + len, sizeof(buf) - 1 - len, 0) ) <= 0 )
+		{
+			/* last command without newline */
+			if ( r == 0 && len > 0 )
+			{
+				buf[len] = '\0';
+				p_control_command(config, sock, buf);
+			}
+			return;
+		}
+
+		len += r;
+	}
+}
+
+static void p_control_printf(int sock, const char *fmt, ...)
+{
+	char line[CONTROL_LINE];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	if ( len < 0 )
+		return;
+	if ( len >= sizeof(line) )
+		len = sizeof(line) - 1;
+
+	send(sock, line, len, MSG_NOSIGNAL);
+}
+
+static void p_control_command(struct config_t *config, int sock, char *line)
+{
+	char *argv[6];
+	char *save;
+	int argc = 0;
+
+	while ( argc < 6 && ( argv[argc] = strtok_r(argc == 0 ? line : NULL, " \t\r\n", &save) ) != NULL )
+		argc++;
+
+	/* empty line */
+	if ( argc == 0 )
+		return;
+
+	#ifdef DEBUG
+	printf("DEBUG: control command %s, %i arguments\n", argv[0], argc - 1);
+	#endif
+
+	if ( argc == 6 )
+	{
+		p_control_printf(sock, "error: too many arguments\n");
+	}
+	else if ( !strcmp(argv[0], "help") )
+	{
+		p_control_printf(sock,
+			"show [<ip>]\n"
+			"neighbor add <ip> <asn> [<key>]\n"
+			"neighbor remove <ip>\n"
+			"neighbor option <ip> duplicate <keep|count|drop>\n"
+			"rotate [<ip>]\n"
+			"flush [<ip>]\n"
+			"refresh [<ip>]\n"
+			"reload\n"
+			"upgrade [sessions]\n"
+			"ok\n");
+	}
+	else if ( !strcmp(argv[0], "show") && argc <= 2 )
+	{
+		p_control_show(config, sock, argc == 2 ? argv[1] : NULL);
+	}
+	else if ( !strcmp(argv[0], "neighbor") )
+	{
+		p_control_neighbor(config, sock, argc - 1, argv + 1);
+	}
+	else if ( ( !strcmp(argv[0], "rotate") || !strcmp(argv[0], "flush") || !strcmp(argv[0], "refresh") ) && argc <= 2 )
+	{
+		p_control_request(config, sock, argv[0], argc == 2 ? argv[1] : NULL);
+	}
+	else if ( !strcmp(argv[0], "reload") && argc == 1 )
+	{
+		/* done by the main loop, like kill -HUP */
+		kill(getpid(), SIGHUP);
+		p_control_printf(sock, "ok\n");
+	}
+	else if ( !strcmp(argv[0], "upgrade") && ( argc == 1 || ( argc == 2 && !strcmp(argv[1], "sessions") ) ) )
+	{
+		char err[100 + sizeof(PIRANHA_BIN)];
+
+		/* the new process answers the next commands */
+		if ( p_handoff_upgrade(config, config->peer, argc == 2, err, sizeof(err)) == -1 )
+		{
+			p_control_printf(sock, "error: %s\n", err);
+			return;
+		}
+
+		p_log_add(time(NULL), "upgrade: done, exiting\n");
+		p_control_printf(sock, "ok\n");
+		exit(0);
+	}
+	else
+	{
+		p_control_printf(sock, "error: unknown command or wrong arguments, try help\n");
+	}
+}
+
+/* neighbors state and counters, tab separated */
+static void p_control_show(struct config_t *config, int sock, char *ip)
+{
+	struct peer_t *peer = config->peer;
+	time_t mytime = time(NULL);
+	int only = -1;
+	int a;
+
+	if ( ip != NULL && ( only = p_config_find_peer(peer, ip) ) == -1 )
+	{
+		p_control_printf(sock, "error: unknown neighbor %s\n", ip);
+		return;
+	}
+
+	p_control_printf(sock, "neighbor\tasn\tstatus\tupdown\trecv\tsent\tbytes\tupdates\tprefixes\tlastupdate\tduplicate\n");
+
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		char prefixes[16] = "-";
+		char lastupd[16]  = "-";
+
+		if ( ! peer[a].allow || ( only != -1 && a != only ) )
+			continue;
+
+		if ( peer[a].duplicate != DUPLICATE_KEEP && peer[a].status == 2 )
+			snprintf(prefixes, sizeof(prefixes), "%u", peer[a].prefixes);
+
+		if ( peer[a].uts )
+			snprintf(lastupd, sizeof(lastupd), "%lu", (unsigned long)(mytime - peer[a].uts));
+
+		p_control_printf(sock, "%s\t%u\t%s\t%lu\t%u\t%u\t%llu\t%u\t%s\t%s\t%s\n",
+			p_control_ip(peer, a), peer[a].as, control_status[peer[a].status], (unsigned long)(mytime - peer[a].cts),
+			peer[a].rmsg, peer[a].smsg, (unsigned long long)peer[a].rbytes, peer[a].ucount,
+			prefixes, lastupd, control_duplicate[peer[a].duplicate]);
+	}
+
+	p_control_printf(sock, "ok\n");
+}
+
+/* neighbor add, remove and option, same syntax as the configuration file */
+static void p_control_neighbor(struct config_t *config, int sock, int argc, char **argv)
+{
+	struct peer_t *peer = config->peer;
+	char logline[100 + INET6_ADDRSTRLEN];
+	int id;
+
+	if ( argc >= 3 && argc <= 4 && !strcmp(argv[0], "add") )
+	{
+		struct in_addr  ip4;
+		struct in6_addr ip6;
+		char key[MAX_KEY_LEN];
+		char *end;
+		uint8_t af = 0;
+		uint32_t as = strtoul(argv[2], &end, 10);
+		int old;
+
+		if ( inet_pton(AF_INET, argv[1], &ip4) == 1 )
+			af = 4;
+		else if ( inet_pton(AF_INET6, argv[1], &ip6) == 1 )
+			af = 6;
+
+		if ( af == 0 || ( af == 4 && p_tools_ip4zero(&ip4) ) || ( af == 6 && p_tools_ip6zero(&ip6) ) )
+		{
+			p_control_printf(sock, "error: invalid address %s\n", argv[1]);
+			return;
+		}
+		if ( *end != '\0' || as == 0 )
+		{
+			p_control_printf(sock, "error: invalid asn %s\n", argv[2]);
+			return;
+		}
+		if ( argc == 4 && strlen(argv[3]) >= sizeof(key) )
+		{
+			p_control_printf(sock, "error: key too long or TCP MD5 not supported\n");
+			return;
+		}
+
+		snprintf(key, sizeof(key), "%s", argc == 4 ? argv[3] : "");
+
+		pthread_mutex_lock(&config_lock);
+
+		if ( ( old = p_config_find_peer(peer, argv[1]) ) != -1 )
+		{
+			/* p_config_add_peer() resets the options */
+			uint8_t duplicate = peer[old].duplicate;
+			int rekey = strcmp(peer[old].key, key) != 0;
+
+			p_config_add_peer(peer, af, &ip4, &ip6, as, key, time(NULL));
+			peer[old].duplicate = duplicate;
+			id = old;
+
+			if ( rekey && p_socket_md5(config, peer, id) == -1 )
+			{
+				pthread_mutex_unlock(&config_lock);
+				p_control_printf(sock, "error: failed to set the TCP MD5 key\n");
+				return;
+			}
+		}
+		else
+		{
+			p_config_add_peer(peer, af, &ip4, &ip6, as, key, time(NULL));
+
+			if ( ( id = p_config_find_peer(peer, argv[1]) ) == -1 )
+			{
+				pthread_mutex_unlock(&config_lock);
+				p_control_printf(sock, "error: no free neighbor slot\n");
+				return;
+			}
+
+			if ( key[0] != '\0' && p_socket_md5(config, peer, id) == -1 )
+			{
+				pthread_mutex_unlock(&config_lock);
+				p_control_printf(sock, "error: failed to set the TCP MD5 key\n");
+				return;
+			}
+		}
+
+		peer[id].type = peer[id].as == config->as ? BGP_TYPE_IBGP : BGP_TYPE_EBGP;
+
+		pthread_mutex_unlock(&config_lock);
+
+		snprintf(logline, sizeof(logline), "%s neighbor %s by control (as %u)\n",
+			p_control_ip(peer, id), old == -1 ? "added" : "updated", as);
+		p_log_add(time(NULL), logline);
+	}
+	else if ( argc == 2 && !strcmp(argv[0], "remove") )
+	{
+		pthread_mutex_lock(&config_lock);
+
+		if ( ( id = p_config_find_peer(peer, argv[1]) ) == -1 )
+		{
+			pthread_mutex_unlock(&config_lock);
+			p_control_printf(sock, "error: unknown neighbor %s\n", argv[1]);
+			return;
+		}
+
+		if ( peer[id].key[0] != '\0' )
+		{
+			peer[id].key[0] = '\0';
+			p_socket_md5(config, peer, id);
+		}
+
+		/* the peer thread closes the session */
+		peer[id].newallow = 0;
+		peer[id].allow    = 0;
+
+		pthread_mutex_unlock(&config_lock);
+
+		snprintf(logline, sizeof(logline), "%s neighbor removed by control\n", p_control_ip(peer, id));
+		p_log_add(time(NULL), logline);
+	}
+	else if ( argc == 4 && !strcmp(argv[0], "option") && !strcmp(argv[2], "duplicate") )
+	{
+		uint8_t duplicate;
+
+		if ( !strcmp(argv[3], "keep") )
+			duplicate = DUPLICATE_KEEP;
+		else if ( !strcmp(argv[3], "count") )
+			duplicate = DUPLICATE_COUNT;
+		else if ( !strcmp(argv[3], "drop") )
+			duplicate = DUPLICATE_DROP;
+		else
+		{
+			p_control_printf(sock, "error: invalid duplicate mode %s\n", argv[3]);
+			return;
+		}
+
+		pthread_mutex_lock(&config_lock);
+
+		if ( ( id = p_config_find_peer(peer, argv[1]) ) == -1 )
+		{
+			pthread_mutex_unlock(&config_lock);
+			p_control_printf(sock, "error: unknown neighbor %s\n", argv[1]);
+			return;
+		}
+
+		peer[id].duplicate = duplicate;
+
+		pthread_mutex_unlock(&config_lock);
+	}
+	else
+	{
+		p_control_printf(sock, "error: unknown command or wrong arguments, try help\n");
+		return;
+	}
+
+	p_control_printf(sock, "ok\n");
+}
+
+/* rotate, flush and refresh are done by the peer threads, *
+ * rotate and flush wait for them to finish                */
+static void p_control_request(struct config_t *config, int sock, char *cmd, char *ip)
+{
+	struct peer_t *peer = config->peer;
+	int only = -1;
+	int wait = strcmp(cmd, "refresh") != 0;
+	int a, t;
+
+	if ( ip != NULL )
+	{
+		if ( ( only = p_config_find_peer(peer, ip) ) == -1 )
+		{
+			p_control_printf(sock, "error: unknown neighbor %s\n", ip);
+			return;
+		}
+		if ( peer[only].status != 2 )
+		{
+			p_control_printf(sock, "error: neighbor %s not established\n", ip);
+			return;
+		}
+	}
+
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		if ( peer[a].status != 2 || ( only != -1 && a != only ) )
+			continue;
+
+		if ( !strcmp(cmd, "rotate") )
+			peer[a].rotatereq = 1;
+		else if ( !strcmp(cmd, "flush") )
+			peer[a].flushreq = 1;
+		else
+			peer[a].refreshreq = 1;
+	}
+
+	for(t=0; wait && t<CONTROL_TIMEOUT*100; t++)
+	{
+		int pending = 0;
+
+		for(a=0; a<MAX_PEERS; a++)
+			if ( peer[a].status == 2 && ( peer[a].rotatereq || peer[a].flushreq ) )
+				pending++;
+
+		if ( pending == 0 )
+			break;
+
+		usleep(10000);
+	}
+
+	if ( wait && t == CONTROL_TIMEOUT*100 )
+		p_control_printf(sock, "error: timeout waiting for the neighbors\n");
+	else
+		p_control_printf(sock, "ok\n");
+}
+
+static char *p_control_ip(struct peer_t *peer, int id)
+{
+	return peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6);
+}
@@ -0,0 +1,163 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+#ifdef OS_LINUX
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <p_defs.h>
+#include <p_cpu.h>
+
+/* Thread placement. Peer threads are pinned to cpu_peers when their
+ * session starts, the main thread to cpu_aux before the other threads are
+ * created, they inherit it. A peer thread allocates its buffers once
+ * pinned, the kernel places the pages on the NUMA node of its cpu (first
+ * touch) and the receive buffer pool keeps one spare list per node. */
+
+static uint8_t cpu_node[MAX_CPUS];
+
+#ifdef OS_LINUX
+/* affinity the daemon was started with, for the threads without a set */
+static cpu_set_t cpu_initial;
+static int       cpu_changed = 0;
+#endif
+
+/* cpu list as in /sys, "0-3,8,10-11", -1 if invalid */
+int p_cpu_parse(struct cpus_t *cpus, char *s)
+{
+	char *next;
+
+	cpus->count = 0;
+
+	while ( s != NULL && *s != '\0' && *s != '\n' )
+	{
+		long first, last;
+
+		first = last = strtol(s, &next, 10);
+		if ( next == s )
+			return -1;
+
+		if ( *next == '-' )
+		{
+			s = next + 1;
+			last = strtol(s, &next, 10);
+			if ( next == s )
+				return -1;
+		}
+
+		if ( first < 0 || last < first || last >= MAX_CPUS )
+			return -1;
+
+		for(; first<=last && cpus->count<MAX_CPUS; first++)
+			cpus->cpu[cpus->count++] = first;
+
+		s = *next == ',' ? next + 1 : next;
+	}
+
+	return cpus->count > 0 ? 0 : -1;
+}
+
+/* cpu to NUMA node table, all on node 0 without /sys */
+void p_cpu_init(void)
+{
+	struct cpus_t cpus;
+	char file[64];
+	char line[1024];
+	int node, a;
+	FILE *fh;
+
+	memset(cpu_node, 0, sizeof(cpu_node));
+
+	#ifdef OS_LINUX
+	if ( pthread_getaffinity_np(pthread_self(), sizeof(cpu_initial), &cpu_initial) != 0 )
+		CPU_ZERO(&cpu_initial);
+	#endif
+
+	for(node=0; node<MAX_NODES; node++)
+	{
+		snprintf(file, sizeof(file), "/sys/devices/system/node/node%i/cpulist", node);
+
+		if ( ( fh = fopen(file, "r") ) == NULL )
+			continue;
+
+		if ( fgets(line, sizeof(line), fh) != NULL && p_cpu_parse(&cpus, line) == 0 )
+			for(a=0; a<cpus.count; a++)
+				cpu_node[cpus.cpu[a]] = node;
+
+		fclose(fh);
+	}
+}
+
+/* pin the calling thread to the cpu set, or to the index-th cpu of it   *
+ * (modulo its size) if index is not -1. With an empty set the thread    *
+ * gets the initial affinity back, it may have inherited cpu_aux.        */
+int p_cpu_pin(struct cpus_t *cpus, int index)
+{
+	#ifdef OS_LINUX
+	{
+		cpu_set_t set;
+		int a;
+
+		if ( cpus->count == 0 )
+		{
+			if ( ! cpu_changed || CPU_COUNT(&cpu_initial) == 0 )
+				return 0;
+
+			return pthread_setaffinity_np(pthread_self(), sizeof(cpu_initial), &cpu_initial) == 0 ? 0 : -1;
+		}
+
+		cpu_changed = 1;
+		CPU_ZERO(&set);
+
+		if ( index >= 0 )
+			CPU_SET(cpus->cpu[index % cpus->count], &set);
+		else
+			for(a=0; a<cpus->count; a++)
+				CPU_SET(cpus->cpu[a], &set);
+
+		#ifdef DEBUG
+		printf("DEBUG: thread pinned to %i cpu(s)\n", index >= 0 ? 1 : cpus->count);
+		#endif
+
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+	}
+	#else
+	return cpus->count == 0 ? 0 : -1;
+	#endif
+}
+
+/* NUMA node of the cpu running the calling thread */
+int p_cpu_node(void)
+{
+	#ifdef OS_LINUX
+	int cpu = sched_getcpu();
+
+	if ( cpu >= 0 && cpu < MAX_CPUS )
+		return cpu_node[cpu];
+	#endif
+
+	return 0;
+}
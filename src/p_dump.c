@@ -23,12 +23,37 @@
 #include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifdef OS_LINUX
+#include <stdio_ext.h>
+#endif
 
 #include <p_defs.h>
 #include <p_dump.h>
+#include <p_attr.h>
+#include <p_mem.h>
+#include <p_feed.h>
+#include <p_stats.h>
+#include <p_hist.h>
 #include <p_tools.h>
+#include <p_probe.h>
+
+#ifdef OS_LINUX
+#define DUMP_PENDING(fh) __fpending(fh)
+#else
+/* the stdio buffer is opaque, flushes are only seen at close */
+#define DUMP_PENDING(fh) 0
+#endif
+
+/* export set of the dump files opened from now on */
+static uint8_t dump_export;
+
+void p_dump_export(uint8_t export)
+{
+	dump_export = export;
+}
 
 /* opening file */
 void p_dump_open_file(struct peer_t *peer, int id, struct timeval *ts)
@@ -68,6 +93,14 @@ void p_dump_open_file(struct peer_t *peer, int id, struct timeval *ts)
 
 	peer[id].fh = fopen(filename, "wb" );
 	peer[id].empty = 1;
+	peer[id].export = dump_export;
+	peer[id].fts = 0;
+	peer[id].fpending = 0;
+
+	/* the initial table is written in large chunks */
+	if ( peer[id].fh != NULL && peer[id].fbulk && ! ( peer[id].eor & ( peer[id].af == 4 ? 1 : 2 ) ) &&
+		( peer[id].fbuf = p_mem_alloc(DUMP_BUFFER) ) != NULL )
+		setvbuf(peer[id].fh, peer[id].fbuf, _IOFBF, p_mem_round(DUMP_BUFFER));
 }
 
 /* log keepalive msg */
@@ -85,15 +118,49 @@ void p_dump_add_keepalive(struct peer_t *peer, int id, struct timeval *ts)
 		msg.uts  = htobe64((uint64_t)ts->tv_usec);
 		msg.len  = htobe16(0);
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
 	}
 }
 
+/* every record starts here and is copied to the live feed, stdio writing
+ * its buffer to the file shows as a drop of the pending bytes since the
+ * previous record */
+void p_dump_msg(struct peer_t *peer, int id, struct dump_msg *msg)
+{
+	uint64_t now = p_hist_clock();
+	size_t pending = DUMP_PENDING(peer[id].fh);
+
+	if ( peer[id].fts != 0 && pending < peer[id].fpending )
+	{
+		p_hist_add(&stats->peer[id].hist[HIST_FLUSH], now - peer[id].fts);
+		peer[id].fts = pending > 0 ? now : 0;
+	}
+
+	if ( peer[id].fts == 0 )
+		peer[id].fts = now;
+
+	if ( peer[id].serts == 0 )
+		peer[id].serts = now;
+
+	p_feed_begin(peer, id, msg);
+
+	fwrite(msg, sizeof(*msg), 1, peer[id].fh);
+	peer[id].fpending = DUMP_PENDING(peer[id].fh);
+}
+
+/* payload of the record started with p_dump_msg() */
+static void p_dump_data(struct peer_t *peer, int id, const void *data, size_t size, size_t count)
+{
+	fwrite(data, size, count, peer[id].fh);
+	p_feed_data(peer, id, data, size * count);
+}
+
 /* log session close */
 void p_dump_add_close(struct peer_t *peer, int id, struct timeval *ts)
 {
 	if ( peer[id].fh == NULL ) { return; }
 	peer[id].empty = 0;
+	p_dump_add_duplicate(peer,id,ts);
 	{
 		struct dump_msg msg;
 
@@ -102,10 +169,12 @@ void p_dump_add_close(struct peer_t *peer, int id, struct timeval *ts)
 		msg.uts  = htobe64((uint64_t)ts->tv_usec);
 		msg.len  = htobe16(0);
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
 	}
 
-	p_dump_check_file(peer,id,ts);
+	/* the session is over, do not leave it in temp.dump until the next one */
+	p_dump_add_footer(peer,id,ts);
+	p_dump_close_file(peer,id);
 }
 
 /* log session open */
@@ -117,13 +186,89 @@ void p_dump_add_open(struct peer_t *peer, int id, struct timeval *ts)
 	peer[id].empty = 0;
 	{
 		struct dump_msg msg;
+		struct dump_open open;
 
 		msg.type = DUMP_OPEN;
 		msg.ts   = htobe64((uint64_t)ts->tv_sec);
 		msg.uts  = htobe64((uint64_t)ts->tv_usec);
-		msg.len  = htobe16(0);
+		msg.len  = htobe16(sizeof(open));
+
+		open.gr     = peer[id].gr;
+		open.grtime = htobe16(peer[id].grtime);
+
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &open, sizeof(open), 1);
+	}
+}
+
+/* number of duplicate announces not dumped since the last one */
+void p_dump_add_duplicate(struct peer_t *peer, int id, struct timeval *ts)
+{
+	if ( peer[id].fh == NULL || peer[id].dcount == 0 ) { return; }
+	peer[id].empty = 0;
+	{
+		struct dump_msg msg;
+		struct dump_duplicate duplicate;
+
+		msg.type = DUMP_DUPLICATE;
+		msg.ts   = htobe64((uint64_t)ts->tv_sec);
+		msg.uts  = htobe64((uint64_t)ts->tv_usec);
+		msg.len  = htobe16(sizeof(duplicate));
+
+		duplicate.count = htobe32(peer[id].dcount);
+
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &duplicate, sizeof(duplicate), 1);
+	}
+	peer[id].dcount = 0;
+}
+
+/* initial table received */
+void p_dump_add_eor(struct peer_t *peer, int id, struct timeval *ts, uint16_t afi, uint32_t count, uint32_t duration)
+{
+	p_dump_check_file(peer,id,ts);
+
+	if ( peer[id].fh == NULL ) { return; }
+	peer[id].empty = 0;
+	{
+		struct dump_msg msg;
+		struct dump_eor eor;
+
+		msg.type = DUMP_EOR;
+		msg.ts   = htobe64((uint64_t)ts->tv_sec);
+		msg.uts  = htobe64((uint64_t)ts->tv_usec);
+		msg.len  = htobe16(sizeof(eor));
+
+		eor.afi      = htobe16(afi);
+		eor.count    = htobe32(count);
+		eor.duration = htobe32(duration);
+
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &eor, sizeof(eor), 1);
+	}
+}
+
+/* BoRR or EoRR, the routes not announced again in between are withdrawn */
+void p_dump_add_refresh(struct peer_t *peer, int id, struct timeval *ts, uint16_t afi, uint8_t subtype)
+{
+	p_dump_check_file(peer,id,ts);
+
+	if ( peer[id].fh == NULL ) { return; }
+	peer[id].empty = 0;
+	{
+		struct dump_msg msg;
+		struct dump_refresh refresh;
+
+		msg.type = DUMP_REFRESH;
+		msg.ts   = htobe64((uint64_t)ts->tv_sec);
+		msg.uts  = htobe64((uint64_t)ts->tv_usec);
+		msg.len  = htobe16(sizeof(refresh));
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
+		refresh.afi     = htobe16(afi);
+		refresh.subtype = subtype;
+
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &refresh, sizeof(refresh), 1);
 	}
 }
 
@@ -139,7 +284,7 @@ void p_dump_add_footer(struct peer_t *peer, int id, struct timeval *ts)
 		msg.uts  = htobe64((uint64_t)ts->tv_usec);
 		msg.len  = htobe64(0);
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
 	}
 }
 
@@ -149,6 +294,7 @@ void p_dump_add_withdrawn4(struct peer_t *peer, int id, struct timeval *ts, uint
 	p_dump_check_file(peer,id,ts);
 
 	if ( peer[id].fh == NULL ) { return; }
+	PROBE3(withdrawn4, id, prefix, mask);
 	peer[id].empty = 0;
 	{
 		struct dump_msg msg;
@@ -163,8 +309,8 @@ void p_dump_add_withdrawn4(struct peer_t *peer, int id, struct timeval *ts, uint
 
 		msg.len = htobe16(sizeof(withdrawn));
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
-		fwrite(&withdrawn, sizeof(withdrawn), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &withdrawn, sizeof(withdrawn), 1);
 
 	}
 }
@@ -175,6 +321,7 @@ void p_dump_add_withdrawn6(struct peer_t *peer, int id, struct timeval *ts, uint
 	p_dump_check_file(peer,id,ts);
 
 	if ( peer[id].fh == NULL ) { return; }
+	PROBE3(withdrawn6, id, prefix, mask);
 	peer[id].empty = 0;
 	{
 		struct dump_msg msg;
@@ -190,226 +337,122 @@ void p_dump_add_withdrawn6(struct peer_t *peer, int id, struct timeval *ts, uint
 
 		msg.len = htobe16(sizeof(withdrawn));
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
-		fwrite(&withdrawn, sizeof(withdrawn), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &withdrawn, sizeof(withdrawn), 1);
 
 	}
 }
 
 /* log IPv4 bgp announce msg */
 void p_dump_add_announce4(struct peer_t *peer, int id, struct timeval *ts,
-			uint32_t prefix,      uint8_t mask,
-			uint8_t origin,       uint32_t nexthop,
-			void *aspath,         uint16_t aspathlen,
-			void *community,      uint16_t communitylen,
-			void *extcommunity4,  uint16_t extcommunitylen4,
-			void *largecommunity, uint16_t largecommunitylen )
+			uint32_t prefix, uint8_t mask, struct attr_t *attr)
 {
 	p_dump_check_file(peer,id,ts);
 
 	if ( peer[id].fh == NULL ) { return; }
+	PROBE3(announce4, id, prefix, mask);
 	peer[id].empty = 0;
 	{
-		struct dump_msg                     msg;
-		struct dump_announce4               announce;
-		struct dump_announce_aspath         opt_aspath;
-		struct dump_announce_community      opt_community;
-		struct dump_announce_extcommunity4  opt_extcommunity4;
-		struct dump_announce_largecommunity opt_largecommunity;
+		struct dump_msg       msg;
+		struct dump_announce4 announce;
 
 		msg.type = DUMP_ANNOUNCE4;
 		msg.ts   = htobe64((uint64_t)ts->tv_sec);
 		msg.uts  = htobe64((uint64_t)ts->tv_usec);
 		msg.len  = htobe16(sizeof(announce)
-			+ sizeof(opt_aspath.data[0]) * aspathlen 
-			+ sizeof(opt_community.data[0]) * communitylen
-			+ sizeof(opt_extcommunity4.data[0]) * extcommunitylen4
-			+ sizeof(opt_largecommunity.data[0]) * largecommunitylen );
+			+ ATTR_ASPATH_LEN         * attr->aspathlen
+			+ ATTR_COMMUNITY_LEN      * attr->communitylen
+			+ ATTR_EXTCOMMUNITY4_LEN  * attr->extcommunitylen4
+			+ ATTR_LARGECOMMUNITY_LEN * attr->largecommunitylen );
 
 		announce.mask              = mask;
 		announce.prefix            = htobe32(prefix);
-		announce.origin            = origin;
-		announce.nexthop           = htobe32(nexthop);
-		announce.aspathlen         = aspathlen;
-		announce.communitylen      = communitylen;
-		announce.extcommunitylen4  = extcommunitylen4;
-		announce.largecommunitylen = largecommunitylen;
+		announce.origin            = attr->origin;
+		announce.nexthop           = htobe32(attr->nexthop4);
+		announce.aspathlen         = attr->aspathlen;
+		announce.communitylen      = attr->communitylen;
+		announce.extcommunitylen4  = attr->extcommunitylen4;
+		announce.largecommunitylen = attr->largecommunitylen;
 
 		#ifdef DEBUG
 		{
 			struct in_addr addr;
-			addr.s_addr = htonl(announce.prefix);
-			printf("DUMP ANNOUNCE %s/%u\n",p_tools_ip4str(id, &addr),announce.mask);
+			addr.s_addr = htonl(prefix);
+			printf("DUMP ANNOUNCE %s/%u attr %u\n",p_tools_ip4str(id, &addr),announce.mask,attr->id);
 		}
 		#endif
 
-		if ( aspathlen > 0 )
-		{
-			int i;
-			for(i=0; i<aspathlen; i++)
-			{
-				if ( peer[id].as4 )
-					opt_aspath.data[i] = *((uint32_t*)aspath+i);
-				else
-					opt_aspath.data[i] = *((uint16_t*)aspath+i);
-			}
-		}
-
-		if ( communitylen > 0 )
-		{
-			int i;
-			for(i=0; i<communitylen; i++)
-			{
-				opt_community.data[i].asn = *((uint16_t*)community+(i*2));
-				opt_community.data[i].num = *((uint16_t*)community+(i*2)+1);
-			}
-		}
-
-		if ( extcommunitylen4 > 0 )
-		{
-			int i;
-			for(i=0; i<extcommunitylen4; i++)
-			{
-				opt_extcommunity4.data[i].type    = *((uint8_t*)extcommunity4+(i*8));
-				opt_extcommunity4.data[i].subtype = *((uint8_t*)extcommunity4+(i*8)+1);
-				memcpy(opt_extcommunity4.data[i].value, (uint8_t*)extcommunity4+(i*8)+2, 6);
-			}
-		}
-
-		if ( largecommunitylen > 0 )
-		{
-			int i;
-			for(i=0; i<largecommunitylen; i++)
-			{
-				opt_largecommunity.data[i].global = *((uint32_t*)largecommunity+(i*12));
-				opt_largecommunity.data[i].local1 = *((uint32_t*)largecommunity+(i*12)+1);
-				opt_largecommunity.data[i].local2 = *((uint32_t*)largecommunity+(i*12)+1);
-			}
-		}
-
-
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
-		fwrite(&announce, sizeof(announce), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &announce, sizeof(announce), 1);
 
-		if ( aspathlen > 0 )
-			fwrite(&opt_aspath, sizeof(opt_aspath.data[0]), aspathlen, peer[id].fh);
+		/* the interned attributes are already in dump order */
+		if ( attr->aspathlen > 0 )
+			p_dump_data(peer, id, ATTR_ASPATH(attr), ATTR_ASPATH_LEN, attr->aspathlen);
 
-		if ( communitylen > 0 )
-			fwrite(&opt_community, sizeof(opt_community.data[0]), communitylen, peer[id].fh);
+		if ( attr->communitylen > 0 )
+			p_dump_data(peer, id, ATTR_COMMUNITY(attr), ATTR_COMMUNITY_LEN, attr->communitylen);
 
-		if ( extcommunitylen4 > 0 )
-			fwrite(&opt_extcommunity4, sizeof(opt_extcommunity4.data[0]), extcommunitylen4, peer[id].fh);
+		if ( attr->extcommunitylen4 > 0 )
+			p_dump_data(peer, id, ATTR_EXTCOMMUNITY4(attr), ATTR_EXTCOMMUNITY4_LEN, attr->extcommunitylen4);
 
-		if ( largecommunitylen > 0 )
-			fwrite(&opt_largecommunity, sizeof(opt_largecommunity.data[0]), largecommunitylen, peer[id].fh);
+		if ( attr->largecommunitylen > 0 )
+			p_dump_data(peer, id, ATTR_LARGECOMMUNITY(attr), ATTR_LARGECOMMUNITY_LEN, attr->largecommunitylen);
 	}
 }
 /* log IPv6 bgp announce msg */
 void p_dump_add_announce6(struct peer_t *peer, int id, struct timeval *ts,
-			uint8_t prefix[16],   uint8_t mask,
-			uint8_t origin,       uint8_t nexthop[16],
-			void *aspath,         uint16_t aspathlen,
-			void *community,      uint16_t communitylen,
-			void *extcommunity6,  uint16_t extcommunitylen6,
-			void *largecommunity, uint16_t largecommunitylen )
+			uint8_t prefix[16], uint8_t mask, struct attr_t *attr)
 {
 	p_dump_check_file(peer,id,ts);
 
 	if ( peer[id].fh == NULL ) { return; }
+	PROBE3(announce6, id, prefix, mask);
 	peer[id].empty = 0;
 	{
-		struct dump_msg                     msg;
-		struct dump_announce6               announce;
-		struct dump_announce_aspath         opt_aspath;
-		struct dump_announce_community      opt_community;
-		struct dump_announce_extcommunity6  opt_extcommunity6;
-		struct dump_announce_largecommunity opt_largecommunity;
+		struct dump_msg       msg;
+		struct dump_announce6 announce;
 
 		msg.type = DUMP_ANNOUNCE6;
 		msg.ts   = htobe64((uint64_t)ts->tv_sec);
 		msg.uts  = htobe64((uint64_t)ts->tv_usec);
 		msg.len  = htobe16( sizeof(announce)
-			+ sizeof(opt_aspath.data[0]) * aspathlen 
-			+ sizeof(opt_community.data[0]) * communitylen
-			+ sizeof(opt_extcommunity6.data[0]) * extcommunitylen6
-			+ sizeof(opt_largecommunity.data[0]) * largecommunitylen );
+			+ ATTR_ASPATH_LEN         * attr->aspathlen
+			+ ATTR_COMMUNITY_LEN      * attr->communitylen
+			+ ATTR_EXTCOMMUNITY6_LEN  * attr->extcommunitylen6
+			+ ATTR_LARGECOMMUNITY_LEN * attr->largecommunitylen );
 
 		memcpy(announce.prefix, prefix, sizeof(announce.prefix));
 		announce.mask              = mask;
-		announce.origin            = origin;
-		memcpy(announce.nexthop, nexthop, sizeof(announce.nexthop));
-		announce.aspathlen         = aspathlen;
-		announce.communitylen      = communitylen;
-		announce.extcommunitylen6  = extcommunitylen6;
-		announce.largecommunitylen = largecommunitylen;
+		announce.origin            = attr->origin;
+		memcpy(announce.nexthop, attr->nexthop6, sizeof(announce.nexthop));
+		announce.aspathlen         = attr->aspathlen;
+		announce.communitylen      = attr->communitylen;
+		announce.extcommunitylen6  = attr->extcommunitylen6;
+		announce.largecommunitylen = attr->largecommunitylen;
 
 		#ifdef DEBUG
 		{
 			struct in6_addr addr;
 			memcpy(addr.s6_addr, announce.prefix, sizeof(announce.prefix));
-			printf("DUMP ANNOUNCE %s/%u\n",p_tools_ip6str(id, &addr),announce.mask);
+			printf("DUMP ANNOUNCE %s/%u attr %u\n",p_tools_ip6str(id, &addr),announce.mask,attr->id);
 		}
 		#endif
 
-		if ( aspathlen > 0 )
-		{
-			int i;
-			for(i=0; i<aspathlen; i++)
-			{
-				if ( peer[id].as4 )
-					opt_aspath.data[i] = *((uint32_t*)aspath+i);
-				else
-					opt_aspath.data[i] = *((uint16_t*)aspath+i);
-			}
-		}
-
-		if ( communitylen > 0 )
-		{
-			int i;
-			for(i=0; i<communitylen; i++)
-			{
-				opt_community.data[i].asn = *((uint16_t*)community+(i*2));
-				opt_community.data[i].num = *((uint16_t*)community+(i*2)+1);
-			}
-		}
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &announce, sizeof(announce), 1);
 
-		if ( extcommunitylen6 > 0 )
-		{
-			int i;
-			for(i=0; i<extcommunitylen6; i++)
-			{
-				opt_extcommunity6.data[i].type    = *((uint8_t*)extcommunity6+(i*20));
-				opt_extcommunity6.data[i].subtype = *((uint8_t*)extcommunity6+(i*20)+1);
-				memcpy(opt_extcommunity6.data[i].global, (uint8_t*)extcommunity6+(i*8)+2, 16);
-				opt_extcommunity6.data[i].local = *((uint16_t*)(uint8_t*)extcommunity6+(i*8)+18);
-			}
-		}
-
-		if ( largecommunitylen > 0 )
-		{
-			int i;
-			for(i=0; i<largecommunitylen; i++)
-			{
-				opt_largecommunity.data[i].global = *((uint32_t*)largecommunity+(i*12));
-				opt_largecommunity.data[i].local1  = *((uint32_t*)largecommunity+(i*12)+1);
-				opt_largecommunity.data[i].local2  = *((uint32_t*)largecommunity+(i*12)+1);
-			}
-		}
+		/* the interned attributes are already in dump order */
+		if ( attr->aspathlen > 0 )
+			p_dump_data(peer, id, ATTR_ASPATH(attr), ATTR_ASPATH_LEN, attr->aspathlen);
 
-		fwrite(&msg, sizeof(msg), 1, peer[id].fh);
-		fwrite(&announce, sizeof(announce), 1, peer[id].fh);
+		if ( attr->communitylen > 0 )
+			p_dump_data(peer, id, ATTR_COMMUNITY(attr), ATTR_COMMUNITY_LEN, attr->communitylen);
 
-		if ( aspathlen > 0 )
-			fwrite(&opt_aspath, sizeof(opt_aspath.data[0]), aspathlen, peer[id].fh);
+		if ( attr->extcommunitylen6 > 0 )
+			p_dump_data(peer, id, ATTR_EXTCOMMUNITY6(attr), ATTR_EXTCOMMUNITY6_LEN, attr->extcommunitylen6);
 
-		if ( communitylen > 0 )
-			fwrite(&opt_community, sizeof(opt_community.data[0]), communitylen, peer[id].fh);
-
-		if ( extcommunitylen6 > 0 )
-			fwrite(&opt_extcommunity6, sizeof(opt_extcommunity6.data[0]), extcommunitylen6, peer[id].fh);
-
-		if ( largecommunitylen > 0 )
-			fwrite(&opt_largecommunity, sizeof(opt_largecommunity.data[0]), largecommunitylen, peer[id].fh);
+		if ( attr->largecommunitylen > 0 )
+			p_dump_data(peer, id, ATTR_LARGECOMMUNITY(attr), ATTR_LARGECOMMUNITY_LEN, attr->largecommunitylen);
 
 	}
 }
@@ -423,8 +466,14 @@ void p_dump_check_file(struct peer_t *peer, int id, struct timeval *ts)
 
 	if ( mts != peer[id].filets )
 	{
+		struct timespec start, end;
+		int rotate = peer[id].fh != NULL;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
 		if ( peer[id].fh != NULL )
 		{
+			p_dump_add_duplicate(peer,id,ts);
 			p_dump_add_footer(peer,id,ts);
 			p_dump_close_file(peer,id);
 		}
@@ -438,6 +487,15 @@ void p_dump_check_file(struct peer_t *peer, int id, struct timeval *ts)
 			else
 				p_dump_add_header6(peer,id,ts);
 		}
+
+		if ( rotate )
+		{
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			uint64_t ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+
+			p_stats_rotation(id, ns);
+			PROBE2(rotate, id, ns);
+		}
 	}
 	else if ( peer[id].fh == NULL && peer[id].status != 0)
 	{
@@ -449,6 +507,65 @@ void p_dump_check_file(struct peer_t *peer, int id, struct timeval *ts)
 	}
 }
 
+/* rotation requested on the control socket, the new file is named after
+ * the current second, it is skipped if that would reuse the current name */
+void p_dump_rotate(struct peer_t *peer, int id, struct timeval *ts)
+{
+	struct timespec start, end;
+	struct tm *tm;
+	char filename[1024];
+	char mytime[100];
+	time_t now = ts->tv_sec;
+	uint64_t ns;
+
+	if ( peer[id].fh == NULL ) { return; }
+
+	tm = gmtime(&now);
+	strftime(mytime, sizeof(mytime), "%Y%m%d%H%M%S" , tm);
+
+	snprintf(filename, sizeof(filename), "%s/%s/%s",
+		DUMPDIR,
+		peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6),
+		mytime);
+
+	if ( strcmp(filename, peer[id].filename) == 0 ) { return; }
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	p_dump_add_duplicate(peer,id,ts);
+	p_dump_add_footer(peer,id,ts);
+	p_dump_close_file(peer,id);
+
+	p_dump_open_file(peer,id,ts);
+	strcpy(peer[id].filename, filename);
+
+	if ( peer[id].af == 4 )
+		p_dump_add_header4(peer,id,ts);
+	else
+		p_dump_add_header6(peer,id,ts);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+
+	p_stats_rotation(id, ns);
+	PROBE2(rotate, id, ns);
+}
+
+/* flush requested on the control socket, hands the buffered records to the kernel */
+void p_dump_flush(struct peer_t *peer, int id)
+{
+	if ( peer[id].fh == NULL ) { return; }
+
+	fflush(peer[id].fh);
+
+	if ( peer[id].fts != 0 )
+	{
+		p_hist_add(&stats->peer[id].hist[HIST_FLUSH], p_hist_clock() - peer[id].fts);
+		peer[id].fts = 0;
+	}
+	peer[id].fpending = 0;
+}
+
 /* file header */
 void p_dump_add_header4(struct peer_t *peer, int id, struct timeval *ts)
 {
@@ -466,8 +583,8 @@ void p_dump_add_header4(struct peer_t *peer, int id, struct timeval *ts)
 		header.as   = htobe32(peer[id].as);
 		header.type = peer[id].type;
 
-		fwrite(&msg,    sizeof(msg),    1, peer[id].fh);
-		fwrite(&header, sizeof(header), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &header, sizeof(header), 1);
 	}
 }
 
@@ -488,8 +605,8 @@ void p_dump_add_header6(struct peer_t *peer, int id, struct timeval *ts)
 		header.as   = htobe32(peer[id].as);
 		header.type = peer[id].type;
 
-		fwrite(&msg,    sizeof(msg),    1, peer[id].fh);
-		fwrite(&header, sizeof(header), 1, peer[id].fh);
+		p_dump_msg(peer, id, &msg);
+		p_dump_data(peer, id, &header, sizeof(header), 1);
 	}
 }
 
@@ -500,7 +617,35 @@ void p_dump_close_file(struct peer_t *peer, int id)
 
 	if ( peer[id].fh == NULL ) { return; }
 
+	/* without End-of-RIB, the initial table is over once a file of a  *
+	 * whole interval does not fill the buffer, an idle session does   *
+	 * not keep it. The first file starts before the session, partial  */
+	if ( peer[id].fbuf != NULL && peer[id].filets * 1000 >= peer[id].ests &&
+		( peer[id].empty == 1 || ftell(peer[id].fh) < DUMP_BUFFER ) )
+		peer[id].fbulk = 0;
+
+	if ( peer[id].empty == 0 )
+	{
+		long size = ftell(peer[id].fh);
+		if ( size > 0 )
+			STATS_ADD(stats->peer[id].dump_bytes, size);
+		STATS_ADD(stats->peer[id].dump_files, 1);
+	}
+
 	fclose(peer[id].fh);
+	peer[id].fh = NULL;
+
+	if ( peer[id].fts != 0 )
+	{
+		p_hist_add(&stats->peer[id].hist[HIST_FLUSH], p_hist_clock() - peer[id].fts);
+		peer[id].fts = 0;
+	}
+
+	if ( peer[id].fbuf != NULL )
+	{
+		p_mem_free(peer[id].fbuf, DUMP_BUFFER);
+		peer[id].fbuf = NULL;
+	}
 
 	snprintf(filename, sizeof(filename), "%s/%s/%s",
 		DUMPDIR,
@@ -514,3 +659,45 @@ void p_dump_close_file(struct peer_t *peer, int id)
 		unlink(peer[id].filename);
 	}
 }
+
+/* binary upgrade, hands the open dump file over without renaming it, *
+ * returns a descriptor of temp.dump or -1 without dump file           */
+int p_dump_detach_file(struct peer_t *peer, int id)
+{
+	int fd;
+
+	if ( peer[id].fh == NULL ) { return -1; }
+
+	fflush(peer[id].fh);
+	fd = dup(fileno(peer[id].fh));
+
+	fclose(peer[id].fh);
+	peer[id].fh = NULL;
+	peer[id].fts = 0;
+	peer[id].fpending = 0;
+
+	if ( peer[id].fbuf != NULL )
+	{
+		p_mem_free(peer[id].fbuf, DUMP_BUFFER);
+		peer[id].fbuf = NULL;
+	}
+
+	return fd;
+}
+
+/* continue writing a dump file handed over, filename and filets are set */
+void p_dump_adopt_file(struct peer_t *peer, int id, int fd)
+{
+	if ( ( peer[id].fh = fdopen(fd, "ab") ) == NULL )
+	{
+		close(fd);
+		return;
+	}
+
+	peer[id].fts = 0;
+	peer[id].fpending = 0;
+
+	if ( peer[id].fbulk && ! ( peer[id].eor & ( peer[id].af == 4 ? 1 : 2 ) ) &&
+		( peer[id].fbuf = p_mem_alloc(DUMP_BUFFER) ) != NULL )
+		setvbuf(peer[id].fh, peer[id].fbuf, _IOFBF, p_mem_round(DUMP_BUFFER));
+}
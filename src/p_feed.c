@@ -0,0 +1,188 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+
+#include <p_defs.h>
+#include <p_feed.h>
+
+/* Live feed. Every dump record is also copied to a ring in a shared file
+ * mapping (FEEDFILE), so local readers get the updates as they are decoded
+ * instead of waiting for the dump file rotation. Peer threads reserve the
+ * space of a record under a lock and copy it without, the record is
+ * published by storing its seq. The writers never wait for the readers, a
+ * reader too slow is overrun and counts the records it lost from the seq
+ * of the next one, see p_undump_feed_next(). */
+
+static pthread_mutex_t feed_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct feed_t  *feed      = NULL;
+static uint8_t        *feed_ring = NULL;
+
+/* create the ring, a new file replaces the one of a previous process so its
+ * readers are not truncated under their feet */
+int p_feed_init(uint32_t mb)
+{
+	struct feed_t *map;
+	size_t len;
+	int fd;
+
+	if ( mb == 0 )
+		return 0;
+
+	len = sizeof(struct feed_t) + (size_t)mb * 1048576;
+
+	if ( ( fd = open(FEEDTEMP, O_RDWR | O_CREAT | O_TRUNC, 0644) ) == -1 )
+		return -1;
+
+	if ( ftruncate(fd, len) == -1 )
+	{
+		close(fd);
+		unlink(FEEDTEMP);
+		return -1;
+	}
+
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( map == MAP_FAILED )
+	{
+		unlink(FEEDTEMP);
+		return -1;
+	}
+
+	map->version = FEED_VERSION;
+	map->size    = (uint64_t)mb * 1048576;
+	map->started = time(NULL);
+	map->reserve = 0;
+	map->seq     = 1;
+
+	/* readers wait for the magic */
+	__atomic_store_n(&map->magic, FEED_MAGIC, __ATOMIC_RELEASE);
+
+	if ( rename(FEEDTEMP, FEEDFILE) == -1 )
+	{
+		munmap(map, len);
+		unlink(FEEDTEMP);
+		return -1;
+	}
+
+	feed_ring = (uint8_t*)map + sizeof(struct feed_t);
+	feed      = map;
+
+	return 0;
+}
+
+/* called by p_dump_msg(), the payload follows with p_feed_data() */
+void p_feed_begin(struct peer_t *peer, int id, struct dump_msg *msg)
+{
+	struct feed_rec_t *rec;
+	uint32_t len = sizeof(*msg) + be16toh(msg->len);
+	uint64_t need = FEED_ALIGN(sizeof(struct feed_rec_t) + len);
+	uint64_t reserve, pos, left;
+
+	peer[id].feedrec = NULL;
+
+	if ( feed == NULL )
+		return;
+
+	pthread_mutex_lock(&feed_lock);
+
+	reserve = feed->reserve;
+	pos     = reserve % feed->size;
+	left    = feed->size - pos;
+
+	/* a record never wraps */
+	if ( left < need )
+	{
+		if ( left >= sizeof(struct feed_rec_t) )
+		{
+			rec = (struct feed_rec_t*)(feed_ring + pos);
+			memset(rec, 0, sizeof(*rec));
+			rec->type = FEED_WRAP;
+			__atomic_store_n(&rec->seq, feed->seq, __ATOMIC_RELEASE);
+		}
+		reserve += left;
+		pos = 0;
+	}
+
+	rec = (struct feed_rec_t*)(feed_ring + pos);
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+
+	peer[id].feedpos = reserve;
+	peer[id].feedseq = feed->seq;
+
+	__atomic_store_n(&feed->seq, feed->seq + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&feed->reserve, reserve + need, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&feed_lock);
+
+	rec->len  = len;
+	rec->id   = id;
+	rec->af   = peer[id].af;
+	rec->type = FEED_RECORD;
+	rec->as   = peer[id].as;
+	rec->reserved = 0;
+
+	memset(rec->ip, 0, sizeof(rec->ip));
+	if ( peer[id].af == 4 )
+		memcpy(rec->ip, &peer[id].ip4, sizeof(peer[id].ip4));
+	else
+		memcpy(rec->ip, &peer[id].ip6, sizeof(peer[id].ip6));
+
+	peer[id].feedrec  = rec;
+	peer[id].feedptr  = (uint8_t*)(rec + 1);
+	peer[id].feedleft = len;
+
+	p_feed_data(peer, id, msg, sizeof(*msg));
+}
+
+/* copy a part of the dump record, it is published once complete */
+void p_feed_data(struct peer_t *peer, int id, const void *data, size_t len)
+{
+	if ( peer[id].feedrec == NULL )
+		return;
+
+	/* overrun by the other writers while this one was held up (disk
+	 * write of the dump file), the space belongs to newer records */
+	if ( __atomic_load_n(&feed->reserve, __ATOMIC_ACQUIRE) > peer[id].feedpos + feed->size ||
+		len > peer[id].feedleft )
+	{
+		peer[id].feedrec = NULL;
+		return;
+	}
+
+	memcpy(peer[id].feedptr, data, len);
+	peer[id].feedptr  += len;
+	peer[id].feedleft -= len;
+
+	if ( peer[id].feedleft == 0 )
+	{
+		__atomic_store_n(&peer[id].feedrec->seq, peer[id].feedseq, __ATOMIC_RELEASE);
+		peer[id].feedrec = NULL;
+	}
+}
@@ -0,0 +1,342 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_filter.h>
+
+/* Event filters of the stream server and ptoa -F, one line:
+ *
+ *   [json|binary] [peer <ip>[/<len>]] [prefix <prefix>/<len>]
+ *                 [origin <asn>] [community <asn>:<value>|<g>:<l1>:<l2>]
+ *
+ * Each keyword may be repeated, an event matches if it matches one of the
+ * values of every keyword given. A prefix matches itself and its more
+ * specifics, only announces have an origin and communities. The filters of
+ * the stream subscribers are compiled into the same tries and hash table,
+ * each with its own bit, p_filter_match() returns the bits of an event. */
+
+static void     p_filter_free_node(struct stream_node_t *node);
+static int      p_filter_insert (struct stream_node_t **root, uint8_t *addr, int len, uint64_t bit);
+static uint64_t p_filter_lookup (struct stream_node_t *root, uint8_t *addr, int len);
+static uint32_t p_filter_hash   (uint8_t type, uint32_t *key);
+static void     p_filter_add    (struct stream_filter_t *filter, uint8_t type, uint32_t *key, uint64_t bit);
+static uint64_t p_filter_find   (struct stream_filter_t *filter, uint8_t type, uint32_t *key);
+
+/* one filter line into the compiled filters with the subscriber bit */
+int p_filter_parse(struct stream_filter_t *filter, char *line, uint64_t bit, uint8_t *format)
+{
+	char copy[STREAM_LINE];
+	char *save = NULL;
+	char *s;
+	int peer = 0, prefix = 0, origin = 0, community = 0;
+
+	strncpy(copy, line, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = '\0';
+
+	*format = STREAM_JSON;
+
+	for(s = strtok_r(copy, " \t", &save); s != NULL; s = strtok_r(NULL, " \t", &save))
+	{
+		if ( !strcmp(s, "json") )
+			*format = STREAM_JSON;
+		else if ( !strcmp(s, "binary") )
+			*format = STREAM_BINARY;
+		else if ( !strcmp(s, "peer") || !strcmp(s, "prefix") )
+		{
+			int isprefix = !strcmp(s, "prefix");
+			uint8_t addr[16];
+			char *slash;
+			int af, len;
+
+			if ( ( s = strtok_r(NULL, " \t", &save) ) == NULL )
+				return -1;
+
+			if ( ( slash = strchr(s, '/') ) != NULL )
+				*slash++ = '\0';
+			else if ( isprefix )
+				return -1;
+
+			memset(addr, 0, sizeof(addr));
+			if ( inet_pton(AF_INET, s, addr) == 1 )
+				af = 0;
+			else if ( inet_pton(AF_INET6, s, addr) == 1 )
+				af = 1;
+			else
+				return -1;
+
+			len = slash != NULL ? atoi(slash) : ( af == 0 ? 32 : 128 );
+			if ( len < 0 || len > ( af == 0 ? 32 : 128 ) )
+				return -1;
+
+			if ( p_filter_insert(isprefix ? &filter->prefix[af] : &filter->peer[af], addr, len, bit) == -1 )
+				return -1;
+
+			if ( isprefix )
+				prefix = 1;
+			else
+				peer = 1;
+		}
+		else if ( !strcmp(s, "origin") )
+		{
+			uint32_t key[3] = { 0, 0, 0 };
+
+			if ( ( s = strtok_r(NULL, " \t", &save) ) == NULL )
+				return -1;
+
+			key[0] = strtoul(s, NULL, 10);
+			p_filter_add(filter, STREAM_ORIGIN, key, bit);
+			origin = 1;
+		}
+		else if ( !strcmp(s, "community") )
+		{
+			uint32_t key[3] = { 0, 0, 0 };
+			int n;
+
+			if ( ( s = strtok_r(NULL, " \t", &save) ) == NULL )
+				return -1;
+
+			n = sscanf(s, "%u:%u:%u", &key[0], &key[1], &key[2]);
+
+			if ( n == 2 && key[0] <= 65535 && key[1] <= 65535 )
+				p_filter_add(filter, STREAM_COMMUNITY, key, bit);
+			else if ( n == 3 )
+				p_filter_add(filter, STREAM_LARGE, key, bit);
+			else
+				return -1;
+
+			community = 1;
+		}
+		else
+			return -1;
+	}
+
+	if ( ! peer )      filter->peer_any      |= bit;
+	if ( ! prefix )    filter->prefix_any    |= bit;
+	if ( ! origin )    filter->origin_any    |= bit;
+	if ( ! community ) filter->community_any |= bit;
+	if ( *format == STREAM_BINARY ) filter->binary |= bit;
+
+	return 0;
+}
+
+static void p_filter_free_node(struct stream_node_t *node)
+{
+	if ( node == NULL )
+		return;
+
+	p_filter_free_node(node->child[0]);
+	p_filter_free_node(node->child[1]);
+	free(node);
+}
+
+void p_filter_free(struct stream_filter_t *filter)
+{
+	int a;
+
+	for(a=0; a<2; a++)
+	{
+		p_filter_free_node(filter->peer[a]);
+		p_filter_free_node(filter->prefix[a]);
+	}
+
+	for(a=0; a<STREAM_HASH; a++)
+	{
+		while ( filter->match[a] != NULL )
+		{
+			struct stream_match_t *next = filter->match[a]->next;
+			free(filter->match[a]);
+			filter->match[a] = next;
+		}
+	}
+
+	memset(filter, 0, sizeof(*filter));
+}
+
+static int p_filter_insert(struct stream_node_t **root, uint8_t *addr, int len, uint64_t bit)
+{
+	struct stream_node_t **node = root;
+	int i;
+
+	for(i=0; ; i++)
+	{
+		if ( *node == NULL && ( *node = calloc(1, sizeof(struct stream_node_t)) ) == NULL )
+			return -1;
+
+		if ( i == len )
+			break;
+
+		node = &(*node)->child[ ( addr[i / 8] >> ( 7 - i % 8 ) ) & 1 ];
+	}
+
+	(*node)->mask |= bit;
+
+	return 0;
+}
+
+/* subscribers of the prefixes covering addr/len */
+static uint64_t p_filter_lookup(struct stream_node_t *node, uint8_t *addr, int len)
+{
+	uint64_t mask = 0;
+	int i;
+
+	for(i=0; node != NULL; i++)
+	{
+		mask |= node->mask;
+
+		if ( i == len )
+			break;
+
+		node = node->child[ ( addr[i / 8] >> ( 7 - i % 8 ) ) & 1 ];
+	}
+
+	return mask;
+}
+
+static uint32_t p_filter_hash(uint8_t type, uint32_t *key)
+{
+	return ( type * 2654435761u ^ key[0] * 2246822519u ^ key[1] * 3266489917u ^ key[2] * 668265263u ) % STREAM_HASH;
+}
+
+static void p_filter_add(struct stream_filter_t *filter, uint8_t type, uint32_t *key, uint64_t bit)
+{
+	uint32_t hash = p_filter_hash(type, key);
+	struct stream_match_t *m;
+
+	for(m = filter->match[hash]; m != NULL; m = m->next)
+		if ( m->type == type && memcmp(m->key, key, sizeof(m->key)) == 0 )
+			break;
+
+	if ( m == NULL )
+	{
+		if ( ( m = calloc(1, sizeof(struct stream_match_t)) ) == NULL )
+			return;
+
+		m->type = type;
+		memcpy(m->key, key, sizeof(m->key));
+		m->next = filter->match[hash];
+		filter->match[hash] = m;
+	}
+
+	m->mask |= bit;
+}
+
+static uint64_t p_filter_find(struct stream_filter_t *filter, uint8_t type, uint32_t *key)
+{
+	struct stream_match_t *m;
+
+	for(m = filter->match[p_filter_hash(type, key)]; m != NULL; m = m->next)
+		if ( m->type == type && memcmp(m->key, key, sizeof(m->key)) == 0 )
+			return m->mask;
+
+	return 0;
+}
+
+/* subscribers of an event, evaluated once for all of them */
+uint64_t p_filter_match(struct stream_filter_t *f, struct feed_rec_t *rec, struct dump_full_msg *msg)
+{
+	uint64_t mask;
+	uint8_t prefix[16];
+	uint8_t len = 0;
+	int af = -1;
+	uint16_t aspathlen = 0;
+	uint16_t communitylen = 0;
+	uint16_t largecommunitylen = 0;
+
+	mask = f->peer_any | p_filter_lookup(f->peer[rec->af == 4 ? 0 : 1], rec->ip, rec->af == 4 ? 32 : 128);
+
+	memset(prefix, 0, sizeof(prefix));
+
+	switch(msg->msg.type)
+	{
+		case DUMP_ANNOUNCE4:
+			*(uint32_t*)prefix = htobe32(msg->announce4.prefix);
+			len = msg->announce4.mask;
+			af  = 0;
+			aspathlen         = msg->announce4.aspathlen;
+			communitylen      = msg->announce4.communitylen;
+			largecommunitylen = msg->announce4.largecommunitylen;
+			break;
+		case DUMP_ANNOUNCE6:
+			memcpy(prefix, msg->announce6.prefix, 16);
+			len = msg->announce6.mask;
+			af  = 1;
+			aspathlen         = msg->announce6.aspathlen;
+			communitylen      = msg->announce6.communitylen;
+			largecommunitylen = msg->announce6.largecommunitylen;
+			break;
+		case DUMP_WITHDRAWN4:
+			*(uint32_t*)prefix = htobe32(msg->withdrawn4.prefix);
+			len = msg->withdrawn4.mask;
+			af  = 0;
+			break;
+		case DUMP_WITHDRAWN6:
+			memcpy(prefix, msg->withdrawn6.prefix, 16);
+			len = msg->withdrawn6.mask;
+			af  = 1;
+			break;
+	}
+
+	mask &= f->prefix_any | ( af != -1 ? p_filter_lookup(f->prefix[af], prefix, len) : 0 );
+
+	if ( mask == 0 )
+		return 0;
+
+	/* the origin is the last AS of the path */
+	{
+		uint64_t origin = f->origin_any;
+
+		if ( aspathlen > 0 )
+		{
+			uint32_t key[3] = { msg->aspath.data[aspathlen - 1], 0, 0 };
+			origin |= p_filter_find(f, STREAM_ORIGIN, key);
+		}
+
+		mask &= origin;
+	}
+
+	if ( ( mask & ~f->community_any ) != 0 )
+	{
+		uint64_t community = f->community_any;
+		int i;
+
+		for(i=0; i<communitylen; i++)
+		{
+			uint32_t key[3] = { msg->community.data[i].asn, msg->community.data[i].num, 0 };
+			community |= p_filter_find(f, STREAM_COMMUNITY, key);
+		}
+
+		for(i=0; i<largecommunitylen; i++)
+		{
+			uint32_t key[3] = { msg->largecommunity.data[i].global, msg->largecommunity.data[i].local1, msg->largecommunity.data[i].local2 };
+			community |= p_filter_find(f, STREAM_LARGE, key);
+		}
+
+		mask &= community;
+	}
+
+	return mask;
+}
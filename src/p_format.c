@@ -0,0 +1,560 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
+
+#include <p_defs.h>
+#include <p_format.h>
+#include <p_tools.h>
+
+/* Text output of the decoded dump records, shared by ptoa and the stream
+ * server (see p_stream.c). Addresses are written with inet_ntop() into
+ * the caller's buffer, the stream thread runs next to the peer threads. */
+
+static char *p_format_ip(char *buf, int af, void *addr)
+{
+	inet_ntop(af, addr, buf, INET6_ADDRSTRLEN);
+
+	return buf;
+}
+
+/* one record, the neighbor and seq come with the live feed records */
+void p_format_msg(FILE *out, int mode, struct dump_full_msg *msg, struct feed_rec_t *rec)
+{
+	char ip[INET6_ADDRSTRLEN];
+
+	switch(mode) {
+		case PTOA_MACHINE:
+			{
+				unsigned long long int ts  = msg->msg.ts;
+				unsigned long long int uts = msg->msg.uts;
+				fprintf(out, "%llu.%llu|",ts,uts);
+			}
+			break;
+		case PTOA_HUMAN:
+			{
+				char line[100];
+				struct timeval t;
+				t.tv_sec  = msg->msg.ts;
+				t.tv_usec = msg->msg.uts;
+
+				p_tools_humantime(line, sizeof(line), &t);
+				fprintf(out, "%s ",line);
+			}
+			break;
+		case PTOA_JSON:
+			{
+				unsigned long long int ts  = msg->msg.ts;
+				unsigned long long int uts = msg->msg.uts;
+				fprintf(out, "{ \"timestamp\": %llu.%llu, ",ts, uts);
+			}
+	}
+
+	/* live feed, the neighbor follows the timestamp */
+	if ( rec != NULL )
+	{
+		p_format_ip(ip, rec->af == 4 ? AF_INET : AF_INET6, rec->ip);
+
+		if ( mode == PTOA_MACHINE )
+			fprintf(out, "%llu|%s|%u|", (unsigned long long int)rec->seq, ip, rec->as);
+		else if ( mode == PTOA_JSON )
+			fprintf(out, "\"seq\": %llu, \"neighbor\": { \"ip\": \"%s\", \"asn\": %u }, ",
+				(unsigned long long int)rec->seq, ip, rec->as);
+		else
+			fprintf(out, "neighbor %s AS %u ", ip, rec->as);
+	}
+
+	switch(msg->msg.type)
+	{
+		case DUMP_HEADER4:
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "P|%u|%u|%c\n",msg->header4.ip,msg->header4.as,msg->header4.type == BGP_TYPE_IBGP ? 'i' : 'e');
+			else if ( mode == PTOA_JSON )
+			{
+				struct in_addr addr;
+				addr.s_addr = htobe32(msg->header4.ip);
+				fprintf(out, "\"type\": \"peer\", \"msg\": { \"peer\": { \"proto\": \"ipv4\", \"ip\": \"%s\", \"asn\": %u, \"type\": \"%s\" } } }\n",
+					p_format_ip(ip, AF_INET, &addr), msg->header4.as, msg->header4.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp" );
+			}
+			else
+			{
+				struct in_addr addr;
+				addr.s_addr = htobe32(msg->header4.ip);
+				fprintf(out, "peer ip %s AS %u TYPE %s\n",p_format_ip(ip, AF_INET, &addr),msg->header4.as,msg->header4.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp");
+			}
+			break;
+
+		case DUMP_HEADER6:
+			if ( mode == PTOA_MACHINE )
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->header6.ip, sizeof(msg->header6.ip));
+				fprintf(out, "P|%s|%u|%c\n",p_format_ip(ip, AF_INET6, &addr),msg->header6.as,msg->header6.type == BGP_TYPE_IBGP ? 'i' : 'e');
+			}
+			else if ( mode == PTOA_JSON )
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->header6.ip, sizeof(msg->header6.ip));
+				fprintf(out, "\"type\": \"peer\", \"msg\": { \"peer\": { \"proto\": \"ipv6\", \"ip\": \"%s\", \"asn\": %u, \"type\": \"%s\" } } }\n",
+					p_format_ip(ip, AF_INET6, &addr),msg->header6.as,msg->header6.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp");
+			}
+			else
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->header6.ip, sizeof(msg->header6.ip));
+				fprintf(out, "peer ip %s AS %u TYPE %s\n",p_format_ip(ip, AF_INET6, &addr),msg->header6.as,msg->header6.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp");
+			}
+			break;
+
+		case DUMP_OPEN:
+			if ( msg->open.gr == 0 )
+			{
+				if ( mode == PTOA_MACHINE )
+					fprintf(out, "C\n");
+				else if ( mode == PTOA_JSON )
+					fprintf(out, "\"type\": \"connect\" }\n");
+				else
+					fprintf(out, "connected\n");
+			}
+			else if ( mode == PTOA_MACHINE )
+				fprintf(out, "C|GR|%u|%c|%c\n", msg->open.grtime,
+					msg->open.gr & GR_PEER_RESTART ? 'R' : '-',
+					msg->open.gr & GR_LOCAL_RESTART ? 'L' : '-');
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"connect\", \"msg\": { \"graceful_restart\": { \"capable\": %s, \"time\": %u, \"peer_restart\": %s, \"local_restart\": %s } } }\n",
+					msg->open.gr & GR_CAPA ? "true" : "false", msg->open.grtime,
+					msg->open.gr & GR_PEER_RESTART ? "true" : "false",
+					msg->open.gr & GR_LOCAL_RESTART ? "true" : "false");
+			else
+				fprintf(out, "connected graceful restart %s time %u%s%s\n",
+					msg->open.gr & GR_CAPA ? "capable" : "not capable", msg->open.grtime,
+					msg->open.gr & GR_PEER_RESTART ? " peer restart" : "",
+					msg->open.gr & GR_LOCAL_RESTART ? " local restart" : "");
+			break;
+
+		case DUMP_CLOSE:
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "D\n");
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"disconnect\" }\n");
+			else
+				fprintf(out, "disconnected\n");
+			break;
+
+		case DUMP_KEEPALIVE:
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "K\n");
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"keepalive\" }\n");
+			else
+				fprintf(out, "keepalive\n");
+			break;
+
+		case DUMP_DUPLICATE:
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "R|%u\n", msg->duplicate.count);
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"duplicate\", \"msg\": { \"count\": %u } }\n", msg->duplicate.count);
+			else
+				fprintf(out, "duplicate announces %u\n", msg->duplicate.count);
+			break;
+
+		case DUMP_EOR:
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "T|%u|%u|%u.%03u\n", msg->eor.afi, msg->eor.count,
+					msg->eor.duration / 1000, msg->eor.duration % 1000);
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"eor\", \"msg\": { \"afi\": \"%s\", \"count\": %u, \"duration\": %u.%03u } }\n",
+					msg->eor.afi == 1 ? "ipv4" : "ipv6", msg->eor.count,
+					msg->eor.duration / 1000, msg->eor.duration % 1000);
+			else
+				fprintf(out, "end of rib %s %u prefixes in %u.%03us\n",
+					msg->eor.afi == 1 ? "ipv4" : "ipv6", msg->eor.count,
+					msg->eor.duration / 1000, msg->eor.duration % 1000);
+			break;
+
+		case DUMP_REFRESH:
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "F|%u|%c\n", msg->refresh.afi, msg->refresh.subtype == BGP_REFRESH_BORR ? 'B' : 'E');
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"refresh\", \"msg\": { \"afi\": \"%s\", \"marker\": \"%s\" } }\n",
+					msg->refresh.afi == 1 ? "ipv4" : "ipv6", msg->refresh.subtype == BGP_REFRESH_BORR ? "begin" : "end");
+			else
+				fprintf(out, "route refresh %s %s\n",
+					msg->refresh.subtype == BGP_REFRESH_BORR ? "begin" : "end", msg->refresh.afi == 1 ? "ipv4" : "ipv6");
+			break;
+
+		case DUMP_ANNOUNCE4:
+
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "A|%u|%u",msg->announce4.prefix, msg->announce4.mask);
+			else if ( mode == PTOA_JSON )
+			{
+				struct in_addr addr;
+				addr.s_addr = htobe32(msg->announce4.prefix);
+				fprintf(out, "\"type\": \"announce\", \"msg\": { \"prefix\": \"%s/%u\"",
+					p_format_ip(ip, AF_INET, &addr),msg->announce4.mask);
+			}
+			else
+			{
+				struct in_addr addr;
+				addr.s_addr = htobe32(msg->announce4.prefix);
+				fprintf(out, "prefix announce %s/%u",p_format_ip(ip, AF_INET, &addr),msg->announce4.mask);
+			}
+
+			if ( msg->announce4.origin != 0xff )
+				p_format_origin(out, mode, msg->announce4.origin);
+
+			if ( msg->announce4.nexthop != 0xffffff )
+				p_format_nexthop4(out, mode, msg->announce4.nexthop);
+
+			if ( msg->announce4.aspathlen > 0 )
+				p_format_aspath(out, mode, &msg->aspath, msg->announce4.aspathlen);
+
+			if ( msg->announce4.communitylen > 0 )
+				p_format_community(out, mode, &msg->community, msg->announce4.communitylen);
+
+			if ( msg->announce4.extcommunitylen4 > 0 )
+				p_format_extcommunity4(out, mode, &msg->extcommunity4, msg->announce4.extcommunitylen4);
+
+			if ( msg->announce4.largecommunitylen > 0 )
+				p_format_largecommunity(out, mode, &msg->largecommunity, msg->announce4.largecommunitylen);
+
+
+			if ( mode == PTOA_JSON )
+				fprintf(out, " } }\n");
+			else
+				fprintf(out, "\n");
+
+			break;
+
+		case DUMP_ANNOUNCE6:
+			if ( mode == PTOA_MACHINE )
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->announce6.prefix, sizeof(msg->announce6.prefix));
+				fprintf(out, "A|%s|%u",p_format_ip(ip, AF_INET6, &addr), msg->announce6.mask);
+			}
+			else if ( mode == PTOA_JSON )
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->announce6.prefix, sizeof(msg->announce6.prefix));
+				fprintf(out, "\"type\": \"announce\", \"msg\": { \"prefix\": \"%s/%u\"",
+					p_format_ip(ip, AF_INET6, &addr),msg->announce6.mask);
+			}
+			else
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->announce6.prefix, sizeof(msg->announce6.prefix));
+				fprintf(out, "prefix announce %s/%u",p_format_ip(ip, AF_INET6, &addr),msg->announce6.mask);
+			}
+
+			if ( msg->announce6.origin != 0xff )
+				p_format_origin(out, mode, msg->announce6.origin);
+
+			{
+				int i;
+				int doit = 0;
+				for(i=0; i<16; i++) {
+					if ( msg->announce6.nexthop[i] != 0xff ) {
+						doit=1;
+						break;
+					}
+				}
+
+				if ( doit )
+					p_format_nexthop6(out, mode, msg->announce6.nexthop);
+			}
+
+			if ( msg->announce6.aspathlen > 0 )
+				p_format_aspath(out, mode, &msg->aspath, msg->announce6.aspathlen);
+
+			if ( msg->announce6.communitylen > 0 )
+				p_format_community(out, mode, &msg->community, msg->announce6.communitylen);
+
+			if ( msg->announce6.extcommunitylen6 > 0 )
+				p_format_extcommunity6(out, mode, &msg->extcommunity6, msg->announce6.extcommunitylen6);
+
+			if ( msg->announce6.largecommunitylen > 0 )
+				p_format_largecommunity(out, mode, &msg->largecommunity, msg->announce6.largecommunitylen);
+
+			if ( mode == PTOA_JSON )
+				fprintf(out, " } }");
+
+			fprintf(out, "\n");
+
+			break;
+
+		case DUMP_WITHDRAWN4:
+
+			if ( mode == PTOA_MACHINE )
+			{
+				fprintf(out, "W|%u|%u",msg->withdrawn4.prefix,msg->withdrawn4.mask);
+			}
+			else if ( mode == PTOA_JSON )
+			{
+				struct in_addr addr;
+				addr.s_addr = htobe32(msg->withdrawn4.prefix);
+				fprintf(out, "\"type\": \"withdrawn\", \"msg\": { \"prefix\": \"%s/%u\" } }",
+					p_format_ip(ip, AF_INET, &addr),msg->withdrawn4.mask);
+			}
+			else
+			{
+				struct in_addr addr;
+				addr.s_addr = htobe32(msg->withdrawn4.prefix);
+				fprintf(out, "prefix withdrawn %s/%u",p_format_ip(ip, AF_INET, &addr),msg->withdrawn4.mask);
+			}
+			fprintf(out, "\n");
+
+			break;
+
+		case DUMP_WITHDRAWN6:
+			if ( mode == PTOA_MACHINE )
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->withdrawn6.prefix, sizeof(msg->withdrawn6.prefix));
+				fprintf(out, "W|%s|%u",p_format_ip(ip, AF_INET6, &addr), msg->withdrawn6.mask);
+			}
+			else if ( mode == PTOA_JSON )
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->withdrawn6.prefix, sizeof(msg->withdrawn6.prefix));
+				fprintf(out, "\"type\": \"withdrawn\", \"msg\": { \"prefix\": \"%s/%u\" } }",
+					p_format_ip(ip, AF_INET6, &addr),msg->withdrawn6.mask);
+			}
+			else
+			{
+				struct in6_addr addr;
+				memcpy(addr.s6_addr, msg->withdrawn6.prefix, sizeof(msg->withdrawn6.prefix));
+				fprintf(out, "prefix withdrawn %s/%u",p_format_ip(ip, AF_INET6, &addr),msg->withdrawn6.mask);
+			}
+			fprintf(out, "\n");
+
+			break;
+
+		case DUMP_FOOTER:
+
+			if ( mode == PTOA_MACHINE )
+				fprintf(out, "E\n");
+			else if ( mode == PTOA_JSON )
+				fprintf(out, "\"type\": \"footer\" }\n");
+			else
+				fprintf(out, "eof\n");
+
+			break;
+
+		default:
+			fprintf(stderr, "Error: received unknown message code: %u\n", msg->msg.type);
+	}
+}
+
+void p_format_nexthop4(FILE *out, int mode, uint32_t nexthop)
+{
+	char ip[INET6_ADDRSTRLEN];
+	struct in_addr addr;
+	addr.s_addr = htobe32(nexthop);
+
+	switch(mode)
+	{
+		case PTOA_MACHINE:
+			fprintf(out, "|NH|%u", nexthop);
+			break;
+		case PTOA_HUMAN:
+			fprintf(out, " nexthop %s", p_format_ip(ip, AF_INET, &addr));
+			break;
+		case PTOA_JSON:
+			fprintf(out, ", \"nexthop\": \"%s\"", p_format_ip(ip, AF_INET, &addr));
+			break;
+	}
+}
+
+void p_format_nexthop6(FILE *out, int mode, uint8_t nexthop[16])
+{
+	char ip[INET6_ADDRSTRLEN];
+	struct in6_addr addr;
+	memcpy(addr.s6_addr, nexthop, 16);
+
+	switch(mode)
+	{
+		case PTOA_MACHINE:
+			fprintf(out, "|NH|%s", p_format_ip(ip, AF_INET6, &addr));
+			break;
+		case PTOA_HUMAN:
+			fprintf(out, " nexthop %s", p_format_ip(ip, AF_INET6, &addr));
+			break;
+		case PTOA_JSON:
+			fprintf(out, ", \"nexthop\": \"%s\"", p_format_ip(ip, AF_INET6, &addr));
+			break;
+	}
+}
+
+void p_format_origin(FILE *out, int mode, uint8_t origin)
+{
+	char o = '?';
+	char oa[10];
+
+	switch(origin)
+	{
+		case BGP_ORIGIN_IGP:
+			o = 'I';
+			snprintf(oa, sizeof(oa), "IGP");
+			break;
+		case BGP_ORIGIN_EGP:
+			o = 'E';
+			snprintf(oa, sizeof(oa), "EGP");
+			break;
+		case BGP_ORIGIN_UNKN:
+			o = '?';
+			snprintf(oa, sizeof(oa), "Unknown");
+			break;
+		default:
+			o = '?';
+			snprintf(oa, sizeof(oa), "Error");
+			break;
+	}
+
+	switch(mode) {
+		case PTOA_MACHINE:
+			fprintf(out, "|O|%c", o);
+			break;
+		case PTOA_HUMAN:
+			fprintf(out, " origin %s", oa);
+			break;
+		case PTOA_JSON:
+			fprintf(out, ", \"origin\": \"%s\"", oa);
+			break;
+	}
+}
+
+
+void p_format_aspath(FILE *out, int mode, struct dump_announce_aspath *aspath, uint8_t len)
+{
+	int i;
+
+	switch(mode) {
+		case PTOA_MACHINE: fprintf(out, "|AP|"); break;
+		case PTOA_HUMAN: fprintf(out, " aspath"); break;
+		case PTOA_JSON: fprintf(out, ", \"aspath\": [ "); break;
+	}
+
+	for(i=0; i<len; i++)
+	{
+		switch(mode) {
+			case PTOA_MACHINE:
+				fprintf(out, "%u", aspath->data[i]);
+				if ( i < len-1 ) fprintf(out, " ");
+				break;
+			case PTOA_HUMAN:
+				fprintf(out, " %u", aspath->data[i]);
+				break;
+			case PTOA_JSON:
+				fprintf(out, "%u", aspath->data[i]);
+				if ( i < len-1 ) fprintf(out, ", ");
+				break;
+		}
+	}
+
+	if ( mode == PTOA_JSON )
+		fprintf(out, " ]");
+}
+
+void p_format_community(FILE *out, int mode, struct dump_announce_community *community, uint16_t len)
+{
+	int i;
+
+	if ( mode == PTOA_MACHINE )
+		fprintf(out, "|C|");
+	else if ( mode == PTOA_JSON )
+		fprintf(out, ", \"community\": [ ");
+	else
+		fprintf(out, " community");
+
+	for(i=0; i<len; i++)
+	{
+		if ( mode == PTOA_MACHINE )
+		{
+			fprintf(out, "%u:%u",community->data[i].asn, community->data[i].num);
+			if ( i < len-1) fprintf(out, " ");
+		}
+		else if ( mode == PTOA_JSON )
+		{
+			fprintf(out, "\"%u:%u\"",community->data[i].asn, community->data[i].num);
+			if ( i < len-1) fprintf(out, ", ");
+		}
+		else
+		{
+			fprintf(out, " %u:%u", community->data[i].asn, community->data[i].num);
+		}
+	}
+
+	if ( mode == PTOA_JSON )
+		fprintf(out, " ]");
+}
+
+void p_format_extcommunity4(FILE *out, int mode, struct dump_announce_extcommunity4 *com, uint16_t len)
+{
+	/* not yet implemented */
+}
+
+void p_format_extcommunity6(FILE *out, int mode, struct dump_announce_extcommunity6 *com, uint16_t len)
+{
+	/* not yet implemented */
+}
+
+void p_format_largecommunity(FILE *out, int mode, struct dump_announce_largecommunity *community, uint16_t len)
+{
+	int i;
+
+	if ( mode == PTOA_MACHINE )
+		fprintf(out, "|LC|");
+	else if ( mode == PTOA_JSON )
+		fprintf(out, ", \"largecommunity\": [ ");
+	else
+		fprintf(out, " largecommunity");
+
+	for(i=0; i<len; i++)
+	{
+		if ( mode == PTOA_MACHINE )
+		{
+			fprintf(out, "%u:%u:%u",community->data[i].global, community->data[i].local1, community->data[i].local2);
+			if ( i < len-1) fprintf(out, " ");
+		}
+		else if ( mode == PTOA_JSON )
+		{
+			fprintf(out, "\"%u:%u:%u\"",community->data[i].global, community->data[i].local1, community->data[i].local2);
+			if ( i < len-1) fprintf(out, ", ");
+		}
+		else
+		{
+			fprintf(out, " %u:%u:%u", community->data[i].global, community->data[i].local1, community->data[i].local2);
+		}
+	}
+
+	if ( mode == PTOA_JSON )
+		fprintf(out, " ]");
+}
+
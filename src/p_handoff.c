@@ -0,0 +1,727 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_buf.h>
+#include <p_config.h>
+#include <p_dump.h>
+#include <p_log.h>
+#include <p_stats.h>
+#include <p_tools.h>
+#include <p_handoff.h>
+
+/* Binary upgrade. The running daemon starts the installed binary with one
+ * end of a unix socket pair as descriptor 3 and passes it the listening
+ * sockets, the control, metrics and stream sockets and optionally the established
+ * sessions with their dump file and decoder state (SCM_RIGHTS). The new
+ * process answers once it took everything over and the old one exits.
+ * Without answer the old process kills it and carries on. */
+
+extern char **environ;
+
+static volatile int handoff_busy = 0;
+static char *handoff_blob[MAX_PEERS];   /* handoff_peer_t and the buffers */
+static int   handoff_file[MAX_PEERS];   /* temp.dump descriptor or -1 */
+static int   handoff_chan = -1;         /* new process, answered once it is ready */
+static char *handoff_drop[MAX_PEERS];   /* new process, dump files of the sessions not taken over */
+
+static int  p_handoff_send(int chan, uint8_t type, uint8_t shard, void *data, uint32_t len, int *fds, int nfd);
+static int  p_handoff_recv(int chan, struct handoff_msg_t *msg, char **data, int *fds);
+static void p_handoff_take(struct config_t *config, struct peer_t *peer, char *data, uint32_t len, int *fds, int nfd, uint32_t mytime);
+
+/* accepting is stopped while the sockets are handed over */
+int p_handoff_busy(void)
+{
+	return handoff_busy;
+}
+
+/* old process, returns 0 once the new process took over, the caller exits */
+int p_handoff_upgrade(struct config_t *config, struct peer_t *peer, int sessions, char *err, size_t errlen)
+{
+	struct handoff_msg_t ack;
+	struct timeval timeout;
+	char env[32];
+	char *argv[3];
+	char **envp;
+	int chan[2];
+	int envc, maxfd, shard, wait, a;
+	int r = 0;
+	pid_t pid;
+
+	if ( access(PIRANHA_BIN, X_OK) == -1 )
+	{
+		snprintf(err, errlen, "cannot exec %s", PIRANHA_BIN);
+		return -1;
+	}
+
+	/* everything the child needs is prepared before fork() */
+	for(envc=0; environ[envc] != NULL; envc++);
+
+	if ( ( envp = malloc((envc + 2) * sizeof(char*)) ) == NULL )
+	{
+		snprintf(err, errlen, "out of memory");
+		return -1;
+	}
+
+	for(a=0, envc=0; environ[a] != NULL; a++)
+		if ( strncmp(environ[a], HANDOFF_ENV "=", strlen(HANDOFF_ENV "=")) != 0 )
+			envp[envc++] = environ[a];
+
+	snprintf(env, sizeof(env), HANDOFF_ENV "=%i", HANDOFF_FD);
+	envp[envc++] = env;
+	envp[envc]   = NULL;
+
+	argv[0] = PIRANHA_BIN;
+	argv[1] = config->file;
+	argv[2] = NULL;
+
+	maxfd = sysconf(_SC_OPEN_MAX);
+
+	if ( socketpair(AF_UNIX, SOCK_STREAM, 0, chan) == -1 )
+	{
+		free(envp);
+		snprintf(err, errlen, "socketpair() failed");
+		return -1;
+	}
+
+	handoff_busy = 1;
+
+	if ( ( pid = fork() ) == -1 )
+	{
+		handoff_busy = 0;
+		free(envp);
+		close(chan[0]);
+		close(chan[1]);
+		snprintf(err, errlen, "fork() failed");
+		return -1;
+	}
+
+	if ( pid == 0 )
+	{
+		/* only the channel is inherited */
+		dup2(chan[1], HANDOFF_FD);
+		for(a=HANDOFF_FD+1; a<maxfd; a++)
+			close(a);
+		execve(PIRANHA_BIN, argv, envp);
+		_exit(1);
+	}
+
+	free(envp);
+	close(chan[1]);
+
+	timeout.tv_sec  = HANDOFF_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(chan[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(chan[0], SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	p_log_add(time(NULL), "upgrade: handing over to " PIRANHA_BIN "\n");
+
+	for(shard=0; shard<config->shards; shard++)
+	{
+		if ( config->ip4.enabled )
+			r |= p_handoff_send(chan[0], HANDOFF_MSG_LISTEN4, shard, NULL, 0, &config->ip4.sock[shard], 1);
+		if ( config->ip6.enabled )
+			r |= p_handoff_send(chan[0], HANDOFF_MSG_LISTEN6, shard, NULL, 0, &config->ip6.sock[shard], 1);
+	}
+
+	if ( config->control != -1 )
+		r |= p_handoff_send(chan[0], HANDOFF_MSG_CONTROL, 0, NULL, 0, &config->control, 1);
+
+	if ( config->metrics.enabled && config->metrics.sock != -1 )
+		r |= p_handoff_send(chan[0], HANDOFF_MSG_METRICS, 0, NULL, 0, &config->metrics.sock, 1);
+
+	if ( config->stream.sock != -1 )
+		r |= p_handoff_send(chan[0], HANDOFF_MSG_STREAM, 0, NULL, 0, &config->stream.sock, 1);
+	if ( config->stream.lsock != -1 )
+		r |= p_handoff_send(chan[0], HANDOFF_MSG_STREAM, 1, NULL, 0, &config->stream.lsock, 1);
+
+	/* the peer threads save their session between two reads */
+	if ( sessions )
+	{
+		for(a=0; a<MAX_PEERS; a++)
+			if ( peer[a].status == 2 )
+				peer[a].handoff = HANDOFF_REQ;
+
+		for(wait=0; wait<CONTROL_TIMEOUT*100; wait++)
+		{
+			for(a=0; a<MAX_PEERS && peer[a].handoff != HANDOFF_REQ; a++);
+			if ( a == MAX_PEERS )
+				break;
+			usleep(10000);
+		}
+	}
+
+	for(a=0; a<MAX_PEERS && r == 0; a++)
+	{
+		struct handoff_peer_t *state = (struct handoff_peer_t*)handoff_blob[a];
+		int fds[HANDOFF_MAXFD];
+
+		if ( peer[a].handoff != HANDOFF_READY )
+			continue;
+
+		fds[0] = peer[a].sock;
+		fds[1] = handoff_file[a];
+
+		r |= p_handoff_send(chan[0], HANDOFF_MSG_PEER, 0, state, sizeof(*state) + state->ilen + state->olen,
+			fds, fds[1] == -1 ? 1 : 2);
+	}
+
+	if ( r == 0 )
+		r = p_handoff_send(chan[0], HANDOFF_MSG_END, 0, NULL, 0, NULL, 0);
+
+	if ( r == 0 )
+	{
+		char *data = NULL;
+		r = p_handoff_recv(chan[0], &ack, &data, NULL);
+		free(data);
+	}
+
+	close(chan[0]);
+
+	if ( r == -1 || ack.type != HANDOFF_MSG_ACK )
+	{
+		/* the saved sessions carry on here */
+		for(a=0; a<MAX_PEERS; a++)
+			if ( peer[a].handoff == HANDOFF_READY || peer[a].handoff == HANDOFF_REQ )
+				peer[a].handoff = 0;
+
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		handoff_busy = 0;
+
+		p_log_add(time(NULL), "upgrade: the new process did not take over, carrying on\n");
+		snprintf(err, errlen, "the new process did not take over, see the log");
+		return -1;
+	}
+
+	for(a=0; a<MAX_PEERS; a++)
+		if ( peer[a].handoff == HANDOFF_READY )
+			peer[a].handoff = HANDOFF_DONE;
+
+	/* the other sessions are closed once the new process took over, *
+	 * their dump file is finished before the caller exits           */
+	for(a=0; a<MAX_PEERS; a++)
+		if ( peer[a].status > 0 && peer[a].handoff != HANDOFF_DONE )
+			peer[a].status = 0;
+
+	for(wait=0; wait<CONTROL_TIMEOUT*100; wait++)
+	{
+		for(a=0; a<MAX_PEERS && ( peer[a].fh == NULL || peer[a].handoff == HANDOFF_DONE ); a++);
+		if ( a == MAX_PEERS )
+			break;
+		usleep(10000);
+	}
+
+	return 0;
+}
+
+/* old process, peer thread: saves the session and waits for the upgrade *
+ * returns 0 if the session was taken over, the thread exits without    *
+ * closing it, -1 to carry on                                            */
+int p_handoff_peer(struct peer_t *peer, int id, char *ibuf, char *obuf)
+{
+	struct handoff_peer_t *state;
+	char *blob;
+
+	if ( peer[id].status != 2 ||
+		( blob = malloc(sizeof(*state) + peer[id].ilen + peer[id].olen) ) == NULL )
+	{
+		peer[id].handoff = 0;
+		return -1;
+	}
+
+	state = (struct handoff_peer_t*)blob;
+	memset(state, 0, sizeof(*state));
+
+	state->af = peer[id].af;
+	if ( peer[id].af == 4 )
+		memcpy(state->ip, &peer[id].ip4, sizeof(peer[id].ip4));
+	else
+		memcpy(state->ip, &peer[id].ip6, sizeof(peer[id].ip6));
+
+	state->as        = peer[id].as;
+	state->as4       = peer[id].as4;
+	state->refresh   = peer[id].refresh;
+	state->gr        = peer[id].gr;
+	state->eor       = peer[id].eor;
+	state->fbulk     = peer[id].fbulk;
+	state->empty     = peer[id].empty;
+	state->export    = peer[id].export;
+	state->grtime    = peer[id].grtime;
+	state->rhold     = peer[id].rhold;
+	state->shold     = peer[id].shold;
+	state->icount[0] = peer[id].icount[0];
+	state->icount[1] = peer[id].icount[1];
+	state->rmsg      = peer[id].rmsg;
+	state->smsg      = peer[id].smsg;
+	state->ucount    = peer[id].ucount;
+	state->dcount    = peer[id].dcount;
+	state->cts       = peer[id].cts;
+	state->rts       = peer[id].rts;
+	state->sts       = peer[id].sts;
+	state->ests      = peer[id].ests;
+	state->filets    = peer[id].filets;
+	state->rbytes    = peer[id].rbytes;
+	state->uts       = peer[id].uts;
+	state->ilen      = peer[id].ilen;
+	state->olen      = peer[id].olen > 0 ? peer[id].olen : 0;
+
+	/* a partial message and the data not sent yet */
+	memcpy(blob + sizeof(*state), ibuf, state->ilen);
+	memcpy(blob + sizeof(*state) + state->ilen, obuf, state->olen);
+
+	if ( peer[id].fh != NULL )
+		strcpy(state->filename, peer[id].filename);
+
+	handoff_file[id] = p_dump_detach_file(peer, id);
+	handoff_blob[id] = blob;
+	peer[id].handoff = HANDOFF_READY;
+
+	while ( peer[id].handoff == HANDOFF_READY )
+		usleep(10000);
+
+	handoff_blob[id] = NULL;
+	free(blob);
+
+	if ( peer[id].handoff == HANDOFF_DONE )
+	{
+		if ( handoff_file[id] != -1 )
+			close(handoff_file[id]);
+		return 0;
+	}
+
+	/* the upgrade failed */
+	if ( handoff_file[id] != -1 )
+		p_dump_adopt_file(peer, id, handoff_file[id]);
+
+	return -1;
+}
+
+/* new process, takes the sockets over before the privileges are dropped, *
+ * the previous process waits for p_handoff_ack()                         */
+int p_handoff_receive(struct config_t *config, struct peer_t *peer, int chan, uint32_t mytime)
+{
+	char logline[100];
+	int shards4 = 0;
+	int shards6 = 0;
+	int shards;
+
+	config->control      = -1;
+	config->metrics.sock = -1;
+	config->stream.sock  = -1;
+	config->stream.lsock = -1;
+
+	for(;;)
+	{
+		struct handoff_msg_t msg;
+		char *data = NULL;
+		int fds[HANDOFF_MAXFD];
+
+		if ( p_handoff_recv(chan, &msg, &data, fds) == -1 )
+		{
+			close(chan);
+			return -1;
+		}
+
+		if ( msg.type == HANDOFF_MSG_END )
+			break;
+
+		if ( ( msg.type == HANDOFF_MSG_LISTEN4 || msg.type == HANDOFF_MSG_LISTEN6 ) && msg.nfd == 1 && msg.shard < MAX_SHARDS )
+		{
+			if ( msg.type == HANDOFF_MSG_LISTEN4 )
+			{
+				config->ip4.sock[msg.shard] = fds[0];
+				shards4 = msg.shard + 1 > shards4 ? msg.shard + 1 : shards4;
+			}
+			else
+			{
+				config->ip6.sock[msg.shard] = fds[0];
+				shards6 = msg.shard + 1 > shards6 ? msg.shard + 1 : shards6;
+			}
+		}
+		else if ( msg.type == HANDOFF_MSG_CONTROL && msg.nfd == 1 )
+			config->control = fds[0];
+		else if ( msg.type == HANDOFF_MSG_METRICS && msg.nfd == 1 && config->metrics.enabled )
+			config->metrics.sock = fds[0];
+		else if ( msg.type == HANDOFF_MSG_STREAM && msg.nfd == 1 && msg.shard == 0 && config->stream.enabled )
+			config->stream.sock = fds[0];
+		else if ( msg.type == HANDOFF_MSG_STREAM && msg.nfd == 1 && msg.shard == 1 && config->stream.local )
+			config->stream.lsock = fds[0];
+		else if ( msg.type == HANDOFF_MSG_PEER && msg.nfd >= 1 )
+		{
+			p_handoff_take(config, peer, data, msg.len, fds, msg.nfd, mytime);
+			data = NULL;
+		}
+		else
+		{
+			int a;
+			for(a=0; a<msg.nfd; a++)
+				close(fds[a]);
+		}
+
+		free(data);
+	}
+
+	/* the listening sockets are kept as they are, a reload applies a new address */
+	shards = shards4 > shards6 ? shards4 : shards6;
+
+	if ( shards > 0 && shards != config->shards )
+	{
+		snprintf(logline, sizeof(logline), "upgrade: %i listen shards kept, restart needed\n", shards);
+		p_log_add(mytime, logline);
+	}
+
+	if ( shards > 0 )
+		config->shards = shards;
+
+	config->ip4.enabled = shards4 > 0;
+	config->ip6.enabled = shards6 > 0;
+
+	handoff_chan = chan;
+
+	return 0;
+}
+
+/* new process, initialization done: the previous process may exit */
+int p_handoff_ack(uint32_t mytime)
+{
+	int r = p_handoff_send(handoff_chan, HANDOFF_MSG_ACK, 0, NULL, 0, NULL, 0);
+	int a;
+
+	close(handoff_chan);
+	handoff_chan = -1;
+
+	for(a=0; a<MAX_PEERS && handoff_drop[a] != NULL; a++)
+	{
+		char temp[sizeof(((struct handoff_peer_t*)NULL)->filename)];
+		char *slash;
+
+		strncpy(temp, handoff_drop[a], sizeof(temp) - 1);
+		temp[sizeof(temp) - 1] = '\0';
+		if ( r == 0 && ( slash = strrchr(temp, '/') ) != NULL && sizeof(temp) - ( slash - temp ) > strlen("/temp.dump") )
+		{
+			strcpy(slash, "/temp.dump");
+			rename(temp, handoff_drop[a]);
+		}
+
+		free(handoff_drop[a]);
+		handoff_drop[a] = NULL;
+	}
+
+	if ( r == -1 )
+		return -1;
+
+	p_log_add(mytime, "upgrade: took over from the previous process\n");
+
+	return 0;
+}
+
+/* new process, peer thread: the buffers of the session taken over */
+void p_handoff_restore(struct peer_t *peer, int id, struct buf_t *ibuf, char *obuf)
+{
+	struct handoff_peer_t *state = (struct handoff_peer_t*)handoff_blob[id];
+
+	peer[id].handoff = 0;
+
+	if ( state == NULL )
+		return;
+
+	/* dropped without session buffers, a partial burst may not fit the small buffer */
+	if ( peer[id].status == 0 || ( state->ilen > ibuf->size && p_buf_grow(ibuf, 0, 1) == -1 ) )
+		peer[id].status = 0;
+	else
+	{
+		memcpy(ibuf->data, handoff_blob[id] + sizeof(*state), state->ilen);
+		memcpy(obuf, handoff_blob[id] + sizeof(*state) + state->ilen, state->olen);
+		peer[id].ilen = state->ilen;
+		peer[id].olen = state->olen;
+	}
+
+	free(handoff_blob[id]);
+	handoff_blob[id] = NULL;
+}
+
+/* a session handed over, it is closed if the neighbor was removed or its AS changed */
+static void p_handoff_take(struct config_t *config, struct peer_t *peer, char *data, uint32_t len, int *fds, int nfd, uint32_t mytime)
+{
+	struct handoff_peer_t *state = (struct handoff_peer_t*)data;
+	char logline[100 + INET6_ADDRSTRLEN];
+	char addr[INET6_ADDRSTRLEN];
+	struct in_addr  ip4;
+	struct in6_addr ip6;
+	int file = nfd == 2 ? fds[1] : -1;
+	int a = -1;
+
+	if ( data == NULL || len < sizeof(*state) || state->ilen < 0 || state->olen < 0 ||
+		state->ilen > INPUT_BUFFER || state->olen > OUTPUT_BUFFER ||
+		len != sizeof(*state) + state->ilen + state->olen || ( state->af != 4 && state->af != 6 ) )
+	{
+		p_log_add(mytime, "upgrade: invalid session state, session closed\n");
+		close(fds[0]);
+		if ( file != -1 )
+			close(file);
+		free(data);
+		return;
+	}
+
+	memcpy(&ip4, state->ip, sizeof(ip4));
+	memcpy(&ip6, state->ip, sizeof(ip6));
+	inet_ntop(state->af == 4 ? AF_INET : AF_INET6, state->ip, addr, sizeof(addr));
+
+	if ( ( a = p_config_match_peer(peer, state->af, &ip4, &ip6) ) == -1 &&
+		( a = p_config_add_dynamic(config, peer, state->af, state->ip, mytime) ) >= 0 )
+	{
+		p_stats_reset(a);
+
+		if ( peer[a].as == 0 )
+		{
+			peer[a].as   = state->as;
+			peer[a].type = peer[a].as == config->as ? BGP_TYPE_IBGP : BGP_TYPE_EBGP;
+		}
+	}
+
+	if ( a < 0 || peer[a].as != state->as )
+	{
+		snprintf(logline, sizeof(logline), "%s session not taken over, neighbor removed or changed\n", addr);
+		p_log_add(mytime, logline);
+
+		if ( a >= 0 && peer[a].dynamic )
+		{
+			peer[a].allow    = 0;
+			peer[a].newallow = 0;
+			peer[a].dynamic  = 0;
+		}
+
+		close(fds[0]);
+
+		/* the dump file is kept as it is, once the previous process is gone */
+		if ( file != -1 )
+		{
+			int b;
+
+			close(file);
+			for(b=0; b<MAX_PEERS && handoff_drop[b] != NULL; b++);
+			if ( b < MAX_PEERS )
+				handoff_drop[b] = strdup(state->filename);
+		}
+
+		free(data);
+		return;
+	}
+
+	peer[a].sock      = fds[0];
+	peer[a].status    = 2;
+	peer[a].as4       = state->as4;
+	peer[a].refresh   = state->refresh;
+	peer[a].gr        = state->gr;
+	peer[a].eor       = state->eor;
+	peer[a].fbulk     = state->fbulk;
+	peer[a].grtime    = state->grtime;
+	peer[a].rhold     = state->rhold;
+	peer[a].shold     = state->shold;
+	peer[a].icount[0] = state->icount[0];
+	peer[a].icount[1] = state->icount[1];
+	peer[a].rmsg      = state->rmsg;
+	peer[a].smsg      = state->smsg;
+	peer[a].ucount    = state->ucount;
+	peer[a].dcount    = state->dcount;
+	peer[a].cts       = state->cts;
+	peer[a].rts       = state->rts;
+	peer[a].sts       = state->sts;
+	peer[a].ests      = state->ests;
+	peer[a].rbytes    = state->rbytes;
+	peer[a].uts       = state->uts;
+	peer[a].fh        = NULL;
+	peer[a].rib       = NULL;
+
+	if ( file != -1 )
+	{
+		strcpy(peer[a].filename, state->filename);
+		peer[a].filets = state->filets;
+		peer[a].empty  = state->empty;
+		peer[a].export = state->export;
+		p_dump_adopt_file(peer, a, file);
+	}
+
+	/* the buffers are copied by the peer thread */
+	handoff_blob[a] = data;
+	peer[a].handoff = HANDOFF_RESUME;
+	peer[a].thread  = 1;
+
+	snprintf(logline, sizeof(logline), "%s session taken over\n", addr);
+	p_log_add(mytime, logline);
+}
+
+/* one message, the descriptors are attached to the header */
+static int p_handoff_send(int chan, uint8_t type, uint8_t shard, void *data, uint32_t len, int *fds, int nfd)
+{
+	struct handoff_msg_t msg;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAXFD)];
+	} control;
+	struct msghdr mh;
+	struct iovec iov[2];
+	ssize_t sent;
+	size_t total = sizeof(msg) + len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.magic   = HANDOFF_MAGIC;
+	msg.version = HANDOFF_VERSION;
+	msg.type    = type;
+	msg.nfd     = nfd;
+	msg.shard   = shard;
+	msg.len     = len;
+
+	iov[0].iov_base = &msg;
+	iov[0].iov_len  = sizeof(msg);
+	iov[1].iov_base = data;
+	iov[1].iov_len  = len;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov    = iov;
+	mh.msg_iovlen = len > 0 ? 2 : 1;
+
+	if ( nfd > 0 )
+	{
+		struct cmsghdr *cmsg;
+
+		memset(&control, 0, sizeof(control));
+		mh.msg_control    = control.buf;
+		mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfd);
+
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * nfd);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfd);
+	}
+
+	if ( ( sent = sendmsg(chan, &mh, MSG_NOSIGNAL) ) <= 0 )
+		return -1;
+
+	/* the rest of a large session state */
+	while ( sent < total )
+	{
+		ssize_t r;
+		size_t off = sent - sizeof(msg);
+
+		if ( sent < sizeof(msg) )
+			r = send(chan, (char*)&msg + sent, sizeof(msg) - sent, MSG_NOSIGNAL);
+		else
+			r = send(chan, (char*)data + off, len - off, MSG_NOSIGNAL);
+
+		if ( r <= 0 )
+			return -1;
+
+		sent += r;
+	}
+
+	return 0;
+}
+
+/* one message, data is allocated when the message has some */
+static int p_handoff_recv(int chan, struct handoff_msg_t *msg, char **data, int *fds)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAXFD)];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr mh;
+	struct iovec iov;
+	size_t got = 0;
+	int nfd = 0;
+
+	iov.iov_base = msg;
+	iov.iov_len  = sizeof(*msg);
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov        = &iov;
+	mh.msg_iovlen     = 1;
+	mh.msg_control    = control.buf;
+	mh.msg_controllen = sizeof(control.buf);
+
+	if ( recvmsg(chan, &mh, MSG_WAITALL) != sizeof(*msg) )
+		return -1;
+
+	for(cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL; cmsg = CMSG_NXTHDR(&mh, cmsg))
+	{
+		if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS )
+		{
+			int a, n = ( cmsg->cmsg_len - CMSG_LEN(0) ) / sizeof(int);
+			int rfds[HANDOFF_MAXFD];
+
+			memcpy(rfds, CMSG_DATA(cmsg), sizeof(int) * ( n > HANDOFF_MAXFD ? HANDOFF_MAXFD : n ));
+			for(a=0; a<n && a<HANDOFF_MAXFD; a++)
+			{
+				if ( fds != NULL )
+					fds[nfd++] = rfds[a];
+				else
+					close(rfds[a]);
+			}
+		}
+	}
+
+	/* a different binary layout cannot take the sessions over */
+	if ( msg->magic != HANDOFF_MAGIC || msg->version != HANDOFF_VERSION || msg->nfd != nfd )
+	{
+		#ifdef DEBUG
+		printf("DEBUG: handoff message version %u, %u descriptors, expected %u\n", msg->version, nfd, msg->nfd);
+		#endif
+		for(; nfd > 0; nfd--)
+			close(fds[nfd-1]);
+		return -1;
+	}
+
+	if ( msg->len == 0 )
+		return 0;
+
+	if ( msg->len > sizeof(struct handoff_peer_t) + INPUT_BUFFER + OUTPUT_BUFFER ||
+		( *data = malloc(msg->len) ) == NULL )
+		return -1;
+
+	while ( got < msg->len )
+	{
+		ssize_t r;
+
+		if ( ( r = recv(chan, *data + got, msg->len - got, 0) ) <= 0 )
+			return -1;
+
+		got += r;
+	}
+
+	return 0;
+}
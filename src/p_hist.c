@@ -0,0 +1,103 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include <p_defs.h>
+#include <p_hist.h>
+
+/* Log-linear (HDR style) latency histograms. Values below 2^HIST_SUB
+ * microseconds get a bucket each, above that every power of two is split
+ * in 2^HIST_SUB linear buckets, so the relative error stays below 25%.
+ * Each histogram has a single writer, readers may see a count slightly
+ * ahead of the buckets. */
+
+/* monotonic time in microseconds */
+uint64_t p_hist_clock()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void p_hist_add(struct stats_hist_t *hist, uint64_t us)
+{
+	__atomic_add_fetch(&hist->bucket[p_hist_bucket(us)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->sum, us, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+
+	if ( us > hist->max )
+		__atomic_store_n(&hist->max, us, __ATOMIC_RELAXED);
+}
+
+int p_hist_bucket(uint64_t us)
+{
+	int msb;
+	int bucket;
+
+	if ( us < ( 1 << HIST_SUB ) )
+		return us;
+
+	msb    = 63 - __builtin_clzll(us);
+	bucket = ( ( msb - HIST_SUB + 1 ) << HIST_SUB ) + ( ( us >> ( msb - HIST_SUB ) ) & ( ( 1 << HIST_SUB ) - 1 ) );
+
+	return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+/* exclusive upper bound of a bucket in microseconds */
+uint64_t p_hist_bound(int bucket)
+{
+	int msb;
+
+	if ( bucket < ( 1 << HIST_SUB ) )
+		return bucket + 1;
+
+	msb = ( bucket >> HIST_SUB ) + HIST_SUB - 1;
+
+	return (uint64_t)( ( 1 << HIST_SUB ) + ( bucket & ( ( 1 << HIST_SUB ) - 1 ) ) + 1 ) << ( msb - HIST_SUB );
+}
+
+/* upper bound of the bucket holding the quantile q, capped by the max */
+uint64_t p_hist_quantile(struct stats_hist_t *hist, double q)
+{
+	uint64_t rank = hist->count * q;
+	uint64_t seen = 0;
+	int a;
+
+	if ( hist->count == 0 )
+		return 0;
+
+	for(a=0; a<HIST_BUCKETS; a++)
+	{
+		seen += hist->bucket[a];
+		if ( seen > rank )
+			break;
+	}
+
+	if ( a == HIST_BUCKETS || p_hist_bound(a) > hist->max )
+		return hist->max;
+
+	return p_hist_bound(a);
+}
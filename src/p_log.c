@@ -18,10 +18,12 @@
 
 
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -47,23 +49,190 @@ void p_log_pid()
 	fclose(fh);
 }
 
+/* log lines are queued in a bounded MPSC queue (D. Vyukov) and written
+   by the logger thread. a slot is free for position p when its seq is p,
+   it holds the line of position p when its seq is p+1. peer threads never
+   block, lines are dropped and counted when the queue is full. */
+static struct log_entry_t logq[LOG_QUEUE_SIZE];
+static uint64_t           logq_head    = 0;     /* next position to write */
+static uint64_t           logq_tail    = 0;     /* next position to read  */
+static uint32_t           logq_drop    = 0;     /* dropped since the last write */
+static uint32_t           logq_dropped = 0;     /* dropped since start */
+static uint8_t            logq_reopen  = 0;
+static uint8_t            logq_running = 0;
+static FILE              *logq_fh      = NULL;
+static pthread_mutex_t    logq_lock    = PTHREAD_MUTEX_INITIALIZER;
+
+static void *p_log_thread(void *data);
+static int   p_log_write(void);
+
 /* add text to logfile */
 void p_log_add(time_t mytime, char *line)
 {
-	struct tm *tm;
-	char timestr[40];
-	FILE *fh;
+	struct log_entry_t *entry;
+	uint64_t pos;
 
-	tm = gmtime((time_t*)&mytime);
+	/* no logger thread yet, write it directly */
+	if ( ! __atomic_load_n(&logq_running, __ATOMIC_ACQUIRE) )
+	{
+		struct tm *tm;
+		char timestr[40];
+		FILE *fh;
 
-	strftime(timestr, sizeof(timestr), "[%Y-%m-%d %H:%M:%S] " , tm);
+		tm = gmtime((time_t*)&mytime);
 
-	if ( ( fh = fopen(LOGFILE,"a") ) == NULL ) { return; }
+		strftime(timestr, sizeof(timestr), "[%Y-%m-%d %H:%M:%S] " , tm);
 
-	fwrite(timestr, strlen(timestr), 1, fh);
-	fwrite(line, strlen(line), 1, fh);
+		if ( ( fh = fopen(LOGFILE,"a") ) == NULL ) { return; }
 
-	fclose(fh);
+		fwrite(timestr, strlen(timestr), 1, fh);
+		fwrite(line, strlen(line), 1, fh);
+
+		fclose(fh);
+		return;
+	}
+
+	pos = __atomic_load_n(&logq_head, __ATOMIC_RELAXED);
+
+	for(;;)
+	{
+		int64_t diff;
+
+		entry = &logq[pos & (LOG_QUEUE_SIZE-1)];
+		diff  = (int64_t)__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) - (int64_t)pos;
+
+		if ( diff == 0 )
+		{
+			if ( __atomic_compare_exchange_n(&logq_head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+				break;
+		}
+		else if ( diff < 0 )
+		{
+			/* full */
+			__atomic_add_fetch(&logq_drop, 1, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&logq_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+			pos = __atomic_load_n(&logq_head, __ATOMIC_RELAXED);
+	}
+
+	entry->ts = mytime;
+	snprintf(entry->line, sizeof(entry->line), "%s", line);
+
+	__atomic_store_n(&entry->seq, pos+1, __ATOMIC_RELEASE);
+}
+
+/* start the logger thread, must be called after daemonization */
+void p_log_start()
+{
+	pthread_t thread;
+	uint64_t a;
+
+	for(a=0; a<LOG_QUEUE_SIZE; a++)
+		logq[a].seq = a;
+
+	if ( pthread_create(&thread, NULL, p_log_thread, NULL) != 0 )
+		return;
+
+	pthread_detach(thread);
+	atexit(p_log_flush);
+
+	__atomic_store_n(&logq_running, 1, __ATOMIC_RELEASE);
+}
+
+/* reopen the logfile at the next write (logrotate) */
+void p_log_reopen()
+{
+	__atomic_store_n(&logq_reopen, 1, __ATOMIC_RELAXED);
+}
+
+/* log lines waiting for the logger thread and dropped since start */
+uint32_t p_log_queue(uint32_t *dropped)
+{
+	uint64_t head = __atomic_load_n(&logq_head, __ATOMIC_RELAXED);
+	uint64_t tail = __atomic_load_n(&logq_tail, __ATOMIC_RELAXED);
+
+	*dropped = __atomic_load_n(&logq_dropped, __ATOMIC_RELAXED);
+
+	return head > tail ? head - tail : 0;
+}
+
+/* write the queued lines now */
+void p_log_flush()
+{
+	p_log_write();
+}
+
+static void *p_log_thread(void *data)
+{
+	for(;;)
+	{
+		if ( p_log_write() == 0 )
+			usleep(LOG_WAIT);
+	}
+
+	return NULL;
+}
+
+/* write the queued lines in one batch, returns the number of lines */
+static int p_log_write()
+{
+	uint32_t drop;
+	int count = 0;
+
+	pthread_mutex_lock(&logq_lock);
+
+	if ( __atomic_exchange_n(&logq_reopen, 0, __ATOMIC_RELAXED) && logq_fh != NULL )
+	{
+		fclose(logq_fh);
+		logq_fh = NULL;
+	}
+
+	if ( logq_fh == NULL && ( logq_fh = fopen(LOGFILE,"a") ) == NULL )
+	{
+		pthread_mutex_unlock(&logq_lock);
+		return 0;
+	}
+
+	for(;;)
+	{
+		struct log_entry_t *entry = &logq[logq_tail & (LOG_QUEUE_SIZE-1)];
+		struct tm tm;
+		char timestr[40];
+
+		if ( __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != logq_tail + 1 )
+			break;
+
+		gmtime_r(&entry->ts, &tm);
+		strftime(timestr, sizeof(timestr), "[%Y-%m-%d %H:%M:%S] " , &tm);
+
+		fputs(timestr, logq_fh);
+		fputs(entry->line, logq_fh);
+
+		__atomic_store_n(&entry->seq, logq_tail + LOG_QUEUE_SIZE, __ATOMIC_RELEASE);
+		__atomic_store_n(&logq_tail, logq_tail + 1, __ATOMIC_RELAXED);
+		count++;
+	}
+
+	if ( ( drop = __atomic_exchange_n(&logq_drop, 0, __ATOMIC_RELAXED) ) > 0 )
+	{
+		struct tm tm;
+		char timestr[40];
+		time_t now = time(NULL);
+
+		gmtime_r(&now, &tm);
+		strftime(timestr, sizeof(timestr), "[%Y-%m-%d %H:%M:%S] " , &tm);
+		fprintf(logq_fh, "%s%u log lines dropped, queue full\n", timestr, drop);
+		count++;
+	}
+
+	if ( count > 0 )
+		fflush(logq_fh);
+
+	pthread_mutex_unlock(&logq_lock);
+
+	return count;
 }
 
 /* convert time_t in weeks,days,hours,mins,sec format */
@@ -95,42 +264,115 @@ void p_log_easytime(time_t mytime, char *timestr, int timestrlen)
 	else              { snprintf(timestr, timestrlen, "%um%us", m, s); }
 }
 
-/* update status file */
+/* update status file, only when a neighbor changed state or every status_interval */
 void p_log_status(struct config_t *config, struct peer_t *peer, time_t mytime)
 {
-	char data[(MAX_PEERS*64)+256];
-	int doff = 0;
-	int a;
+	static uint8_t  laststatus[MAX_PEERS];
+	static uint32_t lastucount[MAX_PEERS];
+	static float    rate[MAX_PEERS];
+	static time_t   lastwrite = 0;
+	static char    *bgp_status[] = { "down", "temp", "up", };
+	static char     data[(MAX_PEERS*256)+512];  /* too large for the stack with --maxpeers */
+	int  doff = 0;
+	int  changed = 0;
+	int  first = 1;
+	int  a;
 	FILE *fh;
-	static char *bgp_status[] = { "down", "temp", "up", };
 
-	snprintf(data,      sizeof(data),      "/----------------------------------------------------------------------------------------------------\\\n");
-	doff = strlen(data);
-	snprintf(data+doff, sizeof(data)-doff, "| neighbor                                      asn        recv       sent  updates  status  up/down |\n");
-	doff = strlen(data);
-	snprintf(data+doff, sizeof(data)-doff, "|----------------------------------------------------------------------------------------------------|\n");
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		uint8_t status = peer[a].allow ? peer[a].status + 1 : 0;
+		if ( status != laststatus[a] )
+		{
+			laststatus[a] = status;
+			changed = 1;
+		}
+	}
+
+	if ( ! changed && ( config->status_interval == 0 || mytime - lastwrite < config->status_interval ) )
+		return;
+
+	/* updates per second since the last write */
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		uint32_t count = peer[a].ucount >= lastucount[a] ? peer[a].ucount - lastucount[a] : peer[a].ucount;
+		if ( mytime > lastwrite )
+			rate[a] = (float)count / (mytime - lastwrite);
+		lastucount[a] = peer[a].ucount;
+	}
+	lastwrite = mytime;
+
+	if ( config->status_format == STATUS_JSON )
+		snprintf(data, sizeof(data), "{ \"timestamp\": %lu, \"peers\": [", (unsigned long)mytime);
+	else if ( config->status_format == STATUS_TSV )
+		snprintf(data, sizeof(data), "neighbor\tasn\tstatus\tupdown\trecv\tsent\tbytes\tupdates\trate\tprefixes\tlastupdate\n");
+	else
+	{
+		snprintf(data,      sizeof(data),      "/---------------------------------------------------------------------------------------------------------------------------------------------\\\n");
+		doff = strlen(data);
+		snprintf(data+doff, sizeof(data)-doff, "| neighbor                                      asn        recv       sent        bytes  updates  upd/s  prefixes  status  up/down  last upd |\n");
+		doff = strlen(data);
+		snprintf(data+doff, sizeof(data)-doff, "|---------------------------------------------------------------------------------------------------------------------------------------------|\n");
+	}
 	doff = strlen(data);
 
 	for(a=0; a<MAX_PEERS; a++)
 	{
 		if ( peer[a].allow )
 		{
-			char timestr[1024];
+			char *ip = peer[a].af == 4 ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6);
+			int held = peer[a].duplicate != DUPLICATE_KEEP && peer[a].status == 2;
+			char prefixes[16] = "-";
+			char lastupd[16]  = "-";
 
-			p_log_easytime(mytime - peer[a].cts, timestr, sizeof(timestr));
+			if ( held )
+				snprintf(prefixes, sizeof(prefixes), "%u", peer[a].prefixes);
 
-			if ( peer[a].status != 2 && peer[a].ucount ) { peer[a].ucount = 0; }
+			if ( config->status_format == STATUS_JSON )
+			{
+				if ( peer[a].uts )
+					snprintf(lastupd, sizeof(lastupd), "%lu", (unsigned long)(mytime - peer[a].uts));
 
-			snprintf(data+doff, sizeof(data)-doff, "| %-39s %10u %10u %10u  %7u %7s %8s |\n",
-				peer[a].af == 4 ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6), peer[a].as, peer[a].rmsg,
-				peer[a].smsg, peer[a].ucount, bgp_status[peer[a].status],
-				timestr );
+				snprintf(data+doff, sizeof(data)-doff, "%s { \"ip\": \"%s\", \"asn\": %u, \"status\": \"%s\", \"updown\": %lu, \"recv\": %u, \"sent\": %u, \"bytes\": %llu, \"updates\": %u, \"rate\": %.1f, \"prefixes\": %s, \"lastupdate\": %s }",
+					first ? "" : ",", ip, peer[a].as, bgp_status[peer[a].status], (unsigned long)(mytime - peer[a].cts),
+					peer[a].rmsg, peer[a].smsg, (unsigned long long)peer[a].rbytes, peer[a].ucount, rate[a],
+					held ? prefixes : "null", peer[a].uts ? lastupd : "null");
+			}
+			else if ( config->status_format == STATUS_TSV )
+			{
+				if ( peer[a].uts )
+					snprintf(lastupd, sizeof(lastupd), "%lu", (unsigned long)(mytime - peer[a].uts));
+
+				snprintf(data+doff, sizeof(data)-doff, "%s\t%u\t%s\t%lu\t%u\t%u\t%llu\t%u\t%.1f\t%s\t%s\n",
+					ip, peer[a].as, bgp_status[peer[a].status], (unsigned long)(mytime - peer[a].cts),
+					peer[a].rmsg, peer[a].smsg, (unsigned long long)peer[a].rbytes, peer[a].ucount, rate[a],
+					prefixes, lastupd);
+			}
+			else
+			{
+				char timestr[1024];
+
+				p_log_easytime(mytime - peer[a].cts, timestr, sizeof(timestr));
+
+				if ( peer[a].uts )
+					p_log_easytime(mytime - peer[a].uts, lastupd, sizeof(lastupd));
+
+				snprintf(data+doff, sizeof(data)-doff, "| %-39s %10u %10u %10u %12llu  %7u %6.1f %9s %7s %8s %9s |\n",
+					ip, peer[a].as, peer[a].rmsg, peer[a].smsg, (unsigned long long)peer[a].rbytes,
+					peer[a].ucount, rate[a], prefixes, bgp_status[peer[a].status],
+					timestr, lastupd );
+			}
 
 			doff = strlen(data);
+			first = 0;
 		}
 	}
 
-	snprintf(data+doff, sizeof(data)-doff, "\\----------------------------------------------------------------------------------------------------/\n");
+	if ( config->status_format == STATUS_JSON )
+		snprintf(data+doff, sizeof(data)-doff, " ] }\n");
+	else if ( config->status_format == STATUS_ASCII )
+		snprintf(data+doff, sizeof(data)-doff, "\\---------------------------------------------------------------------------------------------------------------------------------------------/\n");
+
 	if ( ( fh = fopen(STATUSTEMP,"w") ) == NULL ) { return; }
 	fwrite(data, strlen(data), 1, fh);
 	fclose(fh);
@@ -0,0 +1,114 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <p_defs.h>
+#include <p_log.h>
+#include <p_mem.h>
+
+/* Large buffers and route state (receive buffer pool slabs, initial table
+ * dump buffers, rib buckets and entry arenas) are mapped here. With the
+ * hugepages option a mapping of at least half a huge page is rounded up to
+ * HUGE_PAGE and backed by hugetlb pages, falling back to a 2 MB aligned
+ * mapping advised with MADV_HUGEPAGE (transparent huge pages). The mode is
+ * set once at startup, p_mem_free() must get the length given to
+ * p_mem_alloc(). The memory is zeroed. */
+
+static int    mem_mode = HUGEPAGES_OFF;
+static size_t mem_page = 4096;
+
+void p_mem_init(int mode)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	mem_mode = mode;
+	mem_page = page > 0 ? page : 4096;
+}
+
+int p_mem_huge(void)
+{
+	return mem_mode;
+}
+
+/* length actually mapped, callers may use all of it */
+size_t p_mem_round(size_t len)
+{
+	if ( mem_mode != HUGEPAGES_OFF && len >= HUGE_PAGE / 2 )
+		return ( len + HUGE_PAGE - 1 ) & ~((size_t)HUGE_PAGE - 1);
+
+	return ( len + mem_page - 1 ) & ~(mem_page - 1);
+}
+
+void *p_mem_alloc(size_t len)
+{
+	size_t size = p_mem_round(len);
+	char *p;
+
+	if ( size < HUGE_PAGE || mem_mode == HUGEPAGES_OFF )
+	{
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+		return p == MAP_FAILED ? NULL : p;
+	}
+
+	#ifdef MAP_HUGETLB
+	if ( mem_mode == HUGEPAGES_HUGETLB )
+	{
+		if ( ( p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0) ) != MAP_FAILED )
+			return p;
+
+		/* no (more) reserved pages, logged once */
+		mem_mode = HUGEPAGES_THP;
+		p_log_add(time(NULL), "hugepages: no hugetlb page left, using transparent huge pages\n");
+	}
+	#endif
+
+	/* over-map and trim to a huge page boundary */
+	if ( ( p = mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0) ) == MAP_FAILED )
+		return NULL;
+
+	{
+		size_t head = ( HUGE_PAGE - ( (uintptr_t)p & ( HUGE_PAGE - 1 ) ) ) & ( HUGE_PAGE - 1 );
+
+		if ( head > 0 )
+			munmap(p, head);
+		munmap(p + head + size, HUGE_PAGE - head);
+		p += head;
+	}
+
+	#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+	#endif
+
+	return p;
+}
+
+void p_mem_free(void *p, size_t len)
+{
+	if ( p != NULL )
+		munmap(p, p_mem_round(len));
+}
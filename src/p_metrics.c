@@ -0,0 +1,369 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_stats.h>
+#include <p_hist.h>
+#include <p_metrics.h>
+
+/* The OpenMetrics exporter serves the shared memory statistics (see
+ * p_stats.c) over HTTP from its own thread. It only reads the counters,
+ * a slow scraper never delays the peer threads. */
+
+/* per neighbor metrics, counters get the _total suffix */
+static const struct {
+	const char *name;
+	const char *type;
+	const char *help;
+	size_t      offset;
+	int         size;
+} metrics_peer[] = {
+	{ "piranha_peer_sessions",           "counter", "BGP sessions established",              offsetof(struct stats_peer_t, sessions),   8 },
+	{ "piranha_peer_messages_received",  "counter", "BGP messages received",                 offsetof(struct stats_peer_t, msgs_recv),  8 },
+	{ "piranha_peer_messages_sent",      "counter", "BGP messages sent",                     offsetof(struct stats_peer_t, msgs_sent),  8 },
+	{ "piranha_peer_received_bytes",     "counter", "Bytes received",                        offsetof(struct stats_peer_t, bytes_recv), 8 },
+	{ "piranha_peer_updates",            "counter", "BGP updates received",                  offsetof(struct stats_peer_t, updates),    8 },
+	{ "piranha_peer_announces",          "counter", "Prefixes announced",                    offsetof(struct stats_peer_t, announces),  8 },
+	{ "piranha_peer_withdrawns",         "counter", "Prefixes withdrawn",                    offsetof(struct stats_peer_t, withdrawns), 8 },
+	{ "piranha_peer_duplicates",         "counter", "Announces not changing the route held", offsetof(struct stats_peer_t, duplicates), 8 },
+	{ "piranha_peer_decode_errors",      "counter", "BGP messages failing to decode",        offsetof(struct stats_peer_t, errors),     8 },
+	{ "piranha_peer_dump_bytes",         "counter", "Bytes written to closed dump files",    offsetof(struct stats_peer_t, dump_bytes), 8 },
+	{ "piranha_peer_dump_files",         "counter", "Dump files written",                    offsetof(struct stats_peer_t, dump_files), 8 },
+	{ "piranha_peer_input_buffer_bytes", "gauge",   "Bytes received waiting to be decoded",  offsetof(struct stats_peer_t, ibuf),       4 },
+	{ "piranha_peer_output_buffer_bytes","gauge",   "Bytes waiting to be sent",              offsetof(struct stats_peer_t, obuf),       4 },
+	{ "piranha_peer_last_update_timestamp_seconds", "gauge", "Time of the last update received", offsetof(struct stats_peer_t, uts), 8 },
+};
+
+/* per neighbor latency histograms, indexed by HIST_* */
+static const struct {
+	const char *name;
+	const char *help;
+} metrics_hist[HIST_STAGES] = {
+	{ "piranha_peer_wait_seconds",      "Time received data waited in the socket" },
+	{ "piranha_peer_decode_seconds",    "Time from recv() to the first dump record of a message" },
+	{ "piranha_peer_serialize_seconds", "Time to write the dump records of a message" },
+	{ "piranha_peer_flush_seconds",     "Time the oldest buffered dump record waited for the disk write" },
+	{ "piranha_peer_rotation_seconds",  "Dump file rotation time" },
+};
+
+static void *p_metrics_thread(void *data);
+static void  p_metrics_client(int sock);
+static void  p_metrics_render(struct metrics_buf_t *buf);
+static void  p_metrics_printf(struct metrics_buf_t *buf, const char *fmt, ...);
+static void  p_metrics_hist  (struct metrics_buf_t *buf, const char *name, const char *ip, uint32_t as, struct stats_hist_t *hist);
+
+/* bind the listening socket, before the privileges are dropped */
+int p_metrics_init(struct config_t *config)
+{
+	int on = 1;
+	socklen_t len = config->metrics.listen.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+
+	if ( ! config->metrics.enabled )
+		return 0;
+
+	if ( ( config->metrics.sock = socket(config->metrics.listen.ss_family, SOCK_STREAM, 0) ) == -1 )
+		return -1;
+
+	setsockopt(config->metrics.sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if ( bind(config->metrics.sock, (struct sockaddr*)&config->metrics.listen, len) == -1 ||
+		listen(config->metrics.sock, 16) == -1 )
+	{
+		close(config->metrics.sock);
+		config->metrics.sock = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* start the exporter thread, after daemonization */
+void p_metrics_start(struct config_t *config)
+{
+	pthread_t thread;
+	int *sock;
+
+	if ( ! config->metrics.enabled || config->metrics.sock == -1 )
+		return;
+
+	if ( ( sock = malloc(sizeof(int)) ) == NULL )
+		return;
+
+	*sock = config->metrics.sock;
+
+	if ( pthread_create(&thread, NULL, p_metrics_thread, sock) == 0 )
+		pthread_detach(thread);
+	else
+		free(sock);
+}
+
+static void *p_metrics_thread(void *data)
+{
+	int sock = *(int*)data;
+	free(data);
+
+	for(;;)
+	{
+		struct timeval timeout;
+		int client;
+
+		if ( ( client = accept(sock, NULL, NULL) ) == -1 )
+		{
+			usleep(100000);
+			continue;
+		}
+
+		timeout.tv_sec  = METRICS_TIMEOUT;
+		timeout.tv_usec = 0;
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		p_metrics_client(client);
+		close(client);
+	}
+
+	return NULL;
+}
+
+/* one HTTP/1.0 request per connection */
+static void p_metrics_client(int sock)
+{
+	struct metrics_buf_t buf;
+	char request[4096];
+	char header[256];
+	int len = 0;
+	int hlen;
+	size_t pos;
+
+	while ( len < sizeof(request) - 1 )
+	{
+		int r = recv(sock, request + len, sizeof(request) - 1 - len, 0);
+		if ( r <= 0 )
+			return;
+		len += r;
+		request[len] = '\0';
+		if ( strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL )
+			break;
+	}
+
+	if ( strncmp(request, "GET /metrics ", 13) != 0 && strncmp(request, "GET / ", 6) != 0 )
+	{
+		const char *notfound = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		send(sock, notfound, strlen(notfound), MSG_NOSIGNAL);
+		return;
+	}
+
+	buf.len  = 0;
+	buf.size = METRICS_BUFFER;
+	if ( ( buf.data = malloc(buf.size) ) == NULL )
+		return;
+
+	p_metrics_render(&buf);
+
+	hlen = snprintf(header, sizeof(header),
+		"HTTP/1.0 200 OK\r\n"
+		"Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+		"Content-Length: %lu\r\n"
+		"Connection: close\r\n\r\n", (unsigned long)buf.len);
+
+	if ( send(sock, header, hlen, MSG_NOSIGNAL) == hlen )
+	{
+		for(pos=0; pos<buf.len; )
+		{
+			int s = send(sock, buf.data + pos, buf.len - pos, MSG_NOSIGNAL);
+			if ( s <= 0 )
+				break;
+			pos += s;
+		}
+	}
+
+	free(buf.data);
+}
+
+static void p_metrics_printf(struct metrics_buf_t *buf, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	for(;;)
+	{
+		va_start(ap, fmt);
+		len = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+		va_end(ap);
+
+		if ( len < 0 )
+			return;
+
+		if ( buf->len + len < buf->size )
+		{
+			buf->len += len;
+			return;
+		}
+
+		{
+			char *data = realloc(buf->data, buf->size * 2);
+			if ( data == NULL )
+				return;
+			buf->data  = data;
+			buf->size *= 2;
+		}
+	}
+}
+
+static void p_metrics_render(struct metrics_buf_t *buf)
+{
+	static char ip[MAX_PEERS][INET6_ADDRSTRLEN]; /* metrics thread only, too large for the stack */
+	uint32_t up = 0;
+	int a, m;
+
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		struct stats_peer_t *peer = &stats->peer[a];
+
+		if ( ! peer->allow )
+			continue;
+
+		if ( inet_ntop(peer->af == 4 ? AF_INET : AF_INET6, peer->ip, ip[a], sizeof(ip[a])) == NULL )
+			snprintf(ip[a], sizeof(ip[a]), "unknown");
+
+		if ( peer->status == 2 )
+			up++;
+	}
+
+	p_metrics_printf(buf, "# TYPE piranha_start_time_seconds gauge\n# HELP piranha_start_time_seconds Start time of the daemon\n");
+	p_metrics_printf(buf, "piranha_start_time_seconds %llu\n", (unsigned long long)stats->started);
+
+	p_metrics_printf(buf, "# TYPE piranha_peers_up gauge\n# HELP piranha_peers_up Established BGP sessions\n");
+	p_metrics_printf(buf, "piranha_peers_up %u\n", up);
+
+	p_metrics_printf(buf, "# TYPE piranha_path_attributes gauge\n# HELP piranha_path_attributes Interned path attributes\n");
+	p_metrics_printf(buf, "piranha_path_attributes %llu\n", (unsigned long long)stats->attr_count);
+
+	p_metrics_printf(buf, "# TYPE piranha_path_attributes_bytes gauge\n# HELP piranha_path_attributes_bytes Memory used by interned path attributes\n");
+	p_metrics_printf(buf, "piranha_path_attributes_bytes %llu\n", (unsigned long long)stats->attr_bytes);
+
+	p_metrics_printf(buf, "# TYPE piranha_log_queue gauge\n# HELP piranha_log_queue Log lines waiting for the logger thread\n");
+	p_metrics_printf(buf, "piranha_log_queue %llu\n", (unsigned long long)stats->log_queue);
+
+	p_metrics_printf(buf, "# TYPE piranha_log_dropped counter\n# HELP piranha_log_dropped Log lines dropped, queue full\n");
+	p_metrics_printf(buf, "piranha_log_dropped_total %llu\n", (unsigned long long)stats->log_drops);
+
+	p_metrics_printf(buf, "# TYPE piranha_receive_buffers gauge\n# HELP piranha_receive_buffers Receive buffers borrowed from the pool\n");
+	p_metrics_printf(buf, "piranha_receive_buffers %llu\n", (unsigned long long)stats->buf_used);
+
+	p_metrics_printf(buf, "# TYPE piranha_receive_buffers_bytes gauge\n# HELP piranha_receive_buffers_bytes Memory held by the receive buffer pool\n");
+	p_metrics_printf(buf, "piranha_receive_buffers_bytes %llu\n", (unsigned long long)stats->buf_bytes);
+
+	p_metrics_printf(buf, "# TYPE piranha_receive_buffers_denied counter\n# HELP piranha_receive_buffers_denied Receive buffer requests denied, pool full\n");
+	p_metrics_printf(buf, "piranha_receive_buffers_denied_total %llu\n", (unsigned long long)stats->buf_denied);
+
+	p_metrics_printf(buf, "# TYPE piranha_dump_rotations counter\n# HELP piranha_dump_rotations Dump files rotated\n");
+	p_metrics_printf(buf, "piranha_dump_rotations_total %llu\n", (unsigned long long)stats->rotations);
+
+	p_metrics_printf(buf, "# TYPE piranha_dump_rotation_seconds counter\n# HELP piranha_dump_rotation_seconds Time spent rotating dump files\n");
+	p_metrics_printf(buf, "piranha_dump_rotation_seconds_total %.9f\n", stats->rotation_ns / 1e9);
+
+	p_metrics_printf(buf, "# TYPE piranha_dump_rotation_max_seconds gauge\n# HELP piranha_dump_rotation_max_seconds Longest dump file rotation\n");
+	p_metrics_printf(buf, "piranha_dump_rotation_max_seconds %.9f\n", stats->rotation_ns_max / 1e9);
+
+	p_metrics_printf(buf, "# TYPE piranha_peer_up gauge\n# HELP piranha_peer_up BGP session established\n");
+	for(a=0; a<MAX_PEERS; a++)
+		if ( stats->peer[a].allow )
+			p_metrics_printf(buf, "piranha_peer_up{neighbor=\"%s\",asn=\"%u\"} %u\n",
+				ip[a], stats->peer[a].as, stats->peer[a].status == 2);
+
+	p_metrics_printf(buf, "# TYPE piranha_peer_prefixes gauge\n# HELP piranha_peer_prefixes Routes held, duplicate suppression only\n");
+	for(a=0; a<MAX_PEERS; a++)
+		if ( stats->peer[a].allow && stats->peer[a].held )
+			p_metrics_printf(buf, "piranha_peer_prefixes{neighbor=\"%s\",asn=\"%u\"} %u\n",
+				ip[a], stats->peer[a].as, stats->peer[a].prefixes);
+
+	for(m=0; m<sizeof(metrics_peer)/sizeof(metrics_peer[0]); m++)
+	{
+		int counter = metrics_peer[m].type[0] == 'c';
+
+		p_metrics_printf(buf, "# TYPE %s %s\n# HELP %s %s\n",
+			metrics_peer[m].name, metrics_peer[m].type, metrics_peer[m].name, metrics_peer[m].help);
+
+		for(a=0; a<MAX_PEERS; a++)
+		{
+			char *field = (char*)&stats->peer[a] + metrics_peer[m].offset;
+			unsigned long long value;
+
+			if ( ! stats->peer[a].allow )
+				continue;
+
+			if ( metrics_peer[m].size == 8 )
+				value = __atomic_load_n((uint64_t*)field, __ATOMIC_RELAXED);
+			else
+				value = __atomic_load_n((uint32_t*)field, __ATOMIC_RELAXED);
+
+			p_metrics_printf(buf, "%s%s{neighbor=\"%s\",asn=\"%u\"} %llu\n",
+				metrics_peer[m].name, counter ? "_total" : "", ip[a], stats->peer[a].as, value);
+		}
+	}
+
+	for(m=0; m<HIST_STAGES; m++)
+	{
+		p_metrics_printf(buf, "# TYPE %s histogram\n# HELP %s %s\n",
+			metrics_hist[m].name, metrics_hist[m].name, metrics_hist[m].help);
+
+		for(a=0; a<MAX_PEERS; a++)
+			if ( stats->peer[a].allow )
+				p_metrics_hist(buf, metrics_hist[m].name, ip[a], stats->peer[a].as, &stats->peer[a].hist[m]);
+	}
+
+	p_metrics_printf(buf, "# EOF\n");
+}
+
+/* the buckets are exported per power of two, counted from a snapshot so
+ * the cumulative values stay consistent while the peer thread adds */
+static void p_metrics_hist(struct metrics_buf_t *buf, const char *name, const char *ip, uint32_t as, struct stats_hist_t *hist)
+{
+	uint64_t count = 0;
+	uint64_t sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+	int a;
+
+	for(a=0; a<HIST_BUCKETS; a++)
+	{
+		count += __atomic_load_n(&hist->bucket[a], __ATOMIC_RELAXED);
+
+		if ( a < HIST_BUCKETS - 1 && ( a & ( ( 1 << HIST_SUB ) - 1 ) ) == ( 1 << HIST_SUB ) - 1 )
+			p_metrics_printf(buf, "%s_bucket{neighbor=\"%s\",asn=\"%u\",le=\"%.6f\"} %llu\n",
+				name, ip, as, p_hist_bound(a) / 1e6, (unsigned long long)count);
+	}
+
+	p_metrics_printf(buf, "%s_bucket{neighbor=\"%s\",asn=\"%u\",le=\"+Inf\"} %llu\n", name, ip, as, (unsigned long long)count);
+	p_metrics_printf(buf, "%s_sum{neighbor=\"%s\",asn=\"%u\"} %.6f\n", name, ip, as, sum / 1e6);
+	p_metrics_printf(buf, "%s_count{neighbor=\"%s\",asn=\"%u\"} %llu\n", name, ip, as, (unsigned long long)count);
+}
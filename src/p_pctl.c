@@ -0,0 +1,199 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <p_defs.h>
+#include <p_pctl.h>
+
+/* control socket client, the command is taken from the arguments or *
+ * one per line from stdin, the answers are printed as they are       */
+int main(int argc, char *argv[])
+{
+	char *file = CONTROLFILE;
+	char *cmd  = NULL;
+	size_t clen = 0;
+	size_t csize = 0;
+	int a = 1;
+	int sock;
+
+	if ( argc > 2 && strcmp(argv[1], "-s") == 0 )
+	{
+		file = argv[2];
+		a = 3;
+	}
+	else if ( argc > 1 && argv[1][0] == '-' )
+		syntax(argv[0]);
+
+	/* the whole input is read first, the daemon does not wait for slow typists */
+	if ( a < argc )
+	{
+		for(; a<argc; a++)
+		{
+			if ( pctl_append(&cmd, &clen, &csize, argv[a], strlen(argv[a])) == -1 ||
+				pctl_append(&cmd, &clen, &csize, a+1 < argc ? " " : "\n", 1) == -1 )
+				return 2;
+		}
+	}
+	else
+	{
+		char buf[4096];
+		size_t r;
+
+		while ( ( r = fread(buf, 1, sizeof(buf), stdin) ) > 0 )
+			if ( pctl_append(&cmd, &clen, &csize, buf, r) == -1 )
+				return 2;
+	}
+
+	if ( ( sock = pctl_connect(file) ) == -1 )
+	{
+		fprintf(stderr, "error connecting to '%s', piranha not started?\n", file);
+		return 2;
+	}
+
+	return pctl_run(sock, cmd, clen);
+}
+
+void syntax(char *prog)
+{
+	printf("Piranha v%s.%s.%s control client, Copyright(c) 2004-2017 Pascal Gloor\n",P_VER_MA,P_VER_MI,P_VER_PL);
+	printf("syntax: %s [-s <socket>] [command]\n",prog);
+	printf("\n");
+	printf("without command, one command per line is read from stdin\n");
+	printf("default socket is %s, try the help command\n", CONTROLFILE);
+	exit(2);
+}
+
+int pctl_append(char **buf, size_t *len, size_t *size, const char *data, size_t dlen)
+{
+	if ( *len + dlen > *size )
+	{
+		char *n;
+		size_t s = *size ? *size : 4096;
+
+		while ( s < *len + dlen )
+			s *= 2;
+
+		if ( ( n = realloc(*buf, s) ) == NULL )
+		{
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+		*buf  = n;
+		*size = s;
+	}
+
+	memcpy(*buf + *len, data, dlen);
+	*len += dlen;
+	return 0;
+}
+
+int pctl_connect(char *file)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if ( strlen(file) >= sizeof(addr.sun_path) )
+		return -1;
+
+	strcpy(addr.sun_path, file);
+
+	if ( ( sock = socket(AF_UNIX, SOCK_STREAM, 0) ) == -1 )
+		return -1;
+
+	if ( connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 )
+	{
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/* send the commands while reading the answers, returns 1 if one failed */
+int pctl_run(int sock, char *cmd, size_t clen)
+{
+	char buf[4096];
+	char line[CONTROL_LINE];
+	size_t sent = 0;
+	int llen = 0;
+	int failed = 0;
+
+	if ( clen == 0 )
+		shutdown(sock, SHUT_WR);
+
+	for(;;)
+	{
+		struct pollfd pfd;
+		int r, i;
+
+		pfd.fd      = sock;
+		pfd.events  = POLLIN | ( sent < clen ? POLLOUT : 0 );
+		pfd.revents = 0;
+
+		if ( poll(&pfd, 1, -1) == -1 )
+			return 2;
+
+		if ( pfd.revents & POLLOUT )
+		{
+			/* closed by the daemon, its answer is still read */
+			if ( ( r = send(sock, cmd + sent, clen - sent, MSG_NOSIGNAL) ) == -1 )
+				clen = 0;
+			else if ( ( sent += r ) == clen )
+				shutdown(sock, SHUT_WR);
+		}
+
+		if ( ! ( pfd.revents & ( POLLIN | POLLHUP | POLLERR ) ) )
+			continue;
+
+		if ( ( r = recv(sock, buf, sizeof(buf), 0) ) <= 0 )
+			break;
+
+		fwrite(buf, 1, r, stdout);
+
+		/* watch for failed commands */
+		for(i=0; i<r; i++)
+		{
+			if ( buf[i] != '\n' )
+			{
+				if ( llen < sizeof(line) - 1 )
+					line[llen++] = buf[i];
+				continue;
+			}
+			line[llen] = '\0';
+			if ( strncmp(line, "error:", 6) == 0 )
+				failed = 1;
+			llen = 0;
+		}
+	}
+
+	close(sock);
+
+	return failed;
+}
@@ -34,6 +34,8 @@
 #include <netdb.h>
 #include <dirent.h>
 #include <limits.h>
+#include <time.h>
+#include <sys/uio.h>
 
 
 #include <p_defs.h>
@@ -42,6 +44,19 @@
 #include <p_config.h>
 #include <p_socket.h>
 #include <p_dump.h>
+#include <p_attr.h>
+#include <p_rib.h>
+#include <p_stats.h>
+#include <p_hist.h>
+#include <p_metrics.h>
+#include <p_control.h>
+#include <p_handoff.h>
+#include <p_buf.h>
+#include <p_cpu.h>
+#include <p_mem.h>
+#include <p_feed.h>
+#include <p_stream.h>
+#include <p_probe.h>
 #include <p_tools.h>
 
 
@@ -49,11 +64,15 @@
 struct config_t config;
 struct peer_t   peer[MAX_PEERS];
 struct timeval  ts;
+time_t          started;
+volatile sig_atomic_t reloadreq;
 
 
 /* 00 BEGIN ;) */
 int main(int argc, char *argv[])
 {
+	char *handoff;
+
 	#ifdef DEBUG
 	/* say hello */
 	printf("Piranha v%s.%s.%s BGP Daemon, Copyright(c) 2004-2017 Pascal Gloor\n",P_VER_MA,P_VER_MI,P_VER_PL);
@@ -66,6 +85,10 @@ int main(int argc, char *argv[])
 
 	/* set initial time */
 	gettimeofday(&ts,NULL);
+	started = ts.tv_sec;
+
+	/* shared path attribute store */
+	p_attr_init();
 
 	{
 		char logline[100];
@@ -76,36 +99,143 @@ int main(int argc, char *argv[])
 	/* check the cmd line options */
 	if ( argc != 2 ) { p_main_syntax(argv[0]); return -1; }
 
+	/* started by a binary upgrade */
+	if ( ( handoff = getenv(HANDOFF_ENV) ) != NULL )
+	{
+		handoff = strdup(handoff);
+		unsetenv(HANDOFF_ENV);
+	}
+
 	/* init some stuff and load the config */
 	config.file = argv[1];
+	config.peer = (struct peer_t*)peer;
 
 	if ( p_config_load((struct config_t*)&config,(struct peer_t*)peer, (time_t)ts.tv_sec) == -1 )
 	{ fprintf(stderr,"error while parsing configuration file %s\n", config.file); return -1; }
 
+	p_dump_export(config.export);
+	p_mem_init(config.hugepages);
+	p_buf_cap(config.bufpool);
+
+	/* shared memory statistics */
+	if ( p_stats_init() == -1 )
+		p_log_add((time_t)ts.tv_sec, "failed to create statistics file " STATSFILE "\n");
+
+	/* live feed of the dump records */
+	if ( p_feed_init(config.feed) == -1 )
+		p_log_add((time_t)ts.tv_sec, "failed to create feed file " FEEDFILE "\n");
+
 	/* chown working dir */
 	mychown(PATH, config.uid, config.gid, 0);
 
 	/* set config reload for signal HUP */
 	signal(SIGHUP, p_main_sighup);
 
+	/* set route refresh for signal USR1 */
+	signal(SIGUSR1, p_main_sigusr1);
+
+	/* binary upgrade, the sockets come from the previous process */
+	if ( handoff != NULL )
+	{
+		if ( p_handoff_receive((struct config_t*)&config, (struct peer_t*)peer, atoi(handoff), (time_t)ts.tv_sec) == -1 ||
+			p_socket_keys((struct config_t*)&config, (struct peer_t*)peer) == -1 )
+		{
+			p_log_add((time_t)ts.tv_sec, "upgrade: failed to take over, aborting\n");
+			return -1;
+		}
+	}
 	/* init the socket */
-	if ( p_socket_start((struct config_t*)&config, (struct peer_t*)&peer) == -1 )
+	else if ( p_socket_start((struct config_t*)&config, (struct peer_t*)&peer) == -1 )
 	{
 		fprintf(stderr,"socket error, aborting\n");
 	 	return -1;
 	}
 
 
+	/* OpenMetrics exporter socket */
+	if ( ( handoff == NULL || config.metrics.sock == -1 ) && p_metrics_init((struct config_t*)&config) == -1 )
+	{
+		fprintf(stderr,"metrics socket error, aborting\n");
+		return -1;
+	}
+
+	/* control socket */
+	if ( ( handoff == NULL || config.control == -1 ) && p_control_init((struct config_t*)&config) == -1 )
+	{
+		fprintf(stderr,"control socket error " CONTROLFILE ", aborting\n");
+		return -1;
+	}
+
+	/* stream server sockets */
+	if ( p_stream_init((struct config_t*)&config) == -1 )
+	{
+		fprintf(stderr,"stream socket error, aborting\n");
+		return -1;
+	}
+
 	#ifndef DEBUG
 	/* we dont use daemon() here, it doesnt exist on solaris/suncc ;-) */
 	/* daemon(1,0); */
 	if ( mydaemon(1,0) ) { fprintf(stderr,"daemonization error.\n"); }
 	#endif
 
+	/* everything is set up, the previous process exits */
+	if ( handoff != NULL && p_handoff_ack((time_t)ts.tv_sec) == -1 )
+	{
+		p_log_add((time_t)ts.tv_sec, "upgrade: the previous process is gone, aborting\n");
+		return -1;
+	}
+
 	/* log the pid */
 	p_log_pid();
 
-	while ( p_main_loop() == 0 )
+	/* the threads created from now on inherit the cpu_aux affinity */
+	p_cpu_init();
+	if ( p_cpu_pin((struct cpus_t*)&config.cpu_aux, -1) == -1 )
+		p_log_add((time_t)ts.tv_sec, "cpu_aux: failed to set the thread affinity\n");
+
+	/* from now on log lines are written by the logger thread */
+	p_log_start();
+
+	p_metrics_start((struct config_t*)&config);
+	p_control_start((struct config_t*)&config);
+	p_stream_start((struct config_t*)&config);
+
+	/* sessions taken over from the previous process */
+	{
+		int a;
+		for(a=0; a<MAX_PEERS; a++)
+		{
+			pthread_t thread;
+			int *myid;
+
+			if ( peer[a].handoff != HANDOFF_RESUME )
+				continue;
+
+			myid = malloc(sizeof(int));
+			memcpy(myid,&a,sizeof(int));
+
+			pthread_create(&thread, NULL, p_main_peer_resume, (void *)myid);
+			pthread_detach(thread);
+		}
+	}
+
+	/* the other listen_shards get their own accept thread */
+	{
+		int shard;
+		for(shard=1; shard<config.shards; shard++)
+		{
+			pthread_t thread;
+			int *myshard;
+			myshard = malloc(sizeof(int));
+			memcpy(myshard,&shard,sizeof(int));
+
+			pthread_create(&thread, NULL, p_main_accept, (void *)myshard);
+			pthread_detach(thread);
+		}
+	}
+
+	while ( p_main_loop(0) == 0 )
 	{
 		#ifdef DEBUG
 		printf("accept() loop\n");
@@ -115,7 +245,15 @@ int main(int argc, char *argv[])
 		/* therefor we sleep a bit here. */
 		usleep(100000);
 
+		/* configuration reload requested with SIGHUP */
+		if ( reloadreq )
+		{
+			reloadreq = 0;
+			p_main_reload();
+		}
+
 		p_log_status((struct config_t*)&config,(struct peer_t*)peer, (time_t)ts.tv_sec);
+		p_stats_update((struct config_t*)&config,(struct peer_t*)peer, (time_t)ts.tv_sec);
 
 		/* we update a global var with the actual timestamp */
 		gettimeofday(&ts,NULL);
@@ -128,12 +266,34 @@ int main(int argc, char *argv[])
 	return -1;
 }
 
+/* accept thread of a listen shard */
+void *p_main_accept(void *data)
+{
+	int shard;
+	memcpy(&shard,data,sizeof(shard));
+	free(data);
+
+	while ( p_main_loop(shard) == 0 )
+		usleep(100000);
+
+	pthread_exit(NULL);
+}
+
 /*  check for accept() and start thread() */
-int p_main_loop()
+int p_main_loop(int shard)
 {
 	int sock;
 
-	if ( ( sock = p_socket_accept((struct config_t*)&config) ) == -1 )
+	/* the listening sockets are being handed to a new process */
+	if ( p_handoff_busy() )
+		return 0;
+
+	/* a reload may re-create the listening sockets */
+	pthread_mutex_lock(&config_lock);
+	sock = p_socket_accept((struct config_t*)&config, shard);
+	pthread_mutex_unlock(&config_lock);
+
+	if ( sock == -1 )
 	{
 		return 0;
 	}
@@ -160,7 +320,6 @@ void *p_main_peer(void *data)
 	struct sockaddr_in  *addr4 = (struct sockaddr_in  *)&sockaddr;
 	struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&sockaddr;
 	socklen_t socklen = sizeof(sockaddr);
-	struct timeval msgtime;
 
 	memcpy(&sock,data,sizeof(sock));
 
@@ -199,44 +358,95 @@ void *p_main_peer(void *data)
 		if (
 			( sockaddr.ss_family == AF_INET  && peer[a].af == 4 && p_tools_sameip4(&peer[a].ip4, &addr4->sin_addr)  && peer[a].allow == 1 ) ||
 			( sockaddr.ss_family == AF_INET6 && peer[a].af == 6 && p_tools_sameip6(&peer[a].ip6, &addr6->sin6_addr) && peer[a].allow == 1 )
-		) {
-			char logline[100];
-			if ( peer[a].status == 0 )
-			{
-				snprintf(logline,sizeof(logline), "%s connection (known)\n",
-					sockaddr.ss_family == AF_INET ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6) );
-				p_log_add((time_t)ts.tv_sec, logline);
-				#ifdef DEBUG
-				printf("peer ip allowed id %i\n",a);
-				#endif
-				allow          = 1;
-				peer[a].sock   = sock;
-				peer[a].status = 1;
-				peer[a].rhold  = BGP_DEFAULT_HOLD;
-				peer[a].shold  = BGP_DEFAULT_HOLD;
-				peer[a].ilen   = 0;
-				peer[a].olen   = 0;
-				peer[a].rts    = ts.tv_sec;
-				peer[a].sts    = ts.tv_sec;
-				peer[a].cts    = ts.tv_sec;
-				peer[a].rmsg   = 0;
-				peer[a].smsg   = 0;
-				peer[a].filets = 0;
-				peer[a].fh     = NULL;
-				peer[a].ucount = 0;
-				peer[a].as4    = 0;
-				peerid         = a;
+		)
+			break;
+	}
 
-			}
-			else
-			{
-				snprintf(logline, sizeof(logline), "%s connection (already connected)\n",
-					sockaddr.ss_family == AF_INET ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6) );
-				p_log_add((time_t)ts.tv_sec, logline);
-			}
+	/* a connection from inside a neighbor_range instantiates a dynamic neighbor */
+	if ( a == MAX_PEERS && ( sockaddr.ss_family == AF_INET || sockaddr.ss_family == AF_INET6 ) )
+	{
+		pthread_mutex_lock(&config_lock);
+		if ( sockaddr.ss_family == AF_INET )
+			a = p_config_add_dynamic((struct config_t*)&config, (struct peer_t*)peer, 4, (uint8_t*)&addr4->sin_addr, ts.tv_sec);
+		else
+			a = p_config_add_dynamic((struct config_t*)&config, (struct peer_t*)peer, 6, addr6->sin6_addr.s6_addr, ts.tv_sec);
+		pthread_mutex_unlock(&config_lock);
 
-			break;
+		if ( a == -2 )
+			p_log_add((time_t)ts.tv_sec, "dynamic neighbor refused, no free neighbor slot\n");
+
+		if ( a < 0 )
+			a = MAX_PEERS;
+		else
+			p_stats_reset(a);
+	}
+
+	if ( a < MAX_PEERS )
+	{
+		char logline[100];
+		if ( peer[a].status == 0 )
+		{
+			snprintf(logline,sizeof(logline), "%s connection (%s)\n",
+				sockaddr.ss_family == AF_INET ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6),
+				peer[a].dynamic ? "dynamic" : "known" );
+			p_log_add((time_t)ts.tv_sec, logline);
+			#ifdef DEBUG
+			printf("peer ip allowed id %i\n",a);
+			#endif
+			allow          = 1;
+			peer[a].sock   = sock;
+			peer[a].status = 1;
+			peer[a].thread = 1;
+			peer[a].rhold  = BGP_DEFAULT_HOLD;
+			peer[a].shold  = BGP_DEFAULT_HOLD;
+			peer[a].ilen   = 0;
+			peer[a].olen   = 0;
+			peer[a].rts    = ts.tv_sec;
+			peer[a].sts    = ts.tv_sec;
+			peer[a].cts    = ts.tv_sec;
+			peer[a].rmsg   = 0;
+			peer[a].smsg   = 0;
+			peer[a].filets = 0;
+			peer[a].fh     = NULL;
+			peer[a].ucount = 0;
+			peer[a].rbytes = 0;
+			peer[a].uts    = 0;
+			peer[a].prefixes = 0;
+			peer[a].as4    = 0;
+			peer[a].refresh    = 0;
+			peer[a].refreshreq = 0;
+			peer[a].rotatereq  = 0;
+			peer[a].flushreq   = 0;
+			peer[a].export     = config.export;
+			peer[a].gr     = 0;
+			peer[a].grtime = 0;
+			peer[a].eor    = 0;
+			peer[a].fbulk  = 1;
+			peer[a].icount[0] = 0;
+			peer[a].icount[1] = 0;
+			peer[a].ests   = 0;
+			peer[a].rxts   = 0;
+			peer[a].serts  = 0;
+			peer[a].dcount = 0;
+			peer[a].rib    = NULL;
+			peerid         = a;
+			PROBE3(state, a, 1, peer[a].af);
+
+			#ifdef SO_TIMESTAMPNS
+			/* kernel receive time, for the HIST_WAIT latency */
+			{ int on = 1; setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)); }
+			#endif
+
+			p_socket_tune((struct config_t*)&config, (struct peer_t*)peer, a, sock);
+
+		}
+		else
+		{
+			snprintf(logline, sizeof(logline), "%s connection (already connected)\n",
+				sockaddr.ss_family == AF_INET ? p_tools_ip4str(a, &peer[a].ip4) : p_tools_ip6str(a, &peer[a].ip6) );
+			p_log_add((time_t)ts.tv_sec, logline);
 		}
+
 	}
 
 	if ( allow == 0 )
@@ -257,7 +467,44 @@ void *p_main_peer(void *data)
 	printf("peerid %i\n",peerid);
 	#endif
 
+	p_main_peer_session(data, sock, peerid);
+
+	return NULL;
+}
+
+/* peer thread of a session taken over from the previous process */
+void *p_main_peer_resume(void *data)
+{
+	int peerid;
+
+	memcpy(&peerid,data,sizeof(peerid));
+
+	p_main_peer_session(data, peer[peerid].sock, peerid);
+
+	return NULL;
+}
+
+/* session until it goes down, the slot is held DUMPINTERVAL more */
+void p_main_peer_session(void *data, int sock, int peerid)
+{
+	struct timeval msgtime;
+
+	/* before the session buffers are allocated, they go to this NUMA node */
+	if ( p_cpu_pin((struct cpus_t*)&config.cpu_peers, config.cpu_spread ? peerid : -1) == -1 )
+	{
+		char logline[100];
+		snprintf(logline, sizeof(logline), "%s cpu_peers: failed to set the thread affinity\n",
+			peer[peerid].af == 4 ? p_tools_ip4str(peerid, &peer[peerid].ip4) : p_tools_ip6str(peerid, &peer[peerid].ip6) );
+		p_log_add((time_t)ts.tv_sec, logline);
+	}
+
 	p_main_peer_loop(peerid);
+
+	/* handed over to the new process, nothing is closed */
+	if ( peer[peerid].handoff == HANDOFF_DONE )
+		p_main_peer_exit(data, -1);
+
+	PROBE3(state, peerid, 0, peer[peerid].af);
 	gettimeofday(&msgtime, NULL);
 	p_dump_add_close(peer, peerid, &msgtime);
 
@@ -266,18 +513,27 @@ void *p_main_peer(void *data)
 
 	peer[peerid].status = 1;
 	sleep(DUMPINTERVAL);
+
+	/* a dynamic neighbor only lives as long as its session */
+	pthread_mutex_lock(&config_lock);
+	if ( peer[peerid].dynamic )
+	{
+		peer[peerid].allow    = 0;
+		peer[peerid].newallow = 0;
+		peer[peerid].dynamic  = 0;
+	}
 	peer[peerid].status = 0;
+	peer[peerid].thread = 0;
+	pthread_mutex_unlock(&config_lock);
 
 	p_main_peer_exit(data, sock);
-
-	return NULL;
 }
 
 /* peer looop */
 void p_main_peer_loop(int id)
 {
 	char logline[100];
-	char *ibuf;
+	struct buf_t ibuf;
 	char *obuf;
 	uint8_t marker[16];
 	struct timeval msgtime;
@@ -287,28 +543,42 @@ void p_main_peer_loop(int id)
 	peer[id].ilen = 0;
 	peer[id].olen = 0;
 
-	ibuf = malloc(INPUT_BUFFER);
 	obuf = malloc(OUTPUT_BUFFER);
 
+	if ( p_buf_init(&ibuf) == -1 || obuf == NULL )
+	{
+		snprintf(logline, sizeof(logline), "%s out of memory for the session buffers\n",
+			peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
+		p_log_add((time_t)ts.tv_sec, logline);
+		peer[id].status = 0;
+	}
+
 	#ifdef DEBUG
 	printf("peer status %u\n",peer[id].status);
 	printf("starting peer loop\n");
 	#endif
 
-	p_main_peer_open(id, obuf);
+	/* a session taken over continues where the previous process stopped */
+	if ( peer[id].handoff == HANDOFF_RESUME )
+		p_handoff_restore(peer, id, &ibuf, obuf);
+	else if ( peer[id].status > 0 )
+		p_main_peer_open(id, obuf);
 
 	while((peer[id].status>0))
 	{
 		/* receiving new datas, sleep 1sec if nothing */
 		int tlen = 0;
-		int maxlen = INPUT_BUFFER - peer[id].ilen;
+		int maxlen = ibuf.size - peer[id].ilen;
 
 		if ( TEMP_BUFFER < maxlen ) { maxlen = TEMP_BUFFER; }
 
-		tlen = recv(peer[id].sock, ibuf+peer[id].ilen, INPUT_BUFFER-peer[id].ilen, 0);
+		tlen = p_main_peer_recv(id, ibuf.data+peer[id].ilen, maxlen);
 
 		if ( tlen == -1 )
 		{
+			/* idle, the pool buffer goes back for other bursts */
+			p_buf_shrink(&ibuf, peer[id].ilen);
+
 			gettimeofday(&msgtime, NULL);
 			p_dump_check_file(peer,id,&msgtime);
 			sleep(1);
@@ -319,6 +589,12 @@ void p_main_peer_loop(int id)
 			printf("got data\n");
 			#endif
 			peer[id].ilen += tlen;
+			peer[id].rbytes += tlen;
+			STATS_ADD(stats->peer[id].bytes_recv, tlen);
+
+			/* more is waiting, read bigger chunks while it lasts */
+			if ( tlen == maxlen )
+				p_buf_grow(&ibuf, peer[id].ilen, 0);
 		}
 		else
 		{
@@ -335,7 +611,36 @@ void p_main_peer_loop(int id)
 		/* working on datas */
 		if ( peer[id].ilen > 0 )
 		{
-			p_main_peer_work(ibuf, obuf, id);
+			p_main_peer_work(ibuf.data, obuf, id);
+		}
+
+		/* neighbor removed by a reload or on the control socket */
+		if ( peer[id].allow == 0 )
+			peer[id].status = 0;
+
+		/* dump file rotation or flush requested on the control socket */
+		if ( peer[id].rotatereq )
+		{
+			gettimeofday(&msgtime, NULL);
+			p_dump_rotate(peer, id, &msgtime);
+			peer[id].rotatereq = 0;
+		}
+
+		if ( peer[id].flushreq )
+		{
+			p_dump_flush(peer, id);
+			peer[id].flushreq = 0;
+		}
+
+		/* binary upgrade, the session goes to the new process */
+		if ( peer[id].handoff == HANDOFF_REQ && p_handoff_peer(peer, id, ibuf.data, obuf) == 0 )
+			break;
+
+		/* route refresh requested with SIGUSR1 or on the control socket */
+		if ( peer[id].refreshreq && peer[id].status == 2 )
+		{
+			peer[id].refreshreq = 0;
+			p_main_peer_refresh(id, obuf);
 		}
 
 		/* check if the peer timed out  (note: 0 == no keepalive!) */
@@ -364,6 +669,7 @@ void p_main_peer_loop(int id)
 
 			peer[id].sts = ts.tv_sec;
 			peer[id].smsg++;
+			STATS_ADD(stats->peer[id].msgs_sent, 1);
 
 			p_main_peer_send(id, obuf);
 		}
@@ -395,9 +701,15 @@ void p_main_peer_loop(int id)
 
 	}
 
-	free(ibuf);
+	p_buf_free(&ibuf);
 	free(obuf);
 
+	if ( peer[id].handoff == HANDOFF_DONE )
+		return;
+
+	p_rib_free(peer[id].rib);
+	peer[id].rib = NULL;
+
 	snprintf(logline, sizeof(logline), "%s down\n",
 		peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 	p_log_add((time_t)ts.tv_sec, logline);
@@ -416,10 +728,8 @@ void p_main_peer_open(int id, char *obuf)
 	struct bgp_header r_header;
 	struct bgp_open   r_open;
 	struct bgp_param  r_param;
-	struct bgp_param_capa *r_capa_as4;
-	struct bgp_param_capa *r_capa_afi;
-	uint32_t ugly_afi4 = htonl(0x00010001);
-	uint32_t ugly_afi6 = htonl(0x00020001);
+	uint32_t as4 = htonl(config.as);
+	uint32_t afi = htonl( peer[id].af == 4 ? 0x00010001 : 0x00020001 );
 
 
 	uint8_t marker[16];
@@ -429,32 +739,42 @@ void p_main_peer_open(int id, char *obuf)
 	memcpy(r_header.marker, marker, sizeof(r_header.marker));
 
 
+	/* capabilities parameter */
+	r_param.type     = 2;
+	r_param.len      = 0;
+
 	/* 4 bytes AS capability RFC6793 */
-	r_capa_as4 = (struct bgp_param_capa*)r_param.param;
-	r_capa_as4->type     = 65;
-	r_capa_as4->len      = 4;
-	r_capa_as4->u.as4    = htonl(config.as);
+	p_main_peer_capa(&r_param, BGP_CAPA_AS4, &as4, 4);
 
-	if ( peer[id].af == 4 )
-	{
-		/* AFI support IPv4 unicast */
-		r_capa_afi = (struct bgp_param_capa*)(r_param.param+r_capa_as4->len+2);
-		r_capa_afi->type     = 1;
-		r_capa_afi->len      = 4;
-		memcpy(r_capa_afi->u.def,&ugly_afi4,4); /* TO BE IMPROVED, UGLY !!!!! */
-	}
-	else
+	/* AFI support IPv4 or IPv6 unicast RFC4760 */
+	p_main_peer_capa(&r_param, BGP_CAPA_MP, &afi, 4);
+
+	/* route refresh RFC2918 and enhanced route refresh RFC7313 */
+	p_main_peer_capa(&r_param, BGP_CAPA_REFRESH, NULL, 0);
+	p_main_peer_capa(&r_param, BGP_CAPA_EREFRESH, NULL, 0);
+
+	/* graceful restart RFC4724, the restart state is set while we are
+	   younger than the restart time, forwarding state is never preserved */
+	if ( config.grtime > 0 )
 	{
-		/* AFI support IPv6 unicast */
-		r_capa_afi = (struct bgp_param_capa*)(r_param.param+r_capa_as4->len+2);
-		r_capa_afi->type     = 1;
-		r_capa_afi->len      = 4;
-		memcpy(r_capa_afi->u.def,&ugly_afi6,4); /* TO BE IMPROVED, UGLY !!!!! */
-	}
+		uint8_t gr[6];
+		uint16_t flags = config.grtime & BGP_GR_TIME;
 
-	/* capabilities parameter */
-	r_param.type     = 2;
-	r_param.len      = r_capa_as4->len + 2 + r_capa_afi->len + 2;
+		if ( ts.tv_sec - started < config.grtime )
+		{
+			flags |= BGP_GR_RESTART;
+			peer[id].gr |= GR_LOCAL_RESTART;
+		}
+
+		gr[0] = flags >> 8;
+		gr[1] = flags & 0xff;
+		gr[2] = 0;
+		gr[3] = peer[id].af == 4 ? 1 : 2;
+		gr[4] = 1;
+		gr[5] = 0;
+
+		p_main_peer_capa(&r_param, BGP_CAPA_GR, gr, sizeof(gr));
+	}
 
 	/* open message */
 	r_open.version   = 4;
@@ -477,6 +797,7 @@ void p_main_peer_open(int id, char *obuf)
 
 
 	peer[id].smsg++;
+	STATS_ADD(stats->peer[id].msgs_sent, 1);
 	p_main_peer_send(id,obuf);
 
 	/* we add directly the first keepalive msg */
@@ -493,9 +814,124 @@ void p_main_peer_open(int id, char *obuf)
 	/* send the packet */
 
 	peer[id].smsg++;
+	STATS_ADD(stats->peer[id].msgs_sent, 1);
 	p_main_peer_send(id,obuf);
 }
 
+/* append a capability to the capabilities parameter */
+void p_main_peer_capa(struct bgp_param *param, uint8_t type, void *data, uint8_t len)
+{
+	param->param[param->len]   = type;
+	param->param[param->len+1] = len;
+	if ( len > 0 )
+		memcpy(param->param + param->len + 2, data, len);
+	param->len += 2 + len;
+}
+
+/* End-of-RIB received, the initial table or a graceful restart is complete */
+void p_main_peer_eor(int id, uint16_t afi, struct timeval *msgtime)
+{
+	char logline[100];
+	uint32_t duration;
+
+	/* only the first one closes the initial table */
+	if ( ( afi != 1 && afi != 2 ) || peer[id].eor & afi )
+		return;
+
+	peer[id].eor |= afi;
+
+	duration = (uint64_t)msgtime->tv_sec * 1000 + msgtime->tv_usec / 1000 - peer[id].ests;
+
+	p_dump_add_eor(peer, id, msgtime, afi, peer[id].icount[afi-1], duration);
+
+	snprintf(logline, sizeof(logline), "%s End-of-RIB received afi %u, %u prefixes in %u.%03us\n",
+		peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6), afi,
+		peer[id].icount[afi-1], duration / 1000, duration % 1000);
+	p_log_add((time_t)ts.tv_sec, logline);
+}
+
+/* ask the peer to resend its routes, RFC2918 */
+void p_main_peer_refresh(int id, char *obuf)
+{
+	char logline[100];
+	struct bgp_header  r_header;
+	struct bgp_refresh r_refresh;
+
+	if ( ! ( peer[id].refresh & REFRESH_CAPA ) )
+	{
+		snprintf(logline, sizeof(logline), "%s route refresh not supported by peer\n",
+			peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
+		p_log_add((time_t)ts.tv_sec, logline);
+		return;
+	}
+
+	/* forget the routes held, the resent ones are no duplicates */
+	if ( peer[id].rib != NULL )
+	{
+		p_rib_free(peer[id].rib);
+		if ( ( peer[id].rib = p_rib_new() ) == NULL )
+		{
+			snprintf(logline, sizeof(logline), "%s out of memory for duplicate suppression\n",
+				peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
+			p_log_add((time_t)ts.tv_sec, logline);
+		}
+		peer[id].prefixes = 0;
+	}
+
+	memset(r_header.marker, 0xff, sizeof(r_header.marker));
+	r_header.len      = htons(BGP_HEADER_LEN + BGP_REFRESH_LEN);
+	r_header.type     = BGP_REFRESH;
+
+	r_refresh.afi     = htons( peer[id].af == 4 ? 1 : 2 );
+	r_refresh.subtype = BGP_REFRESH_REQUEST;
+	r_refresh.safi    = 1;
+
+	STATS_ADD(stats->peer[id].msgs_sent, 1);
+
+	memcpy(obuf+peer[id].olen, &r_header, BGP_HEADER_LEN);
+	peer[id].olen += BGP_HEADER_LEN;
+
+	memcpy(obuf+peer[id].olen, &r_refresh, BGP_REFRESH_LEN);
+	peer[id].olen += BGP_REFRESH_LEN;
+
+	snprintf(logline, sizeof(logline), "%s route refresh requested\n",
+		peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
+	p_log_add((time_t)ts.tv_sec, logline);
+}
+
+/* BoRR or EoRR received, RFC7313, the routes of the family not announced *
+ * again in between are withdrawn, the dump readers purge them at EoRR     */
+void p_main_peer_rrmarker(int id, struct bgp_refresh *refresh, struct timeval *msgtime)
+{
+	char logline[100];
+	uint16_t afi = ntohs(refresh->afi);
+	uint32_t purged = 0;
+
+	if ( ( afi != 1 && afi != 2 ) || refresh->safi != 1 )
+		return;
+
+	p_dump_add_refresh(peer, id, msgtime, afi, refresh->subtype);
+
+	/* the routes held for duplicate suppression follow the same rule */
+	if ( peer[id].rib != NULL )
+	{
+		if ( refresh->subtype == BGP_REFRESH_BORR )
+			p_rib_stale(peer[id].rib, afi == 1 ? 4 : 6);
+		else
+			purged = p_rib_purge(peer[id].rib, afi == 1 ? 4 : 6);
+
+		peer[id].prefixes = peer[id].rib->count;
+	}
+
+	if ( refresh->subtype == BGP_REFRESH_BORR )
+		snprintf(logline, sizeof(logline), "%s route refresh BoRR received afi %u\n",
+			peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6), afi);
+	else
+		snprintf(logline, sizeof(logline), "%s route refresh EoRR received afi %u, %u stale routes purged\n",
+			peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6), afi, purged);
+	p_log_add((time_t)ts.tv_sec, logline);
+}
+
 /* bgp decoding stuff */
 void p_main_peer_work(char *ibuf, char *obuf, int id)
 {
@@ -528,6 +964,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 			#ifdef DEBUG
 			printf("invalid marker\n");
 			#endif
+			STATS_ADD(stats->peer[id].errors, 1);
 			peer[id].status = 0;
 			return;
 		}
@@ -550,8 +987,12 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 		#endif
 
 
+		PROBE3(message, id, header->type, htons(header->len));
+
 		pos += BGP_HEADER_LEN;
 		peer[id].rmsg++;
+		peer[id].serts = 0;
+		STATS_ADD(stats->peer[id].msgs_recv, 1);
 
 		peer[id].rts = ts.tv_sec;
 
@@ -580,6 +1021,10 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 			printf("BGP Version: %u\n",bopen->version);
 			#endif
 
+			/* dynamic neighbor of an any AS range, learned here or from capa 65 */
+			if ( peer[id].as == 0 && htons(bopen->as) != 23456 )
+				peer[id].as = htons(bopen->as);
+
 			if ( htons(bopen->as) == 23456 ) /* AS_TRANS RFC6793 */
 			{
 				alt_asn=1;
@@ -612,6 +1057,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 				#ifdef DEBUG
 				printf("size error in bgp open params, len %u, header %u open %u param %u\n",htons(header->len),BGP_HEADER_LEN,BGP_OPEN_LEN,bopen->param_len);
 				#endif
+				STATS_ADD(stats->peer[id].errors, 1);
 				peer[id].status = 0;
 				return;
 			}
@@ -644,6 +1090,9 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 
 						if ( capa->type == 65 && capa->len == 4 ) /* Support for 4-octets ASN */
 						{
+							if ( peer[id].as == 0 )
+								peer[id].as = ntohl(capa->u.as4);
+
 							if ( peer[id].as == ntohl(capa->u.as4) )
 							{
 								alt_asn = 0;
@@ -658,6 +1107,20 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 								return;
 							}
 						}
+						else if ( capa->type == BGP_CAPA_GR && capa->len >= 2 )
+						{
+							uint16_t flags = ( (uint8_t)capa->u.def[0] << 8 ) | (uint8_t)capa->u.def[1];
+
+							peer[id].gr    |= GR_CAPA;
+							peer[id].grtime = flags & BGP_GR_TIME;
+							if ( flags & BGP_GR_RESTART )
+								peer[id].gr |= GR_PEER_RESTART;
+						}
+						else if ( capa->type == BGP_CAPA_REFRESH )
+							peer[id].refresh |= REFRESH_CAPA;
+						else if ( capa->type == BGP_CAPA_EREFRESH )
+							peer[id].refresh |= REFRESH_ENHANCED;
+
 						i += 1 + 1 + capa->len;
 					}
 				}
@@ -677,6 +1140,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					#ifdef DEBUG
 					printf("parameter rejected!\n");
 					#endif
+					STATS_ADD(stats->peer[id].errors, 1);
 					peer[id].status = 0;
 					return;
 				}
@@ -691,11 +1155,24 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 				return;
 			}
 
+			peer[id].type = peer[id].as == config.as ? BGP_TYPE_IBGP : BGP_TYPE_EBGP;
+
 			snprintf(logline, sizeof(logline), "%s established\n",
 				peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 			p_log_add((time_t)ts.tv_sec, logline);
 
 			peer[id].status = 2;
+			STATS_ADD(stats->peer[id].sessions, 1);
+			PROBE3(state, id, 2, peer[id].af);
+			peer[id].ests   = (uint64_t)msgtime.tv_sec * 1000 + msgtime.tv_usec / 1000;
+
+			/* keep the routes held to recognize duplicate announces */
+			if ( peer[id].duplicate != DUPLICATE_KEEP && ( peer[id].rib = p_rib_new() ) == NULL )
+			{
+				snprintf(logline, sizeof(logline), "%s out of memory for duplicate suppression\n",
+					peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
+				p_log_add((time_t)ts.tv_sec, logline);
+			}
 
 			p_dump_add_open(peer, id, &msgtime);
 
@@ -717,6 +1194,14 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 			uint16_t  extcommunitylen6  = 0;
 			void     *largecommunity    = NULL;
 			uint16_t  largecommunitylen = 0;
+			struct attr_t *attr         = NULL;
+
+			STATS_ADD(stats->peer[id].updates, 1);
+			PROBE2(update_start, id, htons(header->len));
+
+			/* IPv4 End-of-RIB is an empty update */
+			if ( htons(header->len) == BGP_HEADER_LEN + 4 )
+				p_main_peer_eor(id, 1, &msgtime);
 
 			wlen = *(uint16_t *) (ibuf + pos);
 			wlen = ntohs(wlen);
@@ -784,8 +1269,12 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 				}
 				#endif
 
+				if ( peer[id].rib != NULL )
+					p_rib_withdrawn4(peer[id].rib, prefix, plen);
+
 				p_dump_add_withdrawn4(peer,id,&msgtime,prefix,plen);
 				peer[id].ucount++;
+				STATS_ADD(stats->peer[id].withdrawns, 1);
 			}
 
 			alen = *(uint16_t *) (ibuf + pos);
@@ -846,6 +1335,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 								p_tools_ip6str(id, &peer[id].ip6) );
 
 						p_log_add((time_t)ts.tv_sec, logline);
+						STATS_ADD(stats->peer[id].errors, 1);
 						peer[id].status = 0;
 						return;
 					}
@@ -867,7 +1357,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 
 				}
 
-				if ( a[BGP_ATTR_ORIGIN].pos != 0xffff && config.export & EXPORT_ORIGIN )
+				if ( a[BGP_ATTR_ORIGIN].pos != 0xffff && peer[id].export & EXPORT_ORIGIN )
 				{
 					uint16_t off     = a[BGP_ATTR_ORIGIN].pos;
 					uint16_t codelen = a[BGP_ATTR_ORIGIN].len;
@@ -881,7 +1371,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					}
 				}
 
-				if ( a[BGP_ATTR_NEXT_HOP].pos != 0xffff && config.export & EXPORT_NEXT_HOP )
+				if ( a[BGP_ATTR_NEXT_HOP].pos != 0xffff && peer[id].export & EXPORT_NEXT_HOP )
 				{
 					uint16_t off     = a[BGP_ATTR_NEXT_HOP].pos;
 					uint16_t codelen = a[BGP_ATTR_NEXT_HOP].len;
@@ -895,7 +1385,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					}
 				}
 
-				if ( a[BGP_ATTR_AS_PATH].pos != 0xffff && config.export & EXPORT_ASPATH )
+				if ( a[BGP_ATTR_AS_PATH].pos != 0xffff && peer[id].export & EXPORT_ASPATH )
 				{
 					uint16_t off     = a[BGP_ATTR_AS_PATH].pos;
 					uint16_t codelen = a[BGP_ATTR_AS_PATH].len;
@@ -953,12 +1443,13 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 						snprintf(logline, sizeof(logline), "%s error in aspath code\n",
 							peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 						p_log_add((time_t)ts.tv_sec, logline);
+						STATS_ADD(stats->peer[id].errors, 1);
 						peer[id].status = 0;
 						return;
 					}
 				}
 
-				if ( a[BGP_ATTR_COMMUNITY].pos != 0xffff && config.export & EXPORT_COMMUNITY )
+				if ( a[BGP_ATTR_COMMUNITY].pos != 0xffff && peer[id].export & EXPORT_COMMUNITY )
 				{
 					uint16_t off = a[BGP_ATTR_COMMUNITY].pos;
 					uint16_t codelen = a[BGP_ATTR_COMMUNITY].len;
@@ -968,6 +1459,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 						snprintf(logline, sizeof(logline), "%s error in community length\n",
 							peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 						p_log_add((time_t)ts.tv_sec, logline);
+						STATS_ADD(stats->peer[id].errors, 1);
 						peer[id].status = 0;
 						return;
 					}
@@ -976,7 +1468,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					communitylen = codelen / 4;
 				}
 
-				if ( a[BGP_ATTR_EXTCOMMUNITY4].pos != 0xffff && config.export & EXPORT_EXTCOMMUNITY )
+				if ( a[BGP_ATTR_EXTCOMMUNITY4].pos != 0xffff && peer[id].export & EXPORT_EXTCOMMUNITY )
 				{
 					uint16_t off = a[BGP_ATTR_EXTCOMMUNITY4].pos;
 					uint16_t codelen = a[BGP_ATTR_EXTCOMMUNITY4].len;
@@ -986,6 +1478,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 						snprintf(logline, sizeof(logline), "%s error in extended community IPv4 length\n",
 							peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 						p_log_add((time_t)ts.tv_sec, logline);
+						STATS_ADD(stats->peer[id].errors, 1);
 						peer[id].status = 0;
 						return;
 					}
@@ -994,7 +1487,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					extcommunitylen4 = codelen / 8;
 				}
 
-				if ( a[BGP_ATTR_EXTCOMMUNITY6].pos != 0xffff && config.export & EXPORT_EXTCOMMUNITY )
+				if ( a[BGP_ATTR_EXTCOMMUNITY6].pos != 0xffff && peer[id].export & EXPORT_EXTCOMMUNITY )
 				{
 					uint16_t off = a[BGP_ATTR_EXTCOMMUNITY6].pos;
 					uint16_t codelen = a[BGP_ATTR_EXTCOMMUNITY6].len;
@@ -1004,6 +1497,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 						snprintf(logline, sizeof(logline), "%s error in extended community IPv6 length\n",
 							peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 						p_log_add((time_t)ts.tv_sec, logline);
+						STATS_ADD(stats->peer[id].errors, 1);
 						peer[id].status = 0;
 						return;
 					}
@@ -1012,7 +1506,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					extcommunitylen6 = codelen / 20;
 				}
 
-				if ( a[BGP_ATTR_LARGECOMMUNITY].pos != 0xffff && config.export & EXPORT_LARGECOMMUNITY )
+				if ( a[BGP_ATTR_LARGECOMMUNITY].pos != 0xffff && peer[id].export & EXPORT_LARGECOMMUNITY )
 				{
 					uint16_t off = a[BGP_ATTR_LARGECOMMUNITY].pos;
 					uint16_t codelen = a[BGP_ATTR_LARGECOMMUNITY].len;
@@ -1022,6 +1516,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 						snprintf(logline, sizeof(logline), "%s error in large community length\n",
 							peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 						p_log_add((time_t)ts.tv_sec, logline);
+						STATS_ADD(stats->peer[id].errors, 1);
 						peer[id].status = 0;
 						return;
 					}
@@ -1030,6 +1525,42 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					largecommunitylen = codelen / 12;
 				}
 
+				/* intern the attributes once, they are shared by all prefixes of this update */
+				if ( a[BGP_ATTR_MP_REACH_NLRI].pos != 0xffff || pos + alen < htons(header->len) )
+				{
+					uint8_t nh[16];
+
+					memset(nh, 0xff, sizeof(nh));
+
+					if ( a[BGP_ATTR_MP_REACH_NLRI].pos != 0xffff && peer[id].export & EXPORT_NEXT_HOP )
+					{
+						uint16_t off   = a[BGP_ATTR_MP_REACH_NLRI].pos;
+						uint16_t afi   = ntohs(*(uint16_t*) (ibuf+pos+off));
+						uint8_t  safi  = *(uint8_t*) (ibuf+pos+off+2);
+						uint8_t  nhlen = *(uint8_t*) (ibuf+pos+off+3);
+
+						/* global address only, a link-local one may follow */
+						if ( afi == 2 && safi == 1 )
+							memcpy(nh, ibuf+pos+off+4, nhlen < sizeof(nh) ? nhlen : sizeof(nh));
+					}
+
+					attr = p_attr_get(peer[id].as4, origin, nexthop, nh,
+						aspath,         aspathlen,
+						community,      communitylen,
+						extcommunity4,  extcommunitylen4,
+						extcommunity6,  extcommunitylen6,
+						largecommunity, largecommunitylen );
+
+					if ( attr == NULL )
+					{
+						snprintf(logline, sizeof(logline), "%s out of memory for path attributes\n",
+							peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
+						p_log_add((time_t)ts.tv_sec, logline);
+						peer[id].status = 0;
+						return;
+					}
+				}
+
 				if ( a[BGP_ATTR_MP_REACH_NLRI].pos != 0xffff )
 				{
 					uint16_t off     = a[BGP_ATTR_MP_REACH_NLRI].pos;
@@ -1038,17 +1569,11 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 					uint16_t  afi    = ntohs(*(uint16_t*) (ibuf+pos+off));
 					uint8_t  safi    = *(uint8_t*) (ibuf+pos+off+2);
 					uint8_t nhlen    = *(uint8_t*) (ibuf+pos+off+3);
-					uint8_t nh[16];
-
-					memset(nh, 0xff, sizeof(nh));
 
 					i += 4 + nhlen + 1;
 
 					if ( afi == 2 && safi == 1) /* IPv6 Unicast */
 					{
-						if ( config.export & EXPORT_NEXT_HOP )
-							memcpy(nh, ibuf+pos+off+4, nhlen);
-
 						while(i<codelen)
 						{
 							uint8_t plen = *(uint8_t*) (ibuf+pos+off+i);
@@ -1084,13 +1609,14 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 							}
 							#endif
 
-							p_dump_add_announce6( peer, id, &msgtime, prefix6, plen, origin, nh,
-								aspath,         aspathlen,
-								community,      communitylen,
-								extcommunity6,  extcommunitylen6,
-								largecommunity, largecommunitylen );
+							if ( ! p_main_peer_duplicate(id, peer[id].rib != NULL && p_rib_announce6(peer[id].rib, prefix6, plen, attr)) )
+								p_dump_add_announce6( peer, id, &msgtime, prefix6, plen, attr );
+
+							if ( ! ( peer[id].eor & 2 ) )
+								peer[id].icount[1]++;
 
 							peer[id].ucount++;
+							STATS_ADD(stats->peer[id].announces, 1);
 						}
 
 					}
@@ -1112,6 +1638,10 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 
 					i += 3;
 
+					/* End-of-RIB is a MP_UNREACH_NLRI without prefix as only attribute */
+					if ( codelen == 3 && safi == 1 && a[BGP_ATTR_MP_UNREACH_NLRI].pos + codelen == alen )
+						p_main_peer_eor(id, afi, &msgtime);
+
 					if ( afi == 2 && safi == 1) /* IPv6 Unicast */
 					{
 						while(i<codelen)
@@ -1149,6 +1679,9 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 							}
 							#endif
 
+							if ( peer[id].rib != NULL )
+								p_rib_withdrawn6(peer[id].rib, prefix6, plen);
+
 							p_dump_add_withdrawn6(
 								peer,
 								id,
@@ -1156,6 +1689,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 								prefix6,
 								plen );
 							peer[id].ucount++;
+							STATS_ADD(stats->peer[id].withdrawns, 1);
 						}
 
 					}
@@ -1225,15 +1759,24 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 				}
 				#endif
 
-				p_dump_add_announce4(peer,id, &msgtime, prefix, plen, origin, nexthop,
-					aspath,         aspathlen,
-					community,      communitylen,
-					extcommunity4,  extcommunitylen4,
-					largecommunity, largecommunitylen );
+				if ( ! p_main_peer_duplicate(id, peer[id].rib != NULL && p_rib_announce4(peer[id].rib, prefix, plen, attr)) )
+					p_dump_add_announce4(peer,id, &msgtime, prefix, plen, attr);
+
+				if ( ! ( peer[id].eor & 1 ) )
+					peer[id].icount[0]++;
 
 				peer[id].ucount++;
+				STATS_ADD(stats->peer[id].announces, 1);
 			}
 
+			p_attr_release(attr);
+
+			peer[id].uts = ts.tv_sec;
+			if ( peer[id].rib != NULL )
+				peer[id].prefixes = peer[id].rib->count;
+
+			PROBE2(update_end, id, htons(header->len));
+
 		}
 		else if ( header->type == BGP_ERROR )
 		{
@@ -1263,6 +1806,26 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 			printf("received keepalive\n");
 			#endif
 		}
+		else if ( header->type == BGP_REFRESH && peer[id].status == 2 && htons(header->len) == BGP_HEADER_LEN + BGP_REFRESH_LEN )
+		{
+			/* route refresh, we have no routes to send, only BoRR/EoRR are of interest */
+			struct bgp_refresh *refresh;
+
+			refresh = (struct bgp_refresh*) (ibuf + pos);
+			pos += BGP_REFRESH_LEN;
+
+			peer[id].rts = ts.tv_sec;
+
+			if ( refresh->subtype == BGP_REFRESH_BORR || refresh->subtype == BGP_REFRESH_EORR )
+				p_main_peer_rrmarker(id, refresh, &msgtime);
+			else
+			{
+				snprintf(logline, sizeof(logline), "%s route refresh request received afi %u safi %u\n",
+					peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6),
+					ntohs(refresh->afi), refresh->safi);
+				p_log_add((time_t)ts.tv_sec, logline);
+			}
+		}
 		else
 		{
 			#ifdef DEBUG
@@ -1272,6 +1835,7 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 			snprintf(logline, sizeof(logline), "%s invalid message type\n",
 				peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 			p_log_add((time_t)ts.tv_sec, logline);
+			STATS_ADD(stats->peer[id].errors, 1);
 			peer[id].status = 0;
 			return;
 		}
@@ -1285,10 +1849,13 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 			snprintf(logline, sizeof(logline), "%s error in packet size\n",
 				peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6) );
 			p_log_add((time_t)ts.tv_sec, logline);
+			STATS_ADD(stats->peer[id].errors, 1);
 			peer[id].status = 0;
 			return;
 		}
 
+		p_main_peer_latency(id);
+
 		if ( peer[id].ilen <= htons(header->len) )
 		{
 			peer[id].ilen = 0;
@@ -1304,6 +1871,85 @@ void p_main_peer_work(char *ibuf, char *obuf, int id)
 	}
 }
 
+/* recv() noting when the data was read and how long the kernel held it */
+int p_main_peer_recv(int id, char *buf, int len)
+{
+	int tlen;
+#ifdef SO_TIMESTAMPNS
+	char control[CMSG_SPACE(sizeof(struct timespec))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len  = len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	if ( ( tlen = recvmsg(peer[id].sock, &msg, 0) ) <= 0 )
+		return tlen;
+
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+		{
+			struct timespec kts, now;
+			int64_t wait;
+
+			memcpy(&kts, CMSG_DATA(cmsg), sizeof(kts));
+			clock_gettime(CLOCK_REALTIME, &now);
+			wait = (int64_t)(now.tv_sec - kts.tv_sec) * 1000000 + (now.tv_nsec - kts.tv_nsec) / 1000;
+
+			if ( wait >= 0 )
+				p_hist_add(&stats->peer[id].hist[HIST_WAIT], wait);
+		}
+	}
+#else
+	if ( ( tlen = recv(peer[id].sock, buf, len, 0) ) <= 0 )
+		return tlen;
+#endif
+
+	peer[id].rxts = p_hist_clock();
+
+	return tlen;
+}
+
+/* account the latencies of the message just decoded */
+void p_main_peer_latency(int id)
+{
+	uint64_t now = p_hist_clock();
+
+	if ( peer[id].rxts == 0 )
+		return;
+
+	if ( peer[id].serts == 0 )
+	{
+		p_hist_add(&stats->peer[id].hist[HIST_DECODE], now - peer[id].rxts);
+		return;
+	}
+
+	p_hist_add(&stats->peer[id].hist[HIST_DECODE],    peer[id].serts - peer[id].rxts);
+	p_hist_add(&stats->peer[id].hist[HIST_SERIALIZE], now - peer[id].serts);
+}
+
+/* duplicate announce suppression, returns 1 if the announce must not be dumped */
+int p_main_peer_duplicate(int id, int duplicate)
+{
+	if ( duplicate == 0 || peer[id].duplicate == DUPLICATE_KEEP )
+		return 0;
+
+	if ( peer[id].duplicate == DUPLICATE_COUNT )
+		peer[id].dcount++;
+
+	STATS_ADD(stats->peer[id].duplicates, 1);
+
+	return 1;
+}
+
 /* send() */
 void p_main_peer_send(int id, char *obuf)
 {
@@ -1365,7 +2011,8 @@ void p_main_peer_exit(void *data, int sock)
 	printf("dead thready with socket %i\n",sock);
 	#endif
 
-	close(sock);
+	if ( sock != -1 )
+		close(sock);
 
 	free(data);
 
@@ -1378,27 +2025,55 @@ void p_main_syntax(char *prog)
 	printf("syntax: %s <configuration file>\n",prog);
 }
 
-/* kill -HUP for config reload */
+/* kill -HUP for config reload, done by the main loop */
 void p_main_sighup(int sig)
 {
-	if ( p_config_load((struct config_t*)&config,(struct peer_t*)peer, (time_t)ts.tv_sec) == -1 )
+	reloadreq = 1;
+	signal(sig,p_main_sighup);
+}
+
+/* reload the configuration file, logrotate */
+void p_main_reload(void)
+{
+	int r;
+
+	p_log_reopen();
+
+	pthread_mutex_lock(&config_lock);
+	r = p_config_reload((struct config_t*)&config,(struct peer_t*)peer, (time_t)ts.tv_sec);
+	pthread_mutex_unlock(&config_lock);
+
+	if ( r == -1 )
 	{
 		#ifdef DEBUG
 		printf("failed to reload config!\n");
-		#else
-		p_log_add((time_t)ts.tv_sec, "failed to reload configuration\n");
 		#endif
-		exit(1);
+		p_log_add((time_t)ts.tv_sec, "failed to reload configuration, running configuration kept\n");
+		return;
 	}
 
-	if ( p_socket_start((struct config_t*)&config, (struct peer_t*)peer) == -1 )
+	if ( r == -2 )
 	{
 		p_log_add((time_t)ts.tv_sec, "socket error, aborting\n");
 		exit(1);
 	}
 
+	/* the export set changes at the next dump file rotation */
+	p_dump_export(config.export);
+
 	p_log_add((time_t)ts.tv_sec, "configuration reloaded\n");
-	signal(sig,p_main_sighup);
+}
+
+/* kill -USR1 to request a route refresh from all established peers */
+void p_main_sigusr1(int sig)
+{
+	int a;
+
+	for(a=0; a<MAX_PEERS; a++)
+		if ( peer[a].status == 2 )
+			peer[a].refreshreq = 1;
+
+	signal(sig,p_main_sigusr1);
 }
 
 int mydaemon(int nochdir, int noclose)
@@ -0,0 +1,253 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_hist.h>
+#include <p_pstat.h>
+
+static const char *status_str[] = { "down", "temp", "up" };
+static const char *hist_str[HIST_STAGES] = { "wait", "decode", "serialize", "flush", "rotation" };
+
+/* shared memory statistics reader */
+int main(int argc, char *argv[])
+{
+	char *file = STATSFILE;
+	int mode = PSTAT_HUMAN;
+	struct stats_t *stats;
+	struct stat sb;
+	int fd;
+	int a;
+
+	for(a=1; a<argc; a++)
+	{
+		if ( strcmp(argv[a], "-j") == 0 )
+			mode = PSTAT_JSON;
+		else if ( argv[a][0] != '-' )
+			file = argv[a];
+		else
+			syntax(argv[0]);
+	}
+
+	if ( ( fd = open(file, O_RDONLY) ) == -1 || fstat(fd, &sb) == -1 )
+	{
+		fprintf(stderr, "error opening '%s'\n", file);
+		return -1;
+	}
+
+	if ( sb.st_size < sizeof(struct stats_t) )
+	{
+		fprintf(stderr, "'%s' is too small, piranha not started?\n", file);
+		return -1;
+	}
+
+	if ( ( stats = mmap(NULL, sizeof(struct stats_t), PROT_READ, MAP_SHARED, fd, 0) ) == MAP_FAILED )
+	{
+		fprintf(stderr, "error mapping '%s'\n", file);
+		return -1;
+	}
+	close(fd);
+
+	if ( __atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+		stats->version != STATS_VERSION || stats->size < sizeof(struct stats_t) || stats->maxpeers != MAX_PEERS )
+	{
+		fprintf(stderr, "'%s' has an unsupported layout (version %u, size %u, peers %u)\n",
+			file, stats->version, stats->size, stats->maxpeers);
+		return -1;
+	}
+
+	if ( mode == PSTAT_JSON )
+		print_json(stats, time(NULL));
+	else
+		print_human(stats, time(NULL));
+
+	return 0;
+}
+
+void syntax(char *prog)
+{
+	printf("Piranha v%s.%s.%s statistics reader, Copyright(c) 2004-2017 Pascal Gloor\n",P_VER_MA,P_VER_MI,P_VER_PL);
+	printf("syntax: %s [-j] [statistics file]\n",prog);
+	printf("\n");
+	printf("-j for JSON output\n");
+	printf("default file is %s\n", STATSFILE);
+	exit(1);
+}
+
+char *peer_ip(struct stats_peer_t *peer, char *str, int len)
+{
+	if ( inet_ntop(peer->af == 4 ? AF_INET : AF_INET6, peer->ip, str, len) == NULL )
+		snprintf(str, len, "-");
+	return str;
+}
+
+void print_human(struct stats_t *stats, time_t now)
+{
+	int a;
+
+	printf("pid %llu started %llus ago, sampled %llus ago\n",
+		(unsigned long long)stats->pid,
+		(unsigned long long)(now - stats->started),
+		(unsigned long long)(now - stats->updated));
+	printf("path attributes %llu (%llu bytes)\n",
+		(unsigned long long)stats->attr_count, (unsigned long long)stats->attr_bytes);
+	printf("log queue %llu, %llu lines dropped\n",
+		(unsigned long long)stats->log_queue, (unsigned long long)stats->log_drops);
+	printf("receive buffers %llu borrowed (%llu bytes), %llu denied\n",
+		(unsigned long long)stats->buf_used, (unsigned long long)stats->buf_bytes,
+		(unsigned long long)stats->buf_denied);
+	printf("dump rotations %llu, last %.3fms, max %.3fms, avg %.3fms\n",
+		(unsigned long long)stats->rotations,
+		stats->rotation_ns_last / 1e6, stats->rotation_ns_max / 1e6,
+		stats->rotations ? (double)stats->rotation_ns / stats->rotations / 1e6 : 0.0);
+	printf("\n");
+	printf("%-39s %10s %6s %8s %10s %10s %12s %10s %10s %10s %10s %6s %12s %8s %8s\n",
+		"neighbor", "asn", "status", "sessions", "recv", "sent", "bytes", "updates", "announces",
+		"withdrawns", "duplicates", "errors", "dump bytes", "ibuf", "obuf");
+
+	for(a=0; a<stats->maxpeers; a++)
+	{
+		struct stats_peer_t *peer = &stats->peer[a];
+		char ip[INET6_ADDRSTRLEN];
+
+		if ( ! peer->allow )
+			continue;
+
+		printf("%-39s %10u %6s %8llu %10llu %10llu %12llu %10llu %10llu %10llu %10llu %6llu %12llu %8u %8u\n",
+			peer_ip(peer, ip, sizeof(ip)), peer->as, status_str[peer->status % 3],
+			(unsigned long long)peer->sessions, (unsigned long long)peer->msgs_recv,
+			(unsigned long long)peer->msgs_sent, (unsigned long long)peer->bytes_recv,
+			(unsigned long long)peer->updates, (unsigned long long)peer->announces,
+			(unsigned long long)peer->withdrawns, (unsigned long long)peer->duplicates,
+			(unsigned long long)peer->errors, (unsigned long long)peer->dump_bytes,
+			peer->ibuf, peer->obuf);
+	}
+
+	printf("\n");
+	printf("%-39s %-9s %10s %10s %10s %10s %10s %10s\n",
+		"latency (us)", "stage", "count", "avg", "p50", "p90", "p99", "max");
+
+	for(a=0; a<stats->maxpeers; a++)
+	{
+		struct stats_peer_t *peer = &stats->peer[a];
+		char ip[INET6_ADDRSTRLEN];
+		int h;
+
+		if ( ! peer->allow )
+			continue;
+
+		for(h=0; h<HIST_STAGES; h++)
+		{
+			struct stats_hist_t *hist = &peer->hist[h];
+
+			if ( hist->count == 0 )
+				continue;
+
+			printf("%-39s %-9s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+				peer_ip(peer, ip, sizeof(ip)), hist_str[h], (unsigned long long)hist->count,
+				(unsigned long long)(hist->sum / hist->count),
+				(unsigned long long)p_hist_quantile(hist, 0.5),
+				(unsigned long long)p_hist_quantile(hist, 0.9),
+				(unsigned long long)p_hist_quantile(hist, 0.99),
+				(unsigned long long)hist->max);
+		}
+	}
+}
+
+void print_json(struct stats_t *stats, time_t now)
+{
+	int a;
+	int first = 1;
+
+	printf("{ \"timestamp\": %llu, \"pid\": %llu, \"started\": %llu, \"updated\": %llu, ",
+		(unsigned long long)now, (unsigned long long)stats->pid,
+		(unsigned long long)stats->started, (unsigned long long)stats->updated);
+	printf("\"attr_count\": %llu, \"attr_bytes\": %llu, \"log_queue\": %llu, \"log_drops\": %llu, ",
+		(unsigned long long)stats->attr_count, (unsigned long long)stats->attr_bytes,
+		(unsigned long long)stats->log_queue, (unsigned long long)stats->log_drops);
+	printf("\"buf_used\": %llu, \"buf_bytes\": %llu, \"buf_denied\": %llu, ",
+		(unsigned long long)stats->buf_used, (unsigned long long)stats->buf_bytes,
+		(unsigned long long)stats->buf_denied);
+	printf("\"rotations\": %llu, \"rotation_ns\": %llu, \"rotation_ns_last\": %llu, \"rotation_ns_max\": %llu, \"peers\": [",
+		(unsigned long long)stats->rotations, (unsigned long long)stats->rotation_ns,
+		(unsigned long long)stats->rotation_ns_last, (unsigned long long)stats->rotation_ns_max);
+
+	for(a=0; a<stats->maxpeers; a++)
+	{
+		struct stats_peer_t *peer = &stats->peer[a];
+		char ip[INET6_ADDRSTRLEN];
+
+		if ( ! peer->allow )
+			continue;
+
+		printf("%s { \"ip\": \"%s\", \"asn\": %u, \"status\": \"%s\", \"cts\": %llu, \"uts\": %llu, ",
+			first ? "" : ",", peer_ip(peer, ip, sizeof(ip)), peer->as, status_str[peer->status % 3],
+			(unsigned long long)peer->cts, (unsigned long long)peer->uts);
+		printf("\"sessions\": %llu, \"msgs_recv\": %llu, \"msgs_sent\": %llu, \"bytes_recv\": %llu, \"updates\": %llu, ",
+			(unsigned long long)peer->sessions, (unsigned long long)peer->msgs_recv,
+			(unsigned long long)peer->msgs_sent, (unsigned long long)peer->bytes_recv,
+			(unsigned long long)peer->updates);
+		printf("\"announces\": %llu, \"withdrawns\": %llu, \"duplicates\": %llu, \"errors\": %llu, ",
+			(unsigned long long)peer->announces, (unsigned long long)peer->withdrawns,
+			(unsigned long long)peer->duplicates, (unsigned long long)peer->errors);
+		printf("\"dump_bytes\": %llu, \"dump_files\": %llu, \"ibuf\": %u, \"obuf\": %u",
+			(unsigned long long)peer->dump_bytes, (unsigned long long)peer->dump_files,
+			peer->ibuf, peer->obuf);
+		if ( peer->held )
+			printf(", \"prefixes\": %u", peer->prefixes);
+		print_json_latency(peer);
+		printf(" }");
+		first = 0;
+	}
+
+	printf(" ] }\n");
+}
+
+/* latency summaries in microseconds */
+void print_json_latency(struct stats_peer_t *peer)
+{
+	int h;
+
+	printf(", \"latency\": {");
+
+	for(h=0; h<HIST_STAGES; h++)
+	{
+		struct stats_hist_t *hist = &peer->hist[h];
+
+		printf("%s \"%s\": { \"count\": %llu, \"sum\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu }",
+			h ? "," : "", hist_str[h], (unsigned long long)hist->count, (unsigned long long)hist->sum,
+			(unsigned long long)p_hist_quantile(hist, 0.5),
+			(unsigned long long)p_hist_quantile(hist, 0.9),
+			(unsigned long long)p_hist_quantile(hist, 0.99),
+			(unsigned long long)hist->max);
+	}
+
+	printf(" }");
+}
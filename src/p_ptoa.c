@@ -26,12 +26,15 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 
 #include <p_defs.h>
 #include <p_ptoa.h>
 #include <p_dump.h>
 #include <p_undump.h>
+#include <p_format.h>
+#include <p_filter.h>
 #include <p_tools.h>
 
 /* dump decoder tool */
@@ -39,9 +42,12 @@ int main(int argc, char *argv[])
 {
 	char *file = NULL;
 	int mode = PTOA_NONE;
+	int arg = 2;
+	struct stream_filter_t filter;
+	struct stream_filter_t *match = NULL;
 	struct dump_file_ctx *ctx;
 
-	if ( argc != 3 )
+	if ( argc < 3 || argc > 6 )
 		syntax(argv[0]);
 	else if ( strcmp(argv[1],"-m") == 0 )
 		mode = PTOA_MACHINE;
@@ -52,6 +58,28 @@ int main(int argc, char *argv[])
 	else
 		syntax(argv[0]);
 
+	/* the filter of the stream server, the format keywords are ignored */
+	if ( argc >= 5 && strcmp(argv[2],"-F") == 0 )
+	{
+		uint8_t format;
+
+		memset(&filter, 0, sizeof(filter));
+		if ( p_filter_parse(&filter, argv[3], 1, &format) == -1 )
+		{
+			fprintf(stderr,"invalid filter '%s'\n",argv[3]);
+			return -1;
+		}
+		match = &filter;
+		arg   = 4;
+	}
+
+	if ( strcmp(argv[arg],"-f") == 0 && argc <= arg + 2 )
+		return print_feed(mode, match, argc == arg + 2 ? argv[arg+1] : FEEDFILE);
+	else if ( strcmp(argv[arg],"-s") == 0 && argc == arg + 2 )
+		return print_stream(mode, match, argv[arg+1]);
+	else if ( match != NULL || argc != 3 )
+		syntax(argv[0]);
+
 	file = argv[2];
 
 	if ( ( ctx = p_undump_open(file) ) == NULL )
@@ -70,267 +98,118 @@ int main(int argc, char *argv[])
 			break;
 		}
 
-		switch(mode) {
-			case PTOA_MACHINE:
-				{
-					unsigned long long int ts  = msg.msg.ts;
-					unsigned long long int uts = msg.msg.uts;
-					printf("%llu.%llu|",ts,uts);
-				}
-				break;
-			case PTOA_HUMAN:
-				{
-					char line[100];
-					struct timeval t;
-					t.tv_sec  = msg.msg.ts;
-					t.tv_usec = msg.msg.uts;
-
-					p_tools_humantime(line, sizeof(line), &t);
-					printf("%s ",line);
-				}
-				break;
-			case PTOA_JSON:
-				{
-					unsigned long long int ts  = msg.msg.ts;
-					unsigned long long int uts = msg.msg.uts;
-					printf("{ \"timestamp\": %llu.%llu, ",ts, uts);
-				}
-		}
-
-		switch(msg.msg.type)
-		{
-			case DUMP_HEADER4:
-				if ( mode == PTOA_MACHINE )
-					printf("P|%u|%u|%c\n",msg.header4.ip,msg.header4.as,msg.header4.type == BGP_TYPE_IBGP ? 'i' : 'e');
-				else if ( mode == PTOA_JSON )
-				{
-					struct in_addr addr;
-					addr.s_addr = htobe32(msg.header4.ip);
-					printf("\"type\": \"peer\", \"msg\": { \"peer\": { \"proto\": \"ipv4\", \"ip\": \"%s\", \"asn\": %u, \"type\": \"%s\" } } }\n",
-						inet_ntoa(addr), msg.header4.as, msg.header4.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp" );
-				}
-				else
-				{
-					struct in_addr addr;
-					addr.s_addr = htobe32(msg.header4.ip);
-					printf("peer ip %s AS %u TYPE %s\n",inet_ntoa(addr),msg.header4.as,msg.header4.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp");
-				}
-				break;
-
-			case DUMP_HEADER6:
-				if ( mode == PTOA_MACHINE )
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.header6.ip, sizeof(msg.header6.ip));
-					printf("P|%s|%u|%c\n",p_tools_ip6str(MAX_PEERS, &addr),msg.header6.as,msg.header6.type == BGP_TYPE_IBGP ? 'i' : 'e');
-				}
-				else if ( mode == PTOA_JSON )
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.header6.ip, sizeof(msg.header6.ip));
-					printf("\"type\": \"peer\", \"msg\": { \"peer\": { \"proto\": \"ipv6\", \"ip\": \"%s\", \"asn\": %u, \"type\": \"%s\" } } }\n",
-						p_tools_ip6str(MAX_PEERS, &addr),msg.header6.as,msg.header6.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp");
-				}
-				else
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.header6.ip, sizeof(msg.header6.ip));
-					printf("peer ip %s AS %u TYPE %s\n",p_tools_ip6str(MAX_PEERS, &addr),msg.header6.as,msg.header6.type == BGP_TYPE_IBGP ? "ibgp" : "ebgp");
-				}
-				break;
-
-			case DUMP_OPEN:
-				if ( mode == PTOA_MACHINE )
-					printf("C\n");
-				else if ( mode == PTOA_JSON )
-					printf("\"type\": \"connect\" }\n");
-				else
-					printf("connected\n");
-				break;
-
-			case DUMP_CLOSE:
-				if ( mode == PTOA_MACHINE )
-					printf("D\n");
-				else if ( mode == PTOA_JSON )
-					printf("\"type\": \"disconnect\" }\n");
-				else
-					printf("disconnected\n");
-				break;
-
-			case DUMP_KEEPALIVE:
-				if ( mode == PTOA_MACHINE )
-					printf("K\n");
-				else if ( mode == PTOA_JSON )
-					printf("\"type\": \"keepalive\" }\n");
-				else
-					printf("keepalive\n");
-				break;
-
-			case DUMP_ANNOUNCE4:
-
-				if ( mode == PTOA_MACHINE )
-					printf("A|%u|%u",msg.announce4.prefix, msg.announce4.mask);
-				else if ( mode == PTOA_JSON )
-				{
-					struct in_addr addr;
-					addr.s_addr = htobe32(msg.announce4.prefix);
-					printf("\"type\": \"announce\", \"msg\": { \"prefix\": \"%s/%u\"",
-						inet_ntoa(addr),msg.announce4.mask);
-				}
-				else
-				{
-					struct in_addr addr;
-					addr.s_addr = htobe32(msg.announce4.prefix);
-					printf("prefix announce %s/%u",inet_ntoa(addr),msg.announce4.mask);
-				}
-
-				if ( msg.announce4.origin != 0xff )
-					print_origin(mode, msg.announce4.origin);
-
-				if ( msg.announce4.nexthop != 0xffffff )
-					print_nexthop4(mode, msg.announce4.nexthop);
-
-				if ( msg.announce4.aspathlen > 0 )
-					print_aspath(mode, &msg.aspath, msg.announce4.aspathlen);
-
-				if ( msg.announce4.communitylen > 0 )
-					print_community(mode, &msg.community, msg.announce4.communitylen);
+		p_format_msg(stdout, mode, &msg, NULL);
+	}
 
-				if ( msg.announce4.extcommunitylen4 > 0 )
-					print_extcommunity4(mode, &msg.extcommunity4, msg.announce4.extcommunitylen4);
+	p_undump_close(ctx);
 
-				if ( msg.announce4.largecommunitylen > 0 )
-					print_largecommunity(mode, &msg.largecommunity, msg.announce4.largecommunitylen);
+	return 0;
+}
 
+/* tail the live feed, opened again once replaced by a new piranha process */
+int print_feed(int mode, struct stream_filter_t *filter, char *file)
+{
+	struct feed_ctx *ctx;
+	struct feed_rec_t rec;
+	uint8_t record[sizeof(struct dump_msg) + 65535];
+	uint64_t lost = 0;
+	int idle = 0;
 
-				if ( mode == PTOA_JSON )
-					printf(" } }\n");
-				else
-					printf("\n");
+	if ( ( ctx = p_undump_feed_open(file) ) == NULL )
+	{
+		fprintf(stderr,"error opening feed '%s'\n",file);
+		return -1;
+	}
 
-				break;
+	while(1)
+	{
+		struct dump_full_msg msg;
 
-			case DUMP_ANNOUNCE6:
-				if ( mode == PTOA_MACHINE )
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.announce6.prefix, sizeof(msg.announce6.prefix));
-					printf("A|%s|%u",p_tools_ip6str(0, &addr), msg.announce6.mask);
-				}
-				else if ( mode == PTOA_JSON )
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.announce6.prefix, sizeof(msg.announce6.prefix));
-					printf("\"type\": \"announce\", \"msg\": { \"prefix\": \"%s/%u\"",
-						p_tools_ip6str(0, &addr),msg.announce6.mask);
-				}
-				else
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.announce6.prefix, sizeof(msg.announce6.prefix));
-					printf("prefix announce %s/%u",p_tools_ip6str(0, &addr),msg.announce6.mask);
-				}
+		if ( p_undump_feed_next(ctx, &rec, record) == 0 )
+		{
+			fflush(stdout);
+			usleep(FEED_WAIT);
 
-				if ( msg.announce6.origin != 0xff )
-					print_origin(mode, msg.announce6.origin);
+			if ( ++idle % 1000 == 0 && p_undump_feed_replaced(ctx) )
+			{
+				struct feed_ctx *next;
 
+				if ( ( next = p_undump_feed_open(file) ) != NULL )
 				{
-					int i;
-					int doit = 0;
-					for(i=0; i<16; i++) {
-						if ( msg.announce6.nexthop[i] != 0xff ) {
-							doit=1;
-							break;
-						}
-					}
-
-					if ( doit )
-						print_nexthop6(mode, msg.announce6.nexthop);
+					p_undump_feed_close(ctx);
+					ctx  = next;
+					lost = 0;
+					fprintf(stderr,"feed '%s' replaced\n",file);
 				}
+			}
+			continue;
+		}
 
-				if ( msg.announce6.aspathlen > 0 )
-					print_aspath(mode, &msg.aspath, msg.announce6.aspathlen);
-
-				if ( msg.announce6.communitylen > 0 )
-					print_community(mode, &msg.community, msg.announce6.communitylen);
+		if ( ctx->lost != lost )
+		{
+			fprintf(stderr,"feed overrun, %llu records lost\n", (unsigned long long int)(ctx->lost - lost));
+			lost = ctx->lost;
+		}
 
-				if ( msg.announce6.extcommunitylen6 > 0 )
-					print_extcommunity6(mode, &msg.extcommunity6, msg.announce6.extcommunitylen6);
+		if ( p_undump_record(record, rec.len, &msg) != 0 )
+		{
+			fprintf(stderr,"error during message parsing of feed record %llu\n", (unsigned long long int)rec.seq);
+			continue;
+		}
 
-				if ( msg.announce6.largecommunitylen > 0 )
-					print_largecommunity(mode, &msg.largecommunity, msg.announce6.largecommunitylen);
+		if ( filter != NULL && p_filter_match(filter, &rec, &msg) == 0 )
+			continue;
 
-				if ( mode == PTOA_JSON )
-					printf(" } }");
-	
-				printf("\n");
-
-				break;
+		p_format_msg(stdout, mode, &msg, &rec);
+	}
 
-			case DUMP_WITHDRAWN4:
+	return 0;
+}
 
-				if ( mode == PTOA_MACHINE )
-				{
-					printf("W|%u|%u",msg.withdrawn4.prefix,msg.withdrawn4.mask);
-				}
-				else if ( mode == PTOA_JSON )
-				{
-					struct in_addr addr;
-					addr.s_addr = htobe32(msg.withdrawn4.prefix);
-					printf("\"type\": \"withdrawn\", \"msg\": { \"prefix\": \"%s/%u\" } }",
-						inet_ntoa(addr),msg.withdrawn4.mask);
-				}
-				else
-				{
-					struct in_addr addr;
-					addr.s_addr = htobe32(msg.withdrawn4.prefix);
-					printf("prefix withdrawn %s/%u",inet_ntoa(addr),msg.withdrawn4.mask);
-				}
-				printf("\n");
+/* the output of a binary stream subscriber, - for stdin */
+int print_stream(int mode, struct stream_filter_t *filter, char *file)
+{
+	struct feed_rec_t rec;
+	uint8_t record[sizeof(struct dump_msg) + 65535];
+	FILE *fh;
 
-				break;
+	if ( ( fh = strcmp(file, "-") == 0 ? stdin : fopen(file, "rb") ) == NULL )
+	{
+		fprintf(stderr,"error opening '%s'\n",file);
+		return -1;
+	}
 
-			case DUMP_WITHDRAWN6:
-				if ( mode == PTOA_MACHINE )
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.withdrawn6.prefix, sizeof(msg.withdrawn6.prefix));
-					printf("W|%s|%u",p_tools_ip6str(0, &addr), msg.withdrawn6.mask);
-				}
-				else if ( mode == PTOA_JSON )
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.withdrawn6.prefix, sizeof(msg.withdrawn6.prefix));
-					printf("\"type\": \"withdrawn\", \"msg\": { \"prefix\": \"%s/%u\" } }",
-						p_tools_ip6str(0, &addr),msg.withdrawn6.mask);
-				}
-				else
-				{
-					struct in6_addr addr;
-					memcpy(addr.s6_addr, msg.withdrawn6.prefix, sizeof(msg.withdrawn6.prefix));
-					printf("prefix withdrawn %s/%u",p_tools_ip6str(0, &addr),msg.withdrawn6.mask);
-				}
-				printf("\n");
+	while ( fread(&rec, sizeof(rec), 1, fh) == 1 )
+	{
+		struct dump_full_msg msg;
 
-				break;
+		if ( rec.type == FEED_LOST )
+		{
+			fprintf(stderr,"stream lost %llu records\n", (unsigned long long int)rec.seq);
+			continue;
+		}
 
-			case DUMP_FOOTER:
+		if ( rec.type != FEED_RECORD || rec.len > sizeof(record) || fread(record, 1, rec.len, fh) != rec.len )
+		{
+			fprintf(stderr,"error reading stream record %llu of '%s'\n", (unsigned long long int)rec.seq, file);
+			break;
+		}
 
-				if ( mode == PTOA_MACHINE )
-					printf("E\n");
-				else if ( mode == PTOA_JSON )
-					printf("\"type\": \"footer\" }\n");
-				else
-					printf("eof\n");
+		if ( p_undump_record(record, rec.len, &msg) != 0 )
+		{
+			fprintf(stderr,"error during message parsing of stream record %llu\n", (unsigned long long int)rec.seq);
+			continue;
+		}
 
-				break;
+		if ( filter != NULL && p_filter_match(filter, &rec, &msg) == 0 )
+			continue;
 
-			default:
-				fprintf(stderr, "Error: received unknown message code: %u\n", msg.msg.type);
-		}
+		p_format_msg(stdout, mode, &msg, &rec);
+		fflush(stdout);
 	}
 
-	p_undump_close(ctx);
+	if ( fh != stdin )
+		fclose(fh);
 
 	return 0;
 }
@@ -340,6 +219,17 @@ void syntax(char *prog)
 {
 	printf("Piranha v%s.%s.%s Dump file decoder, Copyright(c) 2004-2017 Pascal Gloor\n",P_VER_MA,P_VER_MI,P_VER_PL);
 	printf("syntax: %s -<m|j|H> <file>\n",prog);
+	printf("        %s -<m|j|H> [-F <filter>] -f [feed]\n",prog);
+	printf("        %s -<m|j|H> [-F <filter>] -s <file|->\n",prog);
+	printf("\n");
+	printf("-f follows the live feed of piranha (default %s),\n", FEEDFILE);
+	printf("-s reads the output of a binary stream subscriber,\n");
+	printf("the neighbor and the record seq follow the timestamp:\n");
+	printf("timestamp|seq|neighbor_ip|neighbor_as|...\n");
+	printf("\n");
+	printf("-F only prints the records matching a stream server filter:\n");
+	printf("[peer <ip>[/<len>]] [prefix <prefix>/<len>] [origin <asn>]\n");
+	printf("[community <asn>:<value>|<global>:<local1>:<local2>]\n");
 	printf("\n");
 	printf("-H for human readable output\n");
 	printf("\n");
@@ -349,197 +239,16 @@ void syntax(char *prog)
 	printf("-m for machine readable output:\n");
 	printf("timestamp|P|peer_ip|peer_as # begin of every file\n");
 	printf("timestamp|C                 # connected (Active -> Established)\n");
+	printf("timestamp|C|GR|time|R|L     # connected, graceful restart capable neighbor\n");
+	printf("                            # R peer restarted, L piranha restarted, - otherwise\n");
 	printf("timestamp|D                 # disconnected (Established -> Active)\n");
 	printf("timestamp|K                 # BGP Keepalive received\n");
 	printf("timestamp|A|network|mask|opt id|opt|opt id ...\n");
 	printf("                            # BGP Announce\n");
 	printf("timestamp|W|network|mask    # BGP Withdrawn\n");
+	printf("timestamp|R|count           # Duplicate announces not dumped\n");
+	printf("timestamp|T|afi|count|sec   # End-of-RIB, initial table received\n");
 	printf("\n");
 	
 	exit(-1);
 }
-
-void print_nexthop4(int mode, uint32_t nexthop)
-{
-	struct in_addr addr;
-	addr.s_addr = htobe32(nexthop);
-
-	switch(mode)
-	{
-		case PTOA_MACHINE:
-			printf("|NH|%u", nexthop);
-			break;
-		case PTOA_HUMAN:
-			printf(" nexthop %s", inet_ntoa(addr));
-			break;
-		case PTOA_JSON:
-			printf(", \"nexthop\": \"%s\"", inet_ntoa(addr));
-			break;
-	}
-}
-
-void print_nexthop6(int mode, uint8_t nexthop[16])
-{
-	struct in6_addr addr;
-	memcpy(addr.s6_addr, nexthop, 16);
-
-	switch(mode)
-	{
-		case PTOA_MACHINE:
-			printf("|NH|%s", p_tools_ip6str(0, &addr));
-			break;
-		case PTOA_HUMAN:
-			printf(" nexthop %s", p_tools_ip6str(0, &addr));
-			break;
-		case PTOA_JSON:
-			printf(", \"nexthop\": \"%s\"", p_tools_ip6str(0, &addr));
-			break;
-	}
-}
-
-void print_origin(int mode, uint8_t origin)
-{
-	char o = '?';
-	char oa[10];
-
-	switch(origin)
-	{
-		case BGP_ORIGIN_IGP:
-			o = 'I';
-			snprintf(oa, sizeof(oa), "IGP");
-			break;
-		case BGP_ORIGIN_EGP:
-			o = 'E';
-			snprintf(oa, sizeof(oa), "EGP");
-			break;
-		case BGP_ORIGIN_UNKN:
-			o = '?';
-			snprintf(oa, sizeof(oa), "Unknown");
-			break;
-		default:
-			o = '?';
-			snprintf(oa, sizeof(oa), "Error");
-			break;
-	}
-
-	switch(mode) {
-		case PTOA_MACHINE:
-			printf("|O|%c", o);
-			break;
-		case PTOA_HUMAN:
-			printf(" origin %s", oa);
-			break;
-		case PTOA_JSON:
-			printf(", \"origin\": \"%s\"", oa);
-			break;
-	}
-}
-
-
-void print_aspath(int mode, struct dump_announce_aspath *aspath, uint8_t len)
-{
-	int i;
-
-	switch(mode) {
-		case PTOA_MACHINE: printf("|AP|"); break;
-		case PTOA_HUMAN: printf(" aspath"); break;
-		case PTOA_JSON: printf(", \"aspath\": [ "); break;
-	}
-
-	for(i=0; i<len; i++)
-	{
-		switch(mode) {
-			case PTOA_MACHINE:
-				printf("%u", aspath->data[i]);
-				if ( i < len-1 ) printf(" ");
-				break;
-			case PTOA_HUMAN:
-				printf(" %u", aspath->data[i]);
-				break;
-			case PTOA_JSON:
-				printf("%u", aspath->data[i]);
-				if ( i < len-1 ) printf(", ");
-				break;
-		}
-	}
-
-	if ( mode == PTOA_JSON )
-		printf(" ]");
-}
-
-void print_community(int mode, struct dump_announce_community *community, uint16_t len)
-{
-	int i;
-
-	if ( mode == PTOA_MACHINE )
-		printf("|C|");
-	else if ( mode == PTOA_JSON )
-		printf(", \"community\": [ ");
-	else
-		printf(" community");
-
-	for(i=0; i<len; i++)
-	{
-		if ( mode == PTOA_MACHINE )
-		{
-			printf("%u:%u",community->data[i].asn, community->data[i].num);
-			if ( i < len-1) printf(" ");
-		}
-		else if ( mode == PTOA_JSON )
-		{
-			printf("\"%u:%u\"",community->data[i].asn, community->data[i].num);
-			if ( i < len-1) printf(", ");
-		}
-		else
-		{
-			printf(" %u:%u", community->data[i].asn, community->data[i].num);
-		}
-	}
-
-	if ( mode == PTOA_JSON )
-		printf(" ]");
-}
-
-void print_extcommunity4(int mode, struct dump_announce_extcommunity4 *com, uint16_t len)
-{
-	/* not yet implemented */
-}
-
-void print_extcommunity6(int mode, struct dump_announce_extcommunity6 *com, uint16_t len)
-{
-	/* not yet implemented */
-}
-
-void print_largecommunity(int mode, struct dump_announce_largecommunity *community, uint16_t len)
-{
-	int i;
-
-	if ( mode == PTOA_MACHINE )
-		printf("|LC|");
-	else if ( mode == PTOA_JSON )
-		printf(", \"largecommunity\": [ ");
-	else
-		printf(" largecommunity");
-
-	for(i=0; i<len; i++)
-	{
-		if ( mode == PTOA_MACHINE )
-		{
-			printf("%u:%u:%u",community->data[i].global, community->data[i].local1, community->data[i].local2);
-			if ( i < len-1) printf(" ");
-		}
-		else if ( mode == PTOA_JSON )
-		{
-			printf("\"%u:%u:%u\"",community->data[i].global, community->data[i].local1, community->data[i].local2);
-			if ( i < len-1) printf(", ");
-		}
-		else
-		{
-			printf(" %u:%u:%u", community->data[i].global, community->data[i].local1, community->data[i].local2);
-		}
-	}
-
-	if ( mode == PTOA_JSON )
-		printf(" ]");
-}
-
@@ -0,0 +1,184 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_range.h>
+
+/* neighbor_range lookups walk one bit per level, the deepest node holding *
+ * an entry on the way is the longest prefix match                         */
+
+#define RANGE_BIT(p, i) ( ( (p)[(i) / 8] >> ( 7 - (i) % 8 ) ) & 1 )
+
+static void p_range_free_node(struct range_node_t *node);
+
+struct range_t *p_range_new(void)
+{
+	return calloc(1, sizeof(struct range_t));
+}
+
+void p_range_free(struct range_t *range)
+{
+	struct range_entry_t *entry, *next;
+
+	if ( range == NULL )
+		return;
+
+	p_range_free_node(range->root[0]);
+	p_range_free_node(range->root[1]);
+
+	for(entry = range->list; entry != NULL; entry = next)
+	{
+		next = entry->next;
+		free(entry);
+	}
+
+	free(range);
+}
+
+static void p_range_free_node(struct range_node_t *node)
+{
+	if ( node == NULL )
+		return;
+
+	p_range_free_node(node->child[0]);
+	p_range_free_node(node->child[1]);
+	free(node);
+}
+
+/* parse <ip>/<len>, the host bits are cleared */
+int p_range_parse(char *str, uint8_t *af, uint8_t prefix[16], uint8_t *len)
+{
+	char ip[INET6_ADDRSTRLEN];
+	char *slash, *end;
+	long l;
+	int i;
+
+	if ( ( slash = strchr(str, '/') ) == NULL || slash - str >= sizeof(ip) )
+		return -1;
+
+	memcpy(ip, str, slash - str);
+	ip[slash - str] = '\0';
+
+	memset(prefix, 0, 16);
+
+	if ( inet_pton(AF_INET, ip, prefix) == 1 )
+		*af = 4;
+	else if ( inet_pton(AF_INET6, ip, prefix) == 1 )
+		*af = 6;
+	else
+		return -1;
+
+	l = strtol(slash + 1, &end, 10);
+	if ( *end != '\0' || end == slash + 1 || l < 0 || l > ( *af == 4 ? 32 : 128 ) )
+		return -1;
+
+	*len = l;
+
+	for(i = *len; i < 128; i++)
+		prefix[i / 8] &= ~( 0x80 >> ( i % 8 ) );
+
+	return 0;
+}
+
+/* add a range, an existing one with the same prefix is replaced */
+int p_range_add(struct range_t *range, uint8_t af, uint8_t prefix[16], uint8_t len, uint32_t as, char *key)
+{
+	struct range_node_t **node = &range->root[af == 4 ? 0 : 1];
+	struct range_entry_t *entry;
+	int i;
+
+	for(i=0; ; i++)
+	{
+		if ( *node == NULL && ( *node = calloc(1, sizeof(struct range_node_t)) ) == NULL )
+			return -1;
+
+		if ( i == len )
+			break;
+
+		node = &(*node)->child[RANGE_BIT(prefix, i)];
+	}
+
+	if ( ( entry = (*node)->entry ) == NULL )
+	{
+		if ( ( entry = calloc(1, sizeof(struct range_entry_t)) ) == NULL )
+			return -1;
+
+		entry->next = range->list;
+		range->list = entry;
+		(*node)->entry = entry;
+	}
+
+	entry->af  = af;
+	entry->len = len;
+	entry->as  = as;
+	memcpy(entry->prefix, prefix, sizeof(entry->prefix));
+	snprintf(entry->key, sizeof(entry->key), "%s", key);
+
+	return 0;
+}
+
+/* longest prefix match of an address, NULL if no range contains it */
+struct range_entry_t *p_range_lookup(struct range_t *range, uint8_t af, uint8_t *addr)
+{
+	struct range_node_t *node;
+	struct range_entry_t *best = NULL;
+	int bits = af == 4 ? 32 : 128;
+	int i;
+
+	if ( range == NULL )
+		return NULL;
+
+	node = range->root[af == 4 ? 0 : 1];
+
+	for(i=0; node != NULL; i++)
+	{
+		if ( node->entry != NULL )
+			best = node->entry;
+
+		if ( i == bits )
+			break;
+
+		node = node->child[RANGE_BIT(addr, i)];
+	}
+
+	return best;
+}
+
+/* same range with the same key in another set, for the reload diff */
+struct range_entry_t *p_range_find(struct range_t *range, struct range_entry_t *entry)
+{
+	struct range_entry_t *e;
+
+	if ( range == NULL )
+		return NULL;
+
+	for(e = range->list; e != NULL; e = e->next)
+		if ( e->af == entry->af && e->len == entry->len &&
+			memcmp(e->prefix, entry->prefix, sizeof(e->prefix)) == 0 && strcmp(e->key, entry->key) == 0 )
+			return e;
+
+	return NULL;
+}
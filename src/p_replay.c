@@ -0,0 +1,469 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_undump.h>
+#include <p_speaker.h>
+#include <p_replay.h>
+
+/* Replays piranha dump files over a BGP session: announces and withdrawns
+ * are encoded again as UPDATEs, records of the same time and attributes
+ * as one message, at the original pace or faster. Attributes not exported
+ * in the dump are not sent, AS_SETs come back as AS_SEQUENCE. */
+
+static struct replay_t replay;
+
+int main(int argc, char *argv[])
+{
+	char *dst = NULL;
+	char *src = NULL;
+	uint32_t as = 0;
+	int port = 179;
+	int opt, a;
+	double start;
+
+	replay.speedup   = 1;
+	replay.queue.buf = replay.sbuf;
+
+	while ( ( opt = getopt(argc, argv, "d:p:s:a:x:") ) != -1 )
+	{
+		switch(opt)
+		{
+			case 'd': dst            = optarg;                   break;
+			case 'p': port           = atoi(optarg);             break;
+			case 's': src            = optarg;                   break;
+			case 'a': as             = strtoul(optarg, NULL, 10); break;
+			case 'x': replay.speedup = atof(optarg);             break;
+			default:  syntax(argv[0]);
+		}
+	}
+
+	if ( optind >= argc || dst == NULL || as == 0 || replay.speedup < 0 )
+		syntax(argv[0]);
+
+	{
+		struct sockaddr_storage addr;
+
+		if ( p_replay_addr(dst, port, &addr) == -1 ||
+			( src != NULL && ( p_replay_addr(src, 0, &replay.src) == -1 || replay.src.ss_family != addr.ss_family ) ) )
+		{
+			fprintf(stderr, "invalid or mixed address families '%s' '%s'\n", dst, src ? src : "");
+			return 1;
+		}
+
+		if ( ( replay.sock = p_speaker_connect(src != NULL ? &replay.src : NULL, &addr) ) == -1 ||
+			p_speaker_open(replay.sock, addr.ss_family == AF_INET ? 4 : 6, as, 0x0a000001) == -1 ||
+			p_speaker_establish(replay.sock, 60) == -1 )
+		{
+			fprintf(stderr, "cannot establish a session with %s as AS %u\n", dst, as);
+			return 1;
+		}
+
+		/* the source address is the next hop when the dump has none */
+		if ( src == NULL )
+		{
+			socklen_t len = sizeof(replay.src);
+			getsockname(replay.sock, (struct sockaddr*)&replay.src, &len);
+		}
+	}
+
+	start = p_speaker_now();
+	replay.queue.sent = start;
+
+	for(a=optind; a<argc; a++)
+		if ( p_replay_file(argv[a]) == -1 )
+			fprintf(stderr, "error reading '%s'\n", argv[a]);
+
+	p_replay_flush();
+	p_replay_queue(NULL, 0, SPEAKER_FLUSH);
+
+	printf("%llu records, %llu updates, %llu announces, %llu withdrawns, %llu skipped, %llu bytes in %.3fs\n",
+		(unsigned long long)replay.records, (unsigned long long)replay.queue.msgs,
+		(unsigned long long)replay.announces, (unsigned long long)replay.withdrawns,
+		(unsigned long long)replay.skipped, (unsigned long long)replay.queue.bytes, p_speaker_now() - start);
+
+	/* let the collector read everything before the session goes down */
+	shutdown(replay.sock, SHUT_WR);
+	while ( recv(replay.sock, replay.sbuf, sizeof(replay.sbuf), 0) > 0 );
+	close(replay.sock);
+
+	return 0;
+}
+
+void syntax(char *prog)
+{
+	printf("Piranha v%s.%s.%s dump replay, Copyright(c) 2004-2017 Pascal Gloor\n",P_VER_MA,P_VER_MI,P_VER_PL);
+	printf("syntax: %s -d collector -a asn [-p port] [-s source] [-x speedup] <dump file> [dump file ...]\n", prog);
+	printf("\n");
+	printf("-d collector address, -p port (default 179)\n");
+	printf("-a AS of the session\n");
+	printf("-s source address, must be a neighbor of the collector\n");
+	printf("-x divides the time between the records (default 1), 0 sends as fast as possible\n");
+	printf("the files are replayed in the given order\n");
+	exit(1);
+}
+
+int p_replay_addr(char *str, int port, struct sockaddr_storage *addr)
+{
+	struct sockaddr_in  *addr4 = (struct sockaddr_in*)addr;
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6*)addr;
+
+	memset(addr, 0, sizeof(*addr));
+
+	if ( inet_pton(AF_INET, str, &addr4->sin_addr) == 1 )
+	{
+		addr4->sin_family = AF_INET;
+		addr4->sin_port   = htons(port);
+		return 0;
+	}
+
+	if ( inet_pton(AF_INET6, str, &addr6->sin6_addr) == 1 )
+	{
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port   = htons(port);
+		return 0;
+	}
+
+	return -1;
+}
+
+int p_replay_file(char *file)
+{
+	struct dump_file_ctx *ctx;
+	struct dump_full_msg fmsg;
+
+	if ( ( ctx = p_undump_open(file) ) == NULL )
+		return -1;
+
+	while ( p_undump_readmsg(ctx, &fmsg) == 0 )
+		p_replay_record(&fmsg);
+
+	p_undump_close(ctx);
+
+	return 0;
+}
+
+void p_replay_record(struct dump_full_msg *fmsg)
+{
+	uint64_t ts = fmsg->msg.ts * 1000000 + fmsg->msg.uts;
+	uint8_t attr[SPEAKER_MAXLEN];
+	uint8_t prefix[16];
+	uint32_t p;
+	int alen;
+
+	replay.records++;
+
+	switch(fmsg->msg.type)
+	{
+		case DUMP_ANNOUNCE4:
+			if ( ( alen = p_replay_attr(fmsg, attr) ) == -1 )
+				break;
+			p = htonl(fmsg->announce4.prefix);
+			memcpy(prefix, &p, 4);
+			p_replay_add(REPLAY_ANNOUNCE4, ts, attr, alen, NULL, prefix, fmsg->announce4.mask);
+			break;
+
+		case DUMP_ANNOUNCE6:
+			if ( ( alen = p_replay_attr(fmsg, attr) ) == -1 )
+				break;
+			p_replay_add(REPLAY_ANNOUNCE6, ts, attr, alen, fmsg->announce6.nexthop,
+				fmsg->announce6.prefix, fmsg->announce6.mask);
+			break;
+
+		case DUMP_WITHDRAWN4:
+			p = htonl(fmsg->withdrawn4.prefix);
+			memcpy(prefix, &p, 4);
+			p_replay_add(REPLAY_WITHDRAWN4, ts, NULL, 0, NULL, prefix, fmsg->withdrawn4.mask);
+			break;
+
+		case DUMP_WITHDRAWN6:
+			p_replay_add(REPLAY_WITHDRAWN6, ts, NULL, 0, NULL, fmsg->withdrawn6.prefix, fmsg->withdrawn6.mask);
+			break;
+
+		case DUMP_EOR:
+			p_replay_eor(fmsg->eor.afi, ts);
+			break;
+	}
+}
+
+/* path attributes of an announce, -1 if too large for one message */
+int p_replay_attr(struct dump_full_msg *fmsg, uint8_t *attr)
+{
+	uint8_t data[65536];
+	int v4 = fmsg->msg.type == DUMP_ANNOUNCE4;
+	uint8_t  origin            = v4 ? fmsg->announce4.origin            : fmsg->announce6.origin;
+	uint8_t  aspathlen         = v4 ? fmsg->announce4.aspathlen         : fmsg->announce6.aspathlen;
+	uint16_t communitylen      = v4 ? fmsg->announce4.communitylen      : fmsg->announce6.communitylen;
+	uint16_t largecommunitylen = v4 ? fmsg->announce4.largecommunitylen : fmsg->announce6.largecommunitylen;
+	uint16_t extcommunitylen   = v4 ? fmsg->announce4.extcommunitylen4  : fmsg->announce6.extcommunitylen6;
+	int alen = 0;
+	int len = 0;
+	int a;
+
+	/* origin, next hop and AS path, an empty one if not exported */
+	data[0] = origin <= 2 ? origin : 0;
+	alen += p_speaker_attr(attr + alen, 0x40, BGP_ATTR_ORIGIN, data, 1);
+
+	if ( aspathlen > 0 )
+	{
+		data[len++] = 2;
+		data[len++] = aspathlen;
+		for(a=0; a<aspathlen; a++)
+		{
+			uint32_t as = htonl(fmsg->aspath.data[a]);
+			memcpy(data + len, &as, 4);
+			len += 4;
+		}
+	}
+	alen += p_speaker_attr(attr + alen, 0x40, BGP_ATTR_AS_PATH, data, len);
+
+	if ( v4 )
+	{
+		uint32_t nexthop = htonl(fmsg->announce4.nexthop);
+
+		if ( nexthop == 0 && replay.src.ss_family == AF_INET )
+			memcpy(&nexthop, &((struct sockaddr_in*)&replay.src)->sin_addr, 4);
+
+		alen += p_speaker_attr(attr + alen, 0x40, BGP_ATTR_NEXT_HOP, &nexthop, 4);
+	}
+
+	if ( communitylen > 0 )
+	{
+		for(len=0, a=0; a<communitylen; a++)
+		{
+			uint16_t c[2];
+			c[0] = htons(fmsg->community.data[a].asn);
+			c[1] = htons(fmsg->community.data[a].num);
+			memcpy(data + len, c, 4);
+			len += 4;
+		}
+		if ( alen + len + 4 > SPEAKER_MAXLEN )
+			goto toolarge;
+		alen += p_speaker_attr(attr + alen, 0xc0, BGP_ATTR_COMMUNITY, data, len);
+	}
+
+	if ( extcommunitylen > 0 && v4 )
+	{
+		for(len=0, a=0; a<extcommunitylen; a++)
+		{
+			data[len++] = fmsg->extcommunity4.data[a].type;
+			data[len++] = fmsg->extcommunity4.data[a].subtype;
+			memcpy(data + len, fmsg->extcommunity4.data[a].value, 6);
+			len += 6;
+		}
+		if ( alen + len + 4 > SPEAKER_MAXLEN )
+			goto toolarge;
+		alen += p_speaker_attr(attr + alen, 0xc0, BGP_ATTR_EXTCOMMUNITY4, data, len);
+	}
+	else if ( extcommunitylen > 0 )
+	{
+		for(len=0, a=0; a<extcommunitylen; a++)
+		{
+			uint16_t local = htons(fmsg->extcommunity6.data[a].local);
+			data[len++] = fmsg->extcommunity6.data[a].type;
+			data[len++] = fmsg->extcommunity6.data[a].subtype;
+			memcpy(data + len, fmsg->extcommunity6.data[a].global, 16);
+			memcpy(data + len + 16, &local, 2);
+			len += 18;
+		}
+		if ( alen + len + 4 > SPEAKER_MAXLEN )
+			goto toolarge;
+		alen += p_speaker_attr(attr + alen, 0xc0, BGP_ATTR_EXTCOMMUNITY6, data, len);
+	}
+
+	if ( largecommunitylen > 0 )
+	{
+		for(len=0, a=0; a<largecommunitylen; a++)
+		{
+			uint32_t c[3];
+			c[0] = htonl(fmsg->largecommunity.data[a].global);
+			c[1] = htonl(fmsg->largecommunity.data[a].local1);
+			c[2] = htonl(fmsg->largecommunity.data[a].local2);
+			memcpy(data + len, c, 12);
+			len += 12;
+		}
+		if ( alen + len + 4 > SPEAKER_MAXLEN )
+			goto toolarge;
+		alen += p_speaker_attr(attr + alen, 0xc0, BGP_ATTR_LARGECOMMUNITY, data, len);
+	}
+
+	/* room for at least one prefix in an MP_REACH_NLRI */
+	if ( BGP_HEADER_LEN + 4 + alen + 25 + 17 <= SPEAKER_MAXLEN )
+		return alen;
+
+	toolarge:
+	replay.skipped++;
+	return -1;
+}
+
+/* append a prefix to the pending UPDATE, sent first if it does not match */
+void p_replay_add(int kind, uint64_t ts, uint8_t *attr, int alen, uint8_t *nexthop6, uint8_t *prefix, uint8_t plen)
+{
+	struct replay_update_t *u = &replay.update;
+	int overhead = BGP_HEADER_LEN + 4 + ( kind == REPLAY_ANNOUNCE6 ? 25 : kind == REPLAY_WITHDRAWN6 ? 7 : 0 );
+
+	if ( u->kind != kind || u->ts != ts || u->alen != alen || ( alen > 0 && memcmp(u->attr, attr, alen) != 0 ) ||
+		( nexthop6 != NULL && memcmp(u->nexthop6, nexthop6, 16) != 0 ) ||
+		overhead + u->alen + u->nlen + 17 > SPEAKER_MAXLEN )
+	{
+		p_replay_flush();
+
+		u->kind = kind;
+		u->ts   = ts;
+		u->alen = alen;
+		u->nlen = 0;
+		if ( alen > 0 )
+			memcpy(u->attr, attr, alen);
+		if ( nexthop6 != NULL )
+			memcpy(u->nexthop6, nexthop6, 16);
+	}
+
+	u->nlen += p_speaker_prefix(u->nlri + u->nlen, prefix, plen);
+
+	if ( kind == REPLAY_ANNOUNCE4 || kind == REPLAY_ANNOUNCE6 )
+		replay.announces++;
+	else
+		replay.withdrawns++;
+}
+
+/* End-of-RIB marks the end of the initial table */
+void p_replay_eor(uint16_t afi, uint64_t ts)
+{
+	uint8_t msg[SPEAKER_MAXLEN];
+	uint8_t attr[8];
+	uint8_t mp[3] = { 0, 2, 1 };
+	int len;
+
+	p_replay_flush();
+	p_replay_wait(ts);
+
+	if ( afi == 1 )
+		len = p_speaker_update(msg, NULL, 0, NULL, 0, NULL, 0);
+	else
+		len = p_speaker_update(msg, NULL, 0, attr, p_speaker_attr(attr, 0x80, BGP_ATTR_MP_UNREACH_NLRI, mp, 3), NULL, 0);
+
+	p_replay_queue(msg, len, 0);
+}
+
+/* send the pending UPDATE when its time has come */
+void p_replay_flush()
+{
+	struct replay_update_t *u = &replay.update;
+	uint8_t msg[SPEAKER_MAXLEN];
+	uint8_t data[SPEAKER_MAXLEN];
+	int len = 0;
+
+	if ( u->kind == REPLAY_NONE || u->nlen == 0 )
+		return;
+
+	p_replay_wait(u->ts);
+
+	data[0] = 0;
+	data[1] = 2;
+	data[2] = 1;
+
+	switch(u->kind)
+	{
+		case REPLAY_ANNOUNCE4:
+			len = p_speaker_update(msg, NULL, 0, u->attr, u->alen, u->nlri, u->nlen);
+			break;
+
+		case REPLAY_WITHDRAWN4:
+			len = p_speaker_update(msg, u->nlri, u->nlen, NULL, 0, NULL, 0);
+			break;
+
+		case REPLAY_ANNOUNCE6:
+			data[3] = 16;
+			memcpy(data + 4, u->nexthop6, 16);
+			data[20] = 0;
+			memcpy(data + 21, u->nlri, u->nlen);
+			u->alen += p_speaker_attr(u->attr + u->alen, 0x80, BGP_ATTR_MP_REACH_NLRI, data, 21 + u->nlen);
+			len = p_speaker_update(msg, NULL, 0, u->attr, u->alen, NULL, 0);
+			break;
+
+		case REPLAY_WITHDRAWN6:
+			memcpy(data + 3, u->nlri, u->nlen);
+			u->alen = p_speaker_attr(u->attr, 0x80, BGP_ATTR_MP_UNREACH_NLRI, data, 3 + u->nlen);
+			len = p_speaker_update(msg, NULL, 0, u->attr, u->alen, NULL, 0);
+			break;
+	}
+
+	p_replay_queue(msg, len, 0);
+
+	u->kind = REPLAY_NONE;
+	u->nlen = 0;
+}
+
+/* sleep until the record time scaled by the speedup, keeping the session up */
+void p_replay_wait(uint64_t ts)
+{
+	double target;
+
+	if ( replay.speedup == 0 )
+		return;
+
+	if ( replay.first == 0 )
+	{
+		replay.first = ts;
+		replay.start = p_speaker_now();
+		return;
+	}
+
+	if ( ts <= replay.first ||
+		( target = replay.start + ( ts - replay.first ) / 1e6 / replay.speedup ) <= p_speaker_now() )
+		return;
+
+	p_replay_queue(NULL, 0, SPEAKER_FLUSH);
+
+	while ( p_speaker_now() < target )
+	{
+		double left = target - p_speaker_now();
+
+		usleep(left > 1 ? 1000000 : left * 1000000);
+
+		if ( p_speaker_drain(replay.sock) == -1 )
+		{
+			fprintf(stderr, "session closed by the collector\n");
+			exit(1);
+		}
+
+		if ( p_speaker_now() - replay.queue.sent > SPEAKER_HOLD / 3 )
+			p_replay_queue(NULL, 0, SPEAKER_KEEPALIVE);
+	}
+}
+
+/* batch the messages, exits if the collector closed the session */
+void p_replay_queue(uint8_t *msg, int len, int flush)
+{
+	if ( p_speaker_queue(replay.sock, &replay.queue, msg, len, flush) == -1 )
+	{
+		fprintf(stderr, "session closed by the collector\n");
+		exit(1);
+	}
+}
@@ -0,0 +1,308 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <p_defs.h>
+#include <p_attr.h>
+#include <p_mem.h>
+#include <p_rib.h>
+
+/* The rib keeps the routes currently held for a peer, a prefix points
+ * to its interned path attributes (see p_attr.c). It is only used from
+ * the peer thread so it needs no locking. The buckets and the entries
+ * are mapped with p_mem_alloc(), entries are carved from arenas doubling
+ * up to a huge page and withdrawn ones are reused. */
+
+static uint32_t p_rib_hash(uint8_t af, uint8_t *prefix, uint8_t mask)
+{
+	uint32_t w[4];
+	uint32_t hash;
+
+	memcpy(w, prefix, sizeof(w));
+
+	hash  = w[0] * 2654435761u;
+	hash ^= w[1] * 2246822519u;
+	hash ^= w[2] * 3266489917u;
+	hash ^= w[3] * 668265263u;
+	hash ^= ( (uint32_t)af << 8 | mask ) * 374761393u;
+	hash ^= hash >> 15;
+
+	return hash;
+}
+
+/* double the number of buckets */
+static void p_rib_grow(struct rib_t *rib)
+{
+	struct rib_entry_t **bucket;
+	uint32_t size = rib->size * 2;
+	uint32_t i;
+
+	if ( ( bucket = p_mem_alloc(size * sizeof(struct rib_entry_t*)) ) == NULL )
+		return;
+
+	for(i=0; i<rib->size; i++)
+	{
+		struct rib_entry_t *entry = rib->bucket[i];
+		while(entry != NULL)
+		{
+			struct rib_entry_t *next = entry->next;
+			uint32_t b = p_rib_hash(entry->af, entry->prefix, entry->mask) % size;
+			entry->next = bucket[b];
+			bucket[b]   = entry;
+			entry = next;
+		}
+	}
+
+	p_mem_free(rib->bucket, rib->size * sizeof(struct rib_entry_t*));
+	rib->bucket = bucket;
+	rib->size   = size;
+}
+
+/* a withdrawn entry or a new one from the arena */
+static struct rib_entry_t *p_rib_entry(struct rib_t *rib)
+{
+	struct rib_entry_t *entry;
+
+	if ( ( entry = rib->free ) != NULL )
+	{
+		rib->free = entry->next;
+		return entry;
+	}
+
+	if ( rib->chunk == NULL || rib->used + sizeof(struct rib_entry_t) > rib->chunk->len )
+	{
+		struct rib_chunk_t *chunk;
+		size_t len = rib->chunk == NULL ? RIB_CHUNK_MIN : rib->chunk->len * 2;
+
+		if ( len > HUGE_PAGE )
+			len = HUGE_PAGE;
+
+		if ( ( chunk = p_mem_alloc(len) ) == NULL )
+			return NULL;
+
+		chunk->next = rib->chunk;
+		chunk->len  = p_mem_round(len);
+		rib->chunk  = chunk;
+		rib->used   = sizeof(struct rib_chunk_t);
+	}
+
+	entry = (struct rib_entry_t*)((char*)rib->chunk + rib->used);
+	rib->used += sizeof(struct rib_entry_t);
+
+	return entry;
+}
+
+static struct rib_entry_t **p_rib_find(struct rib_t *rib, uint8_t af, uint8_t *prefix, uint8_t mask)
+{
+	struct rib_entry_t **entry;
+
+	entry = &rib->bucket[p_rib_hash(af, prefix, mask) % rib->size];
+
+	while(*entry != NULL)
+	{
+		if ( (*entry)->af == af && (*entry)->mask == mask && memcmp((*entry)->prefix, prefix, 16) == 0 )
+			break;
+		entry = &(*entry)->next;
+	}
+
+	return entry;
+}
+
+/* store a route, returns 1 if the prefix is already held with the same  *
+ * attributes, a stale one is not a duplicate, the dump readers purge it */
+static int p_rib_announce(struct rib_t *rib, uint8_t af, uint8_t *prefix, uint8_t mask, struct attr_t *attr)
+{
+	struct rib_entry_t **entry = p_rib_find(rib, af, prefix, mask);
+
+	if ( *entry != NULL )
+	{
+		int stale = (*entry)->stale;
+
+		(*entry)->stale = 0;
+
+		if ( (*entry)->attr == attr )
+			return ! stale;
+
+		p_attr_ref(attr);
+		p_attr_release((*entry)->attr);
+		(*entry)->attr = attr;
+		return 0;
+	}
+
+	if ( ( *entry = p_rib_entry(rib) ) == NULL )
+		return 0;
+
+	p_attr_ref(attr);
+	(*entry)->next = NULL;
+	(*entry)->attr = attr;
+	(*entry)->af    = af;
+	(*entry)->mask  = mask;
+	(*entry)->stale = 0;
+	memcpy((*entry)->prefix, prefix, 16);
+
+	if ( ++rib->count > rib->size )
+		p_rib_grow(rib);
+
+	return 0;
+}
+
+static void p_rib_withdrawn(struct rib_t *rib, uint8_t af, uint8_t *prefix, uint8_t mask)
+{
+	struct rib_entry_t **entry = p_rib_find(rib, af, prefix, mask);
+	struct rib_entry_t  *old   = *entry;
+
+	if ( old == NULL ) { return; }
+
+	*entry = old->next;
+	p_attr_release(old->attr);
+	old->next = rib->free;
+	rib->free = old;
+	rib->count--;
+}
+
+/* BoRR, the routes of the family are stale until announced again */
+void p_rib_stale(struct rib_t *rib, uint8_t af)
+{
+	uint32_t i;
+
+	for(i=0; i<rib->size; i++)
+	{
+		struct rib_entry_t *entry;
+		for(entry = rib->bucket[i]; entry != NULL; entry = entry->next)
+		{
+			if ( entry->af == af )
+				entry->stale = 1;
+		}
+	}
+}
+
+/* EoRR, the routes still stale are withdrawn, returns how many */
+uint32_t p_rib_purge(struct rib_t *rib, uint8_t af)
+{
+	uint32_t count = 0;
+	uint32_t i;
+
+	for(i=0; i<rib->size; i++)
+	{
+		struct rib_entry_t **entry = &rib->bucket[i];
+		while(*entry != NULL)
+		{
+			struct rib_entry_t *old = *entry;
+
+			if ( old->af != af || ! old->stale )
+			{
+				entry = &old->next;
+				continue;
+			}
+
+			*entry = old->next;
+			p_attr_release(old->attr);
+			old->next = rib->free;
+			rib->free = old;
+			rib->count--;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+struct rib_t *p_rib_new(void)
+{
+	struct rib_t *rib;
+
+	if ( ( rib = malloc(sizeof(struct rib_t)) ) == NULL )
+		return NULL;
+
+	if ( ( rib->bucket = p_mem_alloc(RIB_INITIAL_SIZE * sizeof(struct rib_entry_t*)) ) == NULL )
+	{
+		free(rib);
+		return NULL;
+	}
+
+	rib->size  = RIB_INITIAL_SIZE;
+	rib->count = 0;
+	rib->free  = NULL;
+	rib->chunk = NULL;
+	rib->used  = 0;
+
+	return rib;
+}
+
+void p_rib_free(struct rib_t *rib)
+{
+	uint32_t i;
+
+	if ( rib == NULL ) { return; }
+
+	for(i=0; i<rib->size; i++)
+	{
+		struct rib_entry_t *entry = rib->bucket[i];
+		while(entry != NULL)
+		{
+			p_attr_release(entry->attr);
+			entry = entry->next;
+		}
+	}
+
+	while ( rib->chunk != NULL )
+	{
+		struct rib_chunk_t *next = rib->chunk->next;
+		p_mem_free(rib->chunk, rib->chunk->len);
+		rib->chunk = next;
+	}
+
+	p_mem_free(rib->bucket, rib->size * sizeof(struct rib_entry_t*));
+	free(rib);
+}
+
+int p_rib_announce4(struct rib_t *rib, uint32_t prefix, uint8_t mask, struct attr_t *attr)
+{
+	uint8_t key[16];
+
+	memset(key, 0, sizeof(key));
+	prefix = htobe32(prefix);
+	memcpy(key, &prefix, sizeof(prefix));
+
+	return p_rib_announce(rib, 4, key, mask, attr);
+}
+
+int p_rib_announce6(struct rib_t *rib, uint8_t prefix[16], uint8_t mask, struct attr_t *attr)
+{
+	return p_rib_announce(rib, 6, prefix, mask, attr);
+}
+
+void p_rib_withdrawn4(struct rib_t *rib, uint32_t prefix, uint8_t mask)
+{
+	uint8_t key[16];
+
+	memset(key, 0, sizeof(key));
+	prefix = htobe32(prefix);
+	memcpy(key, &prefix, sizeof(prefix));
+
+	p_rib_withdrawn(rib, 4, key, mask);
+}
+
+void p_rib_withdrawn6(struct rib_t *rib, uint8_t prefix[16], uint8_t mask)
+{
+	p_rib_withdrawn(rib, 6, prefix, mask);
+}
@@ -30,316 +30,469 @@
 #include <errno.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <time.h>
+#ifdef OS_LINUX
+#include <linux/filter.h>
+#endif
 
 #include <p_defs.h>
 #include <p_socket.h>
+#include <p_log.h>
 #include <p_tools.h>
 
 
-/*  init the listening socket */
+/*  init the listening sockets, listen_shards per address family */
 int p_socket_start(struct config_t *config, struct peer_t *peer)
 {
-	#ifdef OS_LINUX
-	int peerid;
-	#endif
-	struct timeval timeout;
+	int shard;
 
-	timeout.tv_sec = 0;
-	timeout.tv_usec = 100000;
+	for(shard=0; shard<config->shards; shard++)
+	{
+		if ( config->ip4.enabled && p_socket_listen(config, 4, shard) == -1 )
+			return -1;
 
-	if ( config->ip4.enabled )
+		if ( config->ip6.enabled && p_socket_listen(config, 6, shard) == -1 )
+			return -1;
+	}
+
+	if ( p_socket_keys(config, peer) == -1 )
+		return -1;
+
+	for(shard=0; shard<config->shards; shard++)
 	{
-		#ifdef DEBUG
-		printf("DEBUG: setting up IPv4 listening socket\n");
-		#endif
-	
-		if ( config->ip4.sock > 0 )
+		if ( config->ip4.enabled && listen(config->ip4.sock[shard], 10) == -1 )
 		{
 			#ifdef DEBUG
-			printf("DEBUG: socket4 still open, closing\n");
+			printf("DEBUG: failed to listen() socket4 shard %i\n", shard);
 			#endif
-			close(config->ip4.sock);
+			return -1;
 		}
-	
-		if ( ( config->ip4.sock = socket(PF_INET, SOCK_STREAM, 0) ) == -1 )
+
+		if ( config->ip6.enabled && listen(config->ip6.sock[shard], 10) == -1 )
 		{
 			#ifdef DEBUG
-			printf("DEBUG: failed to init socket4\n");
+			printf("DEBUG: failed to listen() socket6 shard %i\n", shard);
 			#endif
 			return -1;
 		}
-	
+	}
+	#ifdef DEBUG
+	printf("DEBUG: listen() ok\n");
+	#endif
+
+	return 0;
+}
+
+/* set the TCP MD5 keys of the neighbors and ranges on the listening sockets */
+int p_socket_keys(struct config_t *config, struct peer_t *peer)
+{
+	// TCP MD5 currently only supported on Linux
+	#ifdef OS_LINUX
+	int peerid;
+
+	for(peerid=0; peerid<MAX_PEERS; peerid++)
+	{
+		if ( peer[peerid].key[0] != '\0' && p_socket_md5(config, peer, peerid) == -1 )
+			return -1;
+	}
+	#endif
+
+	if ( config->range != NULL )
+	{
+		struct range_entry_t *range;
+
+		for(range = config->range->list; range != NULL; range = range->next)
+			if ( range->key[0] != '\0' && p_socket_md5_range(config, range, range->key) == -1 )
+				return -1;
+	}
+
+	return 0;
+}
+
+/* create and bind one listening socket, SO_REUSEPORT puts the shards *
+ * and the sockets of other processes on the same port in one group   */
+int p_socket_listen(struct config_t *config, int af, int shard)
+{
+	int *sock = af == 4 ? &config->ip4.sock[shard] : &config->ip6.sock[shard];
+	struct timeval timeout;
+
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 100000;
+
+	#ifdef DEBUG
+	printf("DEBUG: setting up IPv%i listening socket shard %i\n", af, shard);
+	#endif
+
+	if ( *sock > 0 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: socket() ok\n"); }
+		printf("DEBUG: socket%i still open, closing\n", af);
 		#endif
-	
-		if ( setsockopt(config->ip4.sock, SOL_SOCKET, SO_REUSEADDR, "1", sizeof(int)) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() SO_REUSEADDR\n");
-			#endif
-			return -1;
-		}
+		close(*sock);
+	}
+
+	if ( ( *sock = socket(af == 4 ? PF_INET : PF_INET6, SOCK_STREAM, 0) ) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (SO_REUSEADDR) ok\n"); }
+		printf("DEBUG: failed to init socket%i\n", af);
 		#endif
-	
-		if ( ( setsockopt(config->ip4.sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) ) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() SO_SNDTIMEO\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+	#ifdef DEBUG
+	else { printf("DEBUG: socket() ok\n"); }
+	#endif
+
+	if ( af == 6 && setsockopt(*sock, IPPROTO_IPV6, IPV6_V6ONLY, "1", sizeof(int)) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (SO_SNDTIMEO) ok\n"); }
+		printf("DEBUG: failed to setsockopt() IPV6_V6ONLY\n");
 		#endif
-	
-		if ( ( setsockopt(config->ip4.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() SO_RCVTIMEO\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+
+	if ( setsockopt(*sock, SOL_SOCKET, SO_REUSEADDR, "1", sizeof(int)) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (SO_RCVTIMEO) ok\n"); }
+		printf("DEBUG: failed to setsockopt() SO_REUSEADDR\n");
 		#endif
-	
-		if ( fcntl(config->ip4.sock, F_SETFL, O_NONBLOCK) == -1 )
+		return -1;
+	}
+	#ifdef DEBUG
+	else { printf("DEBUG: setsockopt() (SO_REUSEADDR) ok\n"); }
+	#endif
+
+	if ( config->reuseport != REUSEPORT_OFF || config->shards > 1 )
+	{
+		#ifdef SO_REUSEPORT
+		int on = 1;
+		if ( setsockopt(*sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1 )
 		{
 			#ifdef DEBUG
-			printf("DEBUG: failed to fcntl() O_NONBLOCK\n");
+			printf("DEBUG: failed to setsockopt() SO_REUSEPORT\n");
 			#endif
 			return -1;
 		}
 		#ifdef DEBUG
-		else { printf("DEBUG: fcntl() (O_NONBLOCK) ok\n"); }
+		else { printf("DEBUG: setsockopt() (SO_REUSEPORT) ok\n"); }
 		#endif
-	
-		if ( bind(config->ip4.sock, (struct sockaddr*)&config->ip4.listen, sizeof(struct sockaddr_in)) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to bind socket\n");
-			#endif
-			return -1;
-		}
+		#else
 		#ifdef DEBUG
-		else { printf("DEBUG: bind() ok\n"); }
+		printf("DEBUG: SO_REUSEPORT not supported\n");
+		#endif
+		return -1;
 		#endif
 	}
 
-	if ( config->ip6.enabled )
+	if ( ( setsockopt(*sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) ) == -1 )
 	{
 		#ifdef DEBUG
-		printf("DEBUG: setting up IPv6 listening socket\n");
+		printf("DEBUG: failed to setsockopt() SO_SNDTIMEO\n");
 		#endif
-	
-		if ( config->ip6.sock > 0 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: socket4 still open, closing\n");
-			#endif
-			close(config->ip6.sock);
-		}
-	
-		if ( ( config->ip6.sock = socket(PF_INET6, SOCK_STREAM, 0) ) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to init socket4\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+	#ifdef DEBUG
+	else { printf("DEBUG: setsockopt() (SO_SNDTIMEO) ok\n"); }
+	#endif
+
+	if ( ( setsockopt(*sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: socket() ok\n"); }
+		printf("DEBUG: failed to setsockopt() SO_RCVTIMEO\n");
 		#endif
+		return -1;
+	}
+	#ifdef DEBUG
+	else { printf("DEBUG: setsockopt() (SO_RCVTIMEO) ok\n"); }
+	#endif
 
-		if ( setsockopt(config->ip6.sock, IPPROTO_IPV6, IPV6_V6ONLY, "1", sizeof(int)) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() IPV6_V6ONLY\n");
-			#endif
-			return -1;
-		}
+	/* inherited by the sessions, the window scale is chosen from it on accept */
+	if ( config->tcp.rcvbuf != TCP_UNSET && setsockopt(*sock, SOL_SOCKET, SO_RCVBUF, &config->tcp.rcvbuf, sizeof(int)) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (IPV6_V6ONLY) ok\n"); }
+		printf("DEBUG: failed to setsockopt() SO_RCVBUF\n");
 		#endif
-	
-		if ( setsockopt(config->ip6.sock, SOL_SOCKET, SO_REUSEADDR, "1", sizeof(int)) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() SO_REUSEADDR\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+
+	if ( config->tcp.sndbuf != TCP_UNSET && setsockopt(*sock, SOL_SOCKET, SO_SNDBUF, &config->tcp.sndbuf, sizeof(int)) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (SO_REUSEADDR) ok\n"); }
+		printf("DEBUG: failed to setsockopt() SO_SNDBUF\n");
 		#endif
-	
-		if ( ( setsockopt(config->ip6.sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) ) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() SO_SNDTIMEO\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+
+	if ( fcntl(*sock, F_SETFL, O_NONBLOCK) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (SO_SNDTIMEO) ok\n"); }
+		printf("DEBUG: failed to fcntl() O_NONBLOCK\n");
 		#endif
-	
-		if ( ( setsockopt(config->ip6.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to setsockopt() SO_RCVTIMEO\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+	#ifdef DEBUG
+	else { printf("DEBUG: fcntl() (O_NONBLOCK) ok\n"); }
+	#endif
+
+	if ( ( af == 4 && bind(*sock, (struct sockaddr*)&config->ip4.listen, sizeof(struct sockaddr_in)) == -1 ) ||
+		( af == 6 && bind(*sock, (struct sockaddr*)&config->ip6.listen, sizeof(struct sockaddr_in6)) == -1 ) )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: setsockopt() (SO_RCVTIMEO) ok\n"); }
+		printf("DEBUG: failed to bind socket\n");
 		#endif
-	
-		if ( fcntl(config->ip6.sock, F_SETFL, O_NONBLOCK) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to fcntl() O_NONBLOCK\n");
-			#endif
-			return -1;
-		}
+		return -1;
+	}
+	#ifdef DEBUG
+	else { printf("DEBUG: bind() ok\n"); }
+	#endif
+
+	if ( config->reuseport == REUSEPORT_SOURCE && p_socket_steer(*sock, af, config->group ? config->group : config->shards) == -1 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: fcntl() (O_NONBLOCK) ok\n"); }
+		printf("DEBUG: failed to attach the reuseport program\n");
 		#endif
-	
-		if ( bind(config->ip6.sock, (struct sockaddr*)&config->ip6.listen, sizeof(struct sockaddr_in6)) == -1 )
+		return -1;
+	}
+
+	return 0;
+}
+
+/* attach a classic BPF program to the reuseport group which selects   *
+ * the socket by the source address, the IPv4 address or the xor of   *
+ * the four IPv6 address words modulo the group size. An index beyond  *
+ * the sockets listening falls back to the kernel hash.                */
+int p_socket_steer(int sock, int af, uint16_t group)
+{
+	#if defined(OS_LINUX) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	struct sock_filter code4[] = {
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_NET_OFF + 12),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   group),
+		BPF_STMT(BPF_RET | BPF_A,             0),
+	};
+	struct sock_filter code6[] = {
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_NET_OFF + 8),
+		BPF_STMT(BPF_MISC | BPF_TAX,          0),
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_NET_OFF + 12),
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X,   0),
+		BPF_STMT(BPF_MISC | BPF_TAX,          0),
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_NET_OFF + 16),
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X,   0),
+		BPF_STMT(BPF_MISC | BPF_TAX,          0),
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_NET_OFF + 20),
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X,   0),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   group),
+		BPF_STMT(BPF_RET | BPF_A,             0),
+	};
+	struct sock_fprog prog;
+
+	prog.filter = af == 4 ? code4 : code6;
+	prog.len    = af == 4 ? sizeof(code4)/sizeof(code4[0]) : sizeof(code6)/sizeof(code6[0]);
+
+	return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1 ? -1 : 0;
+	#else
+	return -1;
+	#endif
+}
+
+/* check for new peers on a shard */
+int p_socket_accept(struct config_t *config, int shard)
+{
+	int sock;
+	struct sockaddr_in sockaddr;
+	struct sockaddr_in6 sockaddr6;
+	unsigned int addrlen = sizeof(sockaddr);
+	unsigned int addrlen6 = sizeof(sockaddr6);
+
+	if ( ! config->ip4.enabled || ( sock = accept(config->ip4.sock[shard], (struct sockaddr*)&sockaddr, &addrlen) ) == -1 )
+	{
+		if ( ! config->ip6.enabled || ( sock = accept(config->ip6.sock[shard], (struct sockaddr*)&sockaddr6, &addrlen6) ) == -1 )
 		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to bind socket\n");
-			#endif
 			return -1;
 		}
-		#ifdef DEBUG
-		else { printf("DEBUG: bind() ok\n"); }
-		#endif
 	}
+	return sock;
+}
 
+/* one tcp_* option of a session, the neighbor value over the global one */
+static void p_socket_opt(struct peer_t *peer, int id, int sock, int level, int name, int global, int local, char *opt)
+{
+	char logline[100 + INET6_ADDRSTRLEN];
+	int val = local != TCP_UNSET ? local : global;
 
-	// TCP MD5 currently only supported on Linux
-	#ifdef OS_LINUX
-	for(peerid=0; peerid<MAX_PEERS; peerid++)
+	if ( val == TCP_UNSET || setsockopt(sock, level, name, &val, sizeof(val)) == 0 )
+		return;
+
+	snprintf(logline, sizeof(logline), "%s %s %i failed (%s)\n",
+		peer[id].af == 4 ? p_tools_ip4str(id, &peer[id].ip4) : p_tools_ip6str(id, &peer[id].ip6),
+		opt, val, strerror(errno));
+	p_log_add(time(NULL), logline);
+}
+
+/* tcp_* options of an accepted session, unset ones keep the kernel default */
+void p_socket_tune(struct config_t *config, struct peer_t *peer, int id, int sock)
+{
+	struct tcpopt_t *g = &config->tcp;
+	struct tcpopt_t *n = &peer[id].tcp;
+
+	p_socket_opt(peer, id, sock, SOL_SOCKET,  SO_RCVBUF,   g->rcvbuf,  n->rcvbuf,  "tcp_rcvbuf");
+	p_socket_opt(peer, id, sock, SOL_SOCKET,  SO_SNDBUF,   g->sndbuf,  n->sndbuf,  "tcp_sndbuf");
+	p_socket_opt(peer, id, sock, IPPROTO_TCP, TCP_NODELAY, g->nodelay, n->nodelay, "tcp_nodelay");
+	#ifdef SO_BUSY_POLL
+	p_socket_opt(peer, id, sock, SOL_SOCKET,  SO_BUSY_POLL, g->busypoll, n->busypoll, "tcp_busy_poll");
+	#endif
+	#ifdef TCP_USER_TIMEOUT
+	p_socket_opt(peer, id, sock, IPPROTO_TCP, TCP_USER_TIMEOUT, g->usertimeout, n->usertimeout, "tcp_user_timeout");
+	#endif
+
+	/* probes only with an idle time, interval and count default to the kernel ones */
+	if ( ( n->keepidle != TCP_UNSET ? n->keepidle : g->keepidle ) > 0 )
 	{
-		if ( peer[peerid].key[0] != '\0' )
-		{
-			int r;
-			struct tcp_md5sig md5;
-			memset(&md5, 0, sizeof(md5));
+		p_socket_opt(peer, id, sock, SOL_SOCKET,  SO_KEEPALIVE,  1, TCP_UNSET, "tcp_keepalive");
+		#ifdef TCP_KEEPIDLE
+		p_socket_opt(peer, id, sock, IPPROTO_TCP, TCP_KEEPIDLE,  g->keepidle,  n->keepidle,  "tcp_keepalive idle");
+		#endif
+		#ifdef TCP_KEEPINTVL
+		p_socket_opt(peer, id, sock, IPPROTO_TCP, TCP_KEEPINTVL, g->keepintvl, n->keepintvl, "tcp_keepalive interval");
+		#endif
+		#ifdef TCP_KEEPCNT
+		p_socket_opt(peer, id, sock, IPPROTO_TCP, TCP_KEEPCNT,   g->keepcnt,   n->keepcnt,   "tcp_keepalive count");
+		#endif
+	}
+}
 
-			if ( peer[peerid].af == 4 )
-			{
-				struct sockaddr_in  paddr;
-				memset(&paddr, 0, sizeof(paddr));
-				paddr.sin_family = AF_INET;
-				memcpy(&paddr.sin_addr,   &peer[peerid].ip4, sizeof(peer[peerid].ip4));
-				memcpy(&md5.tcpm_addr, &paddr, sizeof(paddr));
+/* set the TCP MD5 key of a neighbor on the listening sockets and on its *
+ * session if connected, an empty key removes it                         */
+int p_socket_md5(struct config_t *config, struct peer_t *peer, int id)
+{
+	#ifdef OS_LINUX
+	int r, shard;
+	struct tcp_md5sig md5;
+	memset(&md5, 0, sizeof(md5));
 
-			}
-			else if ( peer[peerid].af == 6 )
-			{
-				struct sockaddr_in6 paddr6;
-				memset(&paddr6, 0, sizeof(paddr6));
-				paddr6.sin6_family = AF_INET6;
-				memcpy(&paddr6.sin6_addr,   &peer[peerid].ip6, sizeof(peer[peerid].ip6));
-				memcpy(&md5.tcpm_addr, &paddr6, sizeof(paddr6));
-			}
+	if ( peer[id].af == 4 )
+	{
+		struct sockaddr_in  paddr;
+		memset(&paddr, 0, sizeof(paddr));
+		paddr.sin_family = AF_INET;
+		memcpy(&paddr.sin_addr,   &peer[id].ip4, sizeof(peer[id].ip4));
+		memcpy(&md5.tcpm_addr, &paddr, sizeof(paddr));
 
-			memcpy(&md5.tcpm_key, peer[peerid].key, strlen(peer[peerid].key));
-			md5.tcpm_keylen = strlen(peer[peerid].key);
+	}
+	else if ( peer[id].af == 6 )
+	{
+		struct sockaddr_in6 paddr6;
+		memset(&paddr6, 0, sizeof(paddr6));
+		paddr6.sin6_family = AF_INET6;
+		memcpy(&paddr6.sin6_addr,   &peer[id].ip6, sizeof(peer[id].ip6));
+		memcpy(&md5.tcpm_addr, &paddr6, sizeof(paddr6));
+	}
 
-			if ( peer[peerid].af == 4 && config->ip4.enabled )
-			{
+	memcpy(&md5.tcpm_key, peer[id].key, strlen(peer[id].key));
+	md5.tcpm_keylen = strlen(peer[id].key);
 
-				#ifdef DEBUG
-				printf("md5 key %s len %i addr %s\n",
-					md5.tcpm_key,
-					md5.tcpm_keylen,
-					p_tools_ip4str(peerid, &peer[peerid].ip4));
-				#endif
+	if ( peer[id].af == 4 && config->ip4.enabled )
+	{
 
-				if ( ( r = setsockopt(config->ip4.sock, IPPROTO_TCP, TCP_MD5SIG, &md5, sizeof md5)) != 0 )
-				{
-					#ifdef DEBUG
-					printf("Activating MD5SIG failed: '%s'\n", strerror(errno));
-					#endif
-					return -1;
-				}
-			}
-			else if ( peer[peerid].af == 6 && config->ip6.enabled )
-			{
+		#ifdef DEBUG
+		printf("md5 key %s len %i addr %s\n",
+			md5.tcpm_key,
+			md5.tcpm_keylen,
+			p_tools_ip4str(id, &peer[id].ip4));
+		#endif
 
+		for(shard=0; shard<config->shards; shard++)
+		{
+			if ( ( r = setsockopt(config->ip4.sock[shard], IPPROTO_TCP, TCP_MD5SIG, &md5, sizeof md5)) != 0 )
+			{
 				#ifdef DEBUG
-				printf("md5 key %s len %i addr %s\n",
-					md5.tcpm_key,
-					md5.tcpm_keylen,
-					p_tools_ip6str(peerid, &peer[peerid].ip6));
+				printf("Activating MD5SIG failed: '%s'\n", strerror(errno));
 				#endif
-
-				if ( ( r = setsockopt(config->ip6.sock, IPPROTO_TCP, TCP_MD5SIG, &md5, sizeof md5)) != 0 )
-				{
-					#ifdef DEBUG
-					printf("Activating MD5SIG failed: '%s'\n", strerror(errno));
-					#endif
-					return -1;
-				}
+				return -1;
 			}
 		}
 	}
-	#endif
-
-	if ( config->ip4.enabled )
+	else if ( peer[id].af == 6 && config->ip6.enabled )
 	{
-		if ( listen(config->ip4.sock, 10) == -1 )
-		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to listen() socket\n");
-			#endif
-			return -1;
-		}
+
 		#ifdef DEBUG
-		else { printf("DEBUG: listen() ok\n"); }
+		printf("md5 key %s len %i addr %s\n",
+			md5.tcpm_key,
+			md5.tcpm_keylen,
+			p_tools_ip6str(id, &peer[id].ip6));
 		#endif
-	}
 
-	if ( config->ip6.enabled )
-	{
-
-		if ( listen(config->ip6.sock, 10) == -1 )
+		for(shard=0; shard<config->shards; shard++)
 		{
-			#ifdef DEBUG
-			printf("DEBUG: failed to listen() socket\n");
-			#endif
-			return -1;
+			if ( ( r = setsockopt(config->ip6.sock[shard], IPPROTO_TCP, TCP_MD5SIG, &md5, sizeof md5)) != 0 )
+			{
+				#ifdef DEBUG
+				printf("Activating MD5SIG failed: '%s'\n", strerror(errno));
+				#endif
+				return -1;
+			}
 		}
+	}
+
+	/* a new key is used by the established session right away */
+	if ( peer[id].status > 0 && peer[id].sock > 0 &&
+		( r = setsockopt(peer[id].sock, IPPROTO_TCP, TCP_MD5SIG, &md5, sizeof md5)) != 0 )
+	{
 		#ifdef DEBUG
-		else { printf("DEBUG: listen() ok\n"); }
+		printf("Changing MD5SIG of the session failed: '%s'\n", strerror(errno));
 		#endif
 	}
-
+	#endif
 	return 0;
 }
 
-/* check for new peers */
-int p_socket_accept(struct config_t *config)
+/* set the TCP MD5 key of a neighbor_range on the listening sockets, *
+ * needs the prefix extension of Linux 4.13, an empty key removes it  */
+int p_socket_md5_range(struct config_t *config, struct range_entry_t *range, char *key)
 {
-	int sock;
-	struct sockaddr_in sockaddr;
-	struct sockaddr_in6 sockaddr6;
-	unsigned int addrlen = sizeof(sockaddr);
-	unsigned int addrlen6 = sizeof(sockaddr6);
+	#if defined(OS_LINUX) && defined(TCP_MD5SIG_EXT)
+	struct tcp_md5sig md5;
+	int shard;
+
+	if ( ( range->af == 4 && ! config->ip4.enabled ) || ( range->af == 6 && ! config->ip6.enabled ) )
+		return 0;
 
-	if ( ( sock = accept(config->ip4.sock, (struct sockaddr*)&sockaddr, &addrlen) ) == -1 )
+	memset(&md5, 0, sizeof(md5));
+
+	if ( range->af == 4 )
+	{
+		struct sockaddr_in  paddr;
+		memset(&paddr, 0, sizeof(paddr));
+		paddr.sin_family = AF_INET;
+		memcpy(&paddr.sin_addr, range->prefix, sizeof(paddr.sin_addr));
+		memcpy(&md5.tcpm_addr, &paddr, sizeof(paddr));
+	}
+	else
 	{
-		if ( ( sock = accept(config->ip6.sock, (struct sockaddr*)&sockaddr6, &addrlen6) ) == -1 )
+		struct sockaddr_in6 paddr6;
+		memset(&paddr6, 0, sizeof(paddr6));
+		paddr6.sin6_family = AF_INET6;
+		memcpy(&paddr6.sin6_addr, range->prefix, sizeof(paddr6.sin6_addr));
+		memcpy(&md5.tcpm_addr, &paddr6, sizeof(paddr6));
+	}
+
+	md5.tcpm_flags     = TCP_MD5SIG_FLAG_PREFIX;
+	md5.tcpm_prefixlen = range->len;
+	md5.tcpm_keylen    = strlen(key);
+	memcpy(&md5.tcpm_key, key, md5.tcpm_keylen);
+
+	for(shard=0; shard<config->shards; shard++)
+	{
+		int sock = range->af == 4 ? config->ip4.sock[shard] : config->ip6.sock[shard];
+
+		if ( setsockopt(sock, IPPROTO_TCP, TCP_MD5SIG_EXT, &md5, sizeof md5) != 0 )
 		{
+			#ifdef DEBUG
+			printf("Activating MD5SIG on a range failed: '%s'\n", strerror(errno));
+			#endif
 			return -1;
 		}
 	}
-	return sock;
+	return 0;
+	#else
+	return key[0] == '\0' ? 0 : -1;
+	#endif
 }
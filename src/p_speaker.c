@@ -0,0 +1,276 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_speaker.h>
+
+/* A minimal BGP speaker: just enough to bring a session with piranha up
+ * and push UPDATE messages, the tools build the updates themselves. */
+
+int p_speaker_connect(struct sockaddr_storage *src, struct sockaddr_storage *dst)
+{
+	socklen_t len = dst->ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+	int sock;
+
+	if ( ( sock = socket(dst->ss_family, SOCK_STREAM, 0) ) == -1 )
+		return -1;
+
+	if ( ( src != NULL && bind(sock, (struct sockaddr*)src, len) == -1 ) ||
+		connect(sock, (struct sockaddr*)dst, len) == -1 )
+	{
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+int p_speaker_send(int sock, const void *buf, int len)
+{
+	int pos = 0;
+
+	while ( pos < len )
+	{
+		int s = send(sock, (const char*)buf + pos, len - pos, MSG_NOSIGNAL);
+
+		if ( s == -1 && errno == EINTR )
+			continue;
+		if ( s <= 0 )
+			return -1;
+		pos += s;
+	}
+
+	return 0;
+}
+
+/* message header in front of len bytes of body, returns the message length */
+int p_speaker_msg(uint8_t *buf, uint8_t type, uint16_t len)
+{
+	struct bgp_header *header = (struct bgp_header*)buf;
+
+	memset(header->marker, 0xff, sizeof(header->marker));
+	header->len  = htons(BGP_HEADER_LEN + len);
+	header->type = type;
+
+	return BGP_HEADER_LEN + len;
+}
+
+int p_speaker_open(int sock, int af, uint32_t as, uint32_t routerid)
+{
+	uint8_t buf[SPEAKER_MAXLEN];
+	struct bgp_open *open = (struct bgp_open*)(buf + BGP_HEADER_LEN);
+	uint8_t *param = buf + BGP_HEADER_LEN + BGP_OPEN_LEN;
+	uint32_t as4 = htonl(as);
+	uint32_t afi = htonl( af == 4 ? 0x00010001 : 0x00020001 );
+
+	param[0] = 2;
+	param[1] = 12;
+	param[2] = BGP_CAPA_AS4;
+	param[3] = 4;
+	memcpy(param + 4, &as4, 4);
+	param[8] = BGP_CAPA_MP;
+	param[9] = 4;
+	memcpy(param + 10, &afi, 4);
+
+	open->version   = 4;
+	open->as        = as > 65535 ? htons(23456) : htons((uint16_t)as);
+	open->holdtime  = htons(SPEAKER_HOLD);
+	open->bgp_id    = htonl(routerid);
+	open->param_len = 14;
+
+	return p_speaker_send(sock, buf, p_speaker_msg(buf, BGP_OPEN, BGP_OPEN_LEN + 14));
+}
+
+/* wait for the OPEN and KEEPALIVE of the peer, the OPEN is acknowledged */
+int p_speaker_establish(int sock, int timeout)
+{
+	uint8_t buf[SPEAKER_MAXLEN * 2];
+	struct timeval tv;
+	int len = 0;
+	int open = 0;
+
+	tv.tv_sec  = timeout;
+	tv.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	for(;;)
+	{
+		struct bgp_header *header = (struct bgp_header*)buf;
+		int r;
+
+		while ( len >= BGP_HEADER_LEN && len >= ntohs(header->len) )
+		{
+			int mlen = ntohs(header->len);
+
+			if ( mlen < BGP_HEADER_LEN || header->type == BGP_ERROR )
+				return -1;
+
+			if ( header->type == BGP_OPEN )
+			{
+				open = 1;
+				if ( p_speaker_keepalive(sock) == -1 )
+					return -1;
+			}
+			else if ( header->type == BGP_KEEPALIVE && open )
+				return 0;
+
+			memmove(buf, buf + mlen, len - mlen);
+			len -= mlen;
+		}
+
+		if ( ( r = recv(sock, buf + len, sizeof(buf) - len, 0) ) <= 0 )
+			return -1;
+		len += r;
+	}
+}
+
+int p_speaker_keepalive(int sock)
+{
+	uint8_t buf[BGP_HEADER_LEN];
+
+	return p_speaker_send(sock, buf, p_speaker_msg(buf, BGP_KEEPALIVE, 0));
+}
+
+/* discard what the peer sent (keepalives), -1 if the session is gone */
+int p_speaker_drain(int sock)
+{
+	char buf[SPEAKER_MAXLEN];
+	int r;
+
+	while ( ( r = recv(sock, buf, sizeof(buf), MSG_DONTWAIT) ) > 0 );
+
+	if ( r == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+		return -1;
+
+	return 0;
+}
+
+/* path attribute, extended length when needed, returns its length */
+int p_speaker_attr(uint8_t *buf, uint8_t flags, uint8_t code, const void *data, uint16_t len)
+{
+	int pos = 0;
+
+	if ( len > 255 )
+		flags |= 0x10;
+
+	buf[pos++] = flags;
+	buf[pos++] = code;
+
+	if ( flags & 0x10 )
+	{
+		buf[pos++] = len >> 8;
+		buf[pos++] = len & 0xff;
+	}
+	else
+		buf[pos++] = len;
+
+	memcpy(buf + pos, data, len);
+
+	return pos + len;
+}
+
+/* NLRI encoding of a prefix, returns its length */
+int p_speaker_prefix(uint8_t *buf, const uint8_t *prefix, uint8_t plen)
+{
+	int blen = ( plen + 7 ) / 8;
+
+	buf[0] = plen;
+	memcpy(buf + 1, prefix, blen);
+
+	return blen + 1;
+}
+
+/* UPDATE message, returns its length */
+int p_speaker_update(uint8_t *buf, const uint8_t *withdrawn, uint16_t wlen,
+	const uint8_t *attr, uint16_t alen, const uint8_t *nlri, uint16_t nlen)
+{
+	uint8_t *pos = buf + BGP_HEADER_LEN;
+
+	*pos++ = wlen >> 8;
+	*pos++ = wlen & 0xff;
+	if ( wlen > 0 )
+		memcpy(pos, withdrawn, wlen);
+	pos += wlen;
+
+	*pos++ = alen >> 8;
+	*pos++ = alen & 0xff;
+	if ( alen > 0 )
+		memcpy(pos, attr, alen);
+	pos += alen;
+
+	if ( nlen > 0 )
+		memcpy(pos, nlri, nlen);
+
+	return p_speaker_msg(buf, BGP_UPDATE, 4 + wlen + alen + nlen);
+}
+
+/* batch the messages, flush is 0, SPEAKER_FLUSH or SPEAKER_KEEPALIVE, *
+ * returns -1 if a write failed                                        */
+int p_speaker_queue(int sock, struct speaker_queue_t *queue, const uint8_t *msg, int len, int flush)
+{
+	if ( flush == SPEAKER_KEEPALIVE && queue->len + BGP_HEADER_LEN <= SPEAKER_SEND_BUFFER )
+		queue->len += p_speaker_msg(queue->buf + queue->len, BGP_KEEPALIVE, 0);
+
+	if ( len > 0 )
+	{
+		if ( queue->len + len > SPEAKER_SEND_BUFFER )
+		{
+			if ( p_speaker_send(sock, queue->buf, queue->len) == -1 )
+				return -1;
+			queue->sent = p_speaker_now();
+			queue->len  = 0;
+		}
+
+		memcpy(queue->buf + queue->len, msg, len);
+		queue->len   += len;
+		queue->bytes += len;
+		queue->msgs++;
+	}
+
+	if ( flush && queue->len > 0 )
+	{
+		if ( p_speaker_send(sock, queue->buf, queue->len) == -1 )
+			return -1;
+		queue->sent = p_speaker_now();
+		queue->len  = 0;
+	}
+
+	return 0;
+}
+
+double p_speaker_now()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
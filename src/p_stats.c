@@ -0,0 +1,148 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+
+#include <p_defs.h>
+#include <p_attr.h>
+#include <p_buf.h>
+#include <p_log.h>
+#include <p_hist.h>
+#include <p_stats.h>
+
+/* The statistics live in a shared file mapping so piranhactl and
+ * exporters can read them without asking the daemon. Peer threads add to
+ * their own counters, the main loop samples the state every pass. Until
+ * the file is mapped (or if it fails) a private copy is used. */
+
+static struct stats_t  stats_local;
+struct stats_t        *stats = &stats_local;
+
+int p_stats_init()
+{
+	struct stats_t *map;
+	int fd;
+
+	if ( ( fd = open(STATSFILE, O_RDWR | O_CREAT | O_TRUNC, 0644) ) == -1 )
+		return -1;
+
+	if ( ftruncate(fd, sizeof(struct stats_t)) == -1 )
+	{
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, sizeof(struct stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( map == MAP_FAILED )
+		return -1;
+
+	memcpy(map, &stats_local, sizeof(struct stats_t));
+	map->version  = STATS_VERSION;
+	map->size     = sizeof(struct stats_t);
+	map->maxpeers = MAX_PEERS;
+	map->pid      = getpid();
+	map->started  = time(NULL);
+
+	/* readers wait for the magic */
+	__atomic_store_n(&map->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+	stats = map;
+
+	return 0;
+}
+
+/* sample the state of the daemon, called by the main loop */
+void p_stats_update(struct config_t *config, struct peer_t *peer, time_t mytime)
+{
+	uint32_t count;
+	uint64_t bytes;
+	uint32_t drops;
+	uint64_t denied;
+	int a;
+
+	/* daemonization changed the pid */
+	STATS_SET(stats->pid, getpid());
+
+	for(a=0; a<MAX_PEERS; a++)
+	{
+		struct stats_peer_t *s = &stats->peer[a];
+
+		STATS_SET(s->allow,  peer[a].allow);
+		STATS_SET(s->status, peer[a].status);
+		STATS_SET(s->af,     peer[a].af);
+		STATS_SET(s->as,     peer[a].as);
+		STATS_SET(s->cts,    peer[a].cts);
+		STATS_SET(s->uts,    peer[a].uts);
+		STATS_SET(s->ibuf,   peer[a].ilen > 0 ? peer[a].ilen : 0);
+		STATS_SET(s->obuf,   peer[a].olen > 0 ? peer[a].olen : 0);
+		STATS_SET(s->held,   peer[a].duplicate != DUPLICATE_KEEP && peer[a].status == 2);
+		STATS_SET(s->prefixes, peer[a].prefixes);
+
+		if ( peer[a].af == 4 )
+		{
+			memset(s->ip, 0, sizeof(s->ip));
+			memcpy(s->ip, &peer[a].ip4, sizeof(peer[a].ip4));
+		}
+		else
+			memcpy(s->ip, &peer[a].ip6, sizeof(s->ip));
+	}
+
+	p_attr_stats(&count, &bytes);
+	STATS_SET(stats->attr_count, count);
+	STATS_SET(stats->attr_bytes, bytes);
+
+	STATS_SET(stats->log_queue, p_log_queue(&drops));
+	STATS_SET(stats->log_drops, drops);
+
+	p_buf_stats(&count, &bytes, &denied);
+	STATS_SET(stats->buf_used,   count);
+	STATS_SET(stats->buf_bytes,  bytes);
+	STATS_SET(stats->buf_denied, denied);
+
+	STATS_SET(stats->updated, mytime);
+}
+
+/* a dynamic neighbor reuses the record of a previous one */
+void p_stats_reset(int id)
+{
+	memset(&stats->peer[id], 0, sizeof(stats->peer[id]));
+}
+
+/* account a dump file rotation */
+void p_stats_rotation(int id, uint64_t ns)
+{
+	uint64_t max = __atomic_load_n(&stats->rotation_ns_max, __ATOMIC_RELAXED);
+
+	STATS_ADD(stats->rotations, 1);
+	STATS_ADD(stats->rotation_ns, ns);
+	STATS_SET(stats->rotation_ns_last, ns);
+	p_hist_add(&stats->peer[id].hist[HIST_ROTATION], ns / 1000);
+
+	while ( ns > max && ! __atomic_compare_exchange_n(&stats->rotation_ns_max, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
@@ -0,0 +1,496 @@
+/*******************************************************************************/
+/*                                                                             */
+/*  Copyright 2004-2017 Pascal Gloor                                           */
+/*                                                                             */
+/*  Licensed under the Apache License, Version 2.0 (the "License");            */
+/*  you may not use this file except in compliance with the License.           */
+/*  You may obtain a copy of the License at                                    */
+/*                                                                             */
+/*     http://www.apache.org/licenses/LICENSE-2.0                              */
+/*                                                                             */
+/*  Unless required by applicable law or agreed to in writing, software        */
+/*  distributed under the License is distributed on an "AS IS" BASIS,          */
+/*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   */
+/*  See the License for the specific language governing permissions and        */
+/*  limitations under the License.                                             */
+/*                                                                             */
+/*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <p_defs.h>
+#include <p_log.h>
+#include <p_undump.h>
+#include <p_format.h>
+#include <p_filter.h>
+#include <p_stream.h>
+
+/* The stream server follows the live feed (see p_feed.c) from its own
+ * thread and sends the events matching the filter of each subscriber, as
+ * ptoa -j lines or as feed records. A subscriber connects over TCP or the
+ * unix socket and sends its filter on one line (see p_filter.c). The
+ * filters of all subscribers are compiled together with one bit per
+ * subscriber, an event is decoded, evaluated and formatted once. The peer
+ * threads never wait for the subscribers, a subscriber too slow is sent a
+ * lost event once its output has room again. */
+
+static struct stream_client_t stream_client[STREAM_CLIENTS];
+static struct stream_filter_t stream_filter;
+static char                   stream_json[STREAM_FORMAT];
+
+static void    *p_stream_thread (void *data);
+static void     p_stream_accept (int sock);
+static void     p_stream_read   (struct stream_client_t *client);
+static void     p_stream_close  (struct stream_client_t *client);
+static void     p_stream_compile(void);
+static void     p_stream_event  (struct feed_rec_t *rec, uint8_t *record, struct dump_full_msg *msg, FILE *json);
+static int      p_stream_append (struct stream_client_t *client, void *data, size_t len);
+static void     p_stream_send   (struct stream_client_t *client);
+
+/* bind the listening sockets not taken over, before the privileges are dropped */
+int p_stream_init(struct config_t *config)
+{
+	int on = 1;
+
+	if ( config->stream.enabled && config->stream.sock == -1 )
+	{
+		socklen_t len = config->stream.listen.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+
+		if ( ( config->stream.sock = socket(config->stream.listen.ss_family, SOCK_STREAM, 0) ) == -1 )
+			return -1;
+
+		setsockopt(config->stream.sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if ( bind(config->stream.sock, (struct sockaddr*)&config->stream.listen, len) == -1 ||
+			listen(config->stream.sock, 16) == -1 )
+		{
+			close(config->stream.sock);
+			config->stream.sock = -1;
+			return -1;
+		}
+	}
+
+	if ( config->stream.local && config->stream.lsock == -1 )
+	{
+		struct sockaddr_un addr;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+
+		if ( strlen(STREAMFILE) >= sizeof(addr.sun_path) )
+			return -1;
+
+		strcpy(addr.sun_path, STREAMFILE);
+
+		if ( ( config->stream.lsock = socket(AF_UNIX, SOCK_STREAM, 0) ) == -1 )
+			return -1;
+
+		/* left over by a previous instance */
+		unlink(STREAMFILE);
+
+		/* the daemon user and its group only */
+		if ( bind(config->stream.lsock, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+			chown(STREAMFILE, config->uid, config->gid) == -1 ||
+			chmod(STREAMFILE, 0660) == -1 ||
+			listen(config->stream.lsock, 16) == -1 )
+		{
+			close(config->stream.lsock);
+			config->stream.lsock = -1;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* start the stream thread, after daemonization and the feed creation */
+void p_stream_start(struct config_t *config)
+{
+	pthread_t thread;
+
+	if ( config->stream.sock == -1 && config->stream.lsock == -1 )
+		return;
+
+	if ( config->feed == 0 )
+	{
+		p_log_add(time(NULL), "stream_listen needs a feed, stream server disabled\n");
+		return;
+	}
+
+	if ( pthread_create(&thread, NULL, p_stream_thread, config) == 0 )
+		pthread_detach(thread);
+}
+
+static void *p_stream_thread(void *data)
+{
+	struct config_t *config = data;
+	struct feed_ctx *feed;
+	struct feed_rec_t rec;
+	uint8_t record[sizeof(struct dump_msg) + 65535];
+	uint64_t lost = 0;
+	FILE *json;
+	int idle = 1;
+	int a;
+
+	if ( ( feed = p_undump_feed_open(FEEDFILE) ) == NULL ||
+		( json = fmemopen(stream_json, sizeof(stream_json), "w") ) == NULL )
+	{
+		p_log_add(time(NULL), "stream: failed to open the feed " FEEDFILE "\n");
+		return NULL;
+	}
+
+	for(a=0; a<STREAM_CLIENTS; a++)
+		stream_client[a].sock = -1;
+
+	for(;;)
+	{
+		struct pollfd pfd[STREAM_CLIENTS + 2];
+		int client[STREAM_CLIENTS + 2];
+		time_t now = time(NULL);
+		int nfd = 0;
+		int count = 0;
+
+		if ( config->stream.sock != -1 )
+		{
+			pfd[nfd].fd     = config->stream.sock;
+			pfd[nfd].events = POLLIN;
+			client[nfd++]   = -1;
+		}
+
+		if ( config->stream.lsock != -1 )
+		{
+			pfd[nfd].fd     = config->stream.lsock;
+			pfd[nfd].events = POLLIN;
+			client[nfd++]   = -1;
+		}
+
+		for(a=0; a<STREAM_CLIENTS; a++)
+		{
+			struct stream_client_t *c = &stream_client[a];
+
+			if ( c->sock == -1 )
+				continue;
+
+			if ( ! c->running && now - c->cts > STREAM_TIMEOUT )
+			{
+				p_stream_close(c);
+				continue;
+			}
+
+			pfd[nfd].fd     = c->sock;
+			pfd[nfd].events = POLLIN | ( c->olen > c->osent ? POLLOUT : 0 );
+			client[nfd++]   = a;
+		}
+
+		/* the feed is read between two polls, the poll waits while it is idle, *
+		 * a record reserved but not written yet included                     */
+		if ( poll(pfd, nfd, idle ? FEED_WAIT / 1000 : 0) > 0 )
+		{
+			for(a=0; a<nfd; a++)
+			{
+				if ( pfd[a].revents == 0 )
+					continue;
+
+				if ( client[a] == -1 )
+					p_stream_accept(pfd[a].fd);
+				else if ( pfd[a].revents & ( POLLIN | POLLERR | POLLHUP ) )
+					p_stream_read(&stream_client[client[a]]);
+				else if ( pfd[a].revents & POLLOUT )
+					p_stream_send(&stream_client[client[a]]);
+			}
+		}
+
+		while ( count < STREAM_BATCH && ( idle = p_undump_feed_next(feed, &rec, record) == 0 ) == 0 )
+		{
+			struct dump_full_msg msg;
+
+			count++;
+
+			/* overrun, the subscribers may have lost events */
+			if ( feed->lost != lost )
+			{
+				for(a=0; a<STREAM_CLIENTS; a++)
+					if ( stream_client[a].sock != -1 && stream_client[a].running )
+						stream_client[a].lost += feed->lost - lost;
+				lost = feed->lost;
+			}
+
+			if ( p_undump_record(record, rec.len, &msg) == 0 )
+				p_stream_event(&rec, record, &msg, json);
+		}
+
+		for(a=0; a<STREAM_CLIENTS; a++)
+			if ( stream_client[a].sock != -1 && stream_client[a].olen > stream_client[a].osent )
+				p_stream_send(&stream_client[a]);
+	}
+
+	return NULL;
+}
+
+static void p_stream_accept(int sock)
+{
+	struct stream_client_t *c = NULL;
+	int client;
+	int a;
+
+	if ( ( client = accept(sock, NULL, NULL) ) == -1 )
+		return;
+
+	for(a=0; a<STREAM_CLIENTS && c == NULL; a++)
+		if ( stream_client[a].sock == -1 )
+			c = &stream_client[a];
+
+	if ( c == NULL )
+	{
+		const char *full = "error too many subscribers\n";
+		send(client, full, strlen(full), MSG_NOSIGNAL | MSG_DONTWAIT);
+		close(client);
+		return;
+	}
+
+	fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+
+	memset(c, 0, sizeof(*c));
+	c->sock = client;
+	c->cts  = time(NULL);
+}
+
+/* the filter line, anything after it is ignored */
+static void p_stream_read(struct stream_client_t *client)
+{
+	struct stream_filter_t check;
+	char logline[LOG_LINE_LEN];
+	char buf[STREAM_LINE];
+	char *eol;
+	ssize_t len;
+
+	if ( ( len = recv(client->sock, buf, sizeof(buf), 0) ) <= 0 )
+	{
+		if ( len == 0 || ( errno != EAGAIN && errno != EINTR ) )
+			p_stream_close(client);
+		return;
+	}
+
+	if ( client->running )
+		return;
+
+	if ( (size_t)len >= STREAM_LINE - client->llen )
+	{
+		const char *error = "error filter too long\n";
+		send(client->sock, error, strlen(error), MSG_NOSIGNAL);
+		p_stream_close(client);
+		return;
+	}
+
+	memcpy(client->line + client->llen, buf, len);
+	client->llen += len;
+	client->line[client->llen] = '\0';
+
+	if ( ( eol = strchr(client->line, '\n') ) == NULL )
+		return;
+
+	*eol = '\0';
+	if ( eol > client->line && eol[-1] == '\r' )
+		eol[-1] = '\0';
+
+	/* checked alone before it joins the compiled filters */
+	memset(&check, 0, sizeof(check));
+	if ( p_filter_parse(&check, client->line, 1, &client->format) == -1 )
+	{
+		const char *error = "error invalid filter\n";
+		p_filter_free(&check);
+		send(client->sock, error, strlen(error), MSG_NOSIGNAL);
+		p_stream_close(client);
+		return;
+	}
+	p_filter_free(&check);
+
+	client->running = 1;
+	p_stream_compile();
+
+	snprintf(logline, sizeof(logline), "stream: subscriber %u filter '%.128s'\n",
+		(unsigned int)(client - stream_client), client->line);
+	p_log_add(time(NULL), logline);
+}
+
+static void p_stream_close(struct stream_client_t *client)
+{
+	if ( client->running )
+	{
+		char logline[LOG_LINE_LEN];
+
+		snprintf(logline, sizeof(logline), "stream: subscriber %u closed, %llu events sent, %llu dropped\n",
+			(unsigned int)(client - stream_client),
+			(unsigned long long int)client->sent, (unsigned long long int)client->dropped);
+		p_log_add(time(NULL), logline);
+	}
+
+	close(client->sock);
+	free(client->out);
+
+	memset(client, 0, sizeof(*client));
+	client->sock = -1;
+
+	p_stream_compile();
+}
+
+/* the filters of the running subscribers, rebuilt when one comes or goes */
+static void p_stream_compile(void)
+{
+	int a;
+
+	p_filter_free(&stream_filter);
+
+	for(a=0; a<STREAM_CLIENTS; a++)
+	{
+		struct stream_client_t *c = &stream_client[a];
+
+		if ( c->sock != -1 && c->running )
+			p_filter_parse(&stream_filter, c->line, (uint64_t)1 << a, &c->format);
+	}
+}
+
+/* formatted once per format, queued to each subscriber */
+static void p_stream_event(struct feed_rec_t *rec, uint8_t *record, struct dump_full_msg *msg, FILE *json)
+{
+	uint64_t mask = p_filter_match(&stream_filter, rec, msg);
+	long jlen = -1;
+	int a;
+
+	if ( mask == 0 )
+		return;
+
+	if ( ( mask & ~stream_filter.binary ) != 0 )
+	{
+		rewind(json);
+		p_format_msg(json, PTOA_JSON, msg, rec);
+		fflush(json);
+
+		/* larger than the buffer */
+		if ( ( jlen = ftell(json) ) >= (long)sizeof(stream_json) - 1 )
+			jlen = -1;
+	}
+
+	for(a=0; a<STREAM_CLIENTS; a++)
+	{
+		struct stream_client_t *c = &stream_client[a];
+		int r;
+
+		if ( ! ( mask & ( (uint64_t)1 << a ) ) )
+			continue;
+
+		/* events lost before this one */
+		if ( c->lost > 0 )
+		{
+			if ( c->format == STREAM_BINARY )
+			{
+				struct feed_rec_t lost;
+
+				memset(&lost, 0, sizeof(lost));
+				lost.type = FEED_LOST;
+				lost.seq  = c->lost;
+				r = p_stream_append(c, &lost, sizeof(lost));
+			}
+			else
+			{
+				char line[100];
+				int len = snprintf(line, sizeof(line), "{ \"type\": \"lost\", \"msg\": { \"count\": %llu } }\n",
+					(unsigned long long int)c->lost);
+				r = p_stream_append(c, line, len);
+			}
+
+			if ( r == -1 )
+			{
+				c->lost++;
+				c->dropped++;
+				continue;
+			}
+			c->lost = 0;
+		}
+
+		if ( c->format == STREAM_BINARY )
+		{
+			if ( ( r = p_stream_append(c, rec, sizeof(*rec)) ) == 0 &&
+				( r = p_stream_append(c, record, rec->len) ) == -1 )
+			{
+				/* a header without its record would misframe the stream,
+				 * it is still the last thing in the output */
+				c->olen -= sizeof(*rec);
+			}
+		}
+		else
+			r = jlen == -1 ? -1 : p_stream_append(c, stream_json, jlen);
+
+		if ( r == -1 )
+		{
+			c->lost++;
+			c->dropped++;
+		}
+		else
+			c->sent++;
+	}
+}
+
+/* queue output, -1 if it does not fit in STREAM_BUFFER */
+static int p_stream_append(struct stream_client_t *client, void *data, size_t len)
+{
+	/* sent output is discarded first */
+	if ( client->osent > 0 && client->olen + len > client->osize )
+	{
+		memmove(client->out, client->out + client->osent, client->olen - client->osent);
+		client->olen -= client->osent;
+		client->osent = 0;
+	}
+
+	if ( client->olen + len > client->osize )
+	{
+		size_t size = client->osize > 0 ? client->osize : 65536;
+		char *out;
+
+		while ( size < client->olen + len )
+			size *= 2;
+
+		if ( size > STREAM_BUFFER || ( out = realloc(client->out, size) ) == NULL )
+			return -1;
+
+		client->out   = out;
+		client->osize = size;
+	}
+
+	memcpy(client->out + client->olen, data, len);
+	client->olen += len;
+
+	return 0;
+}
+
+static void p_stream_send(struct stream_client_t *client)
+{
+	ssize_t len = send(client->sock, client->out + client->osent, client->olen - client->osent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+	if ( len == -1 )
+	{
+		if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+			p_stream_close(client);
+		return;
+	}
+
+	client->osent += len;
+
+	if ( client->osent == client->olen )
+		client->osent = client->olen = 0;
+}
@@ -27,12 +27,18 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 
 #include <p_defs.h>
 #include <p_undump.h>
 #include <p_tools.h>
 
+static int p_undump_payload(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg, char *buffer);
+
 struct dump_file_ctx *p_undump_open(char *file)
 {
 	struct dump_file_ctx *ctx;
@@ -110,6 +116,43 @@ int p_undump_readmsg(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg)
 	// p_tools_dump("Message Dump", buffer, msg.len);
 	#endif
 
+	return p_undump_payload(ctx, fmsg, buffer);
+}
+
+/* dump record of the live feed, the neighbor comes with the feed record */
+int p_undump_record(uint8_t *record, uint32_t len, struct dump_full_msg *fmsg)
+{
+	char buffer[65536];
+	struct dump_file_ctx ctx;
+	struct dump_msg msg;
+
+	if ( len < sizeof(msg) )
+		return (-1);
+
+	memcpy(&msg, record, sizeof(msg));
+	msg.len = be16toh(msg.len);
+	msg.ts  = be64toh(msg.ts);
+	msg.uts = be64toh(msg.uts);
+	memcpy(&fmsg->msg, &msg, sizeof(msg));
+
+	if ( msg.len != len - sizeof(msg) )
+		return (-1);
+
+	memset(buffer, 0, sizeof(buffer));
+	memcpy(buffer, record + sizeof(msg), msg.len);
+
+	/* records are not preceded by the file header */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.head = msg.type != DUMP_HEADER4 && msg.type != DUMP_HEADER6;
+
+	return p_undump_payload(&ctx, fmsg, buffer);
+}
+
+/* decode the payload of the record in fmsg->msg */
+static int p_undump_payload(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg, char *buffer)
+{
+	struct dump_msg msg = fmsg->msg;
+
 	if ( msg.type == DUMP_HEADER4 && !ctx->head )
 	{
 		struct dump_header4 *header = (struct dump_header4 *)(buffer);
@@ -128,6 +171,11 @@ int p_undump_readmsg(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg)
 	}
 	else if ( msg.type == DUMP_OPEN && ctx->head )
 	{
+		/* older dumps have no payload, the buffer is zeroed */
+		struct dump_open *open = (struct dump_open*)buffer;
+
+		fmsg->open.gr     = open->gr;
+		fmsg->open.grtime = be16toh(open->grtime);
 	}
 	else if ( msg.type == DUMP_CLOSE && ctx->head )
 	{
@@ -135,6 +183,27 @@ int p_undump_readmsg(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg)
 	else if ( msg.type == DUMP_KEEPALIVE && ctx->head )
 	{
 	}
+	else if ( msg.type == DUMP_DUPLICATE && ctx->head )
+	{
+		struct dump_duplicate *duplicate = (struct dump_duplicate*)buffer;
+
+		fmsg->duplicate.count = be32toh(duplicate->count);
+	}
+	else if ( msg.type == DUMP_EOR && ctx->head )
+	{
+		struct dump_eor *eor = (struct dump_eor*)buffer;
+
+		fmsg->eor.afi      = be16toh(eor->afi);
+		fmsg->eor.count    = be32toh(eor->count);
+		fmsg->eor.duration = be32toh(eor->duration);
+	}
+	else if ( msg.type == DUMP_REFRESH && ctx->head )
+	{
+		struct dump_refresh *refresh = (struct dump_refresh*)buffer;
+
+		fmsg->refresh.afi     = be16toh(refresh->afi);
+		fmsg->refresh.subtype = refresh->subtype;
+	}
 	else if ( ( msg.type == DUMP_ANNOUNCE4 || msg.type == DUMP_ANNOUNCE6 ) && ctx->head )
 	{
 		int jump = 0;
@@ -282,3 +351,144 @@ int p_undump_readmsg(struct dump_file_ctx *ctx, struct dump_full_msg *fmsg)
 
 	return 0;
 }
+
+/* attach to the live feed, reading starts with the next record */
+struct feed_ctx *p_undump_feed_open(char *file)
+{
+	struct feed_ctx *ctx;
+	struct stat sb;
+	int fd;
+
+	if ( ( fd = open(file, O_RDONLY) ) == -1 )
+		return NULL;
+
+	if ( fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(struct feed_t) )
+	{
+		close(fd);
+		return NULL;
+	}
+
+	ctx = malloc(sizeof(struct feed_ctx));
+	assert(ctx);
+
+	memset(ctx, 0, sizeof(struct feed_ctx));
+
+	strcpy(ctx->file, file);
+	ctx->map = sb.st_size;
+	ctx->ino = sb.st_ino;
+
+	ctx->feed = mmap(NULL, ctx->map, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( ctx->feed == MAP_FAILED ||
+		__atomic_load_n(&ctx->feed->magic, __ATOMIC_ACQUIRE) != FEED_MAGIC ||
+		ctx->feed->version != FEED_VERSION ||
+		ctx->feed->size + sizeof(struct feed_t) > ctx->map )
+	{
+		if ( ctx->feed != MAP_FAILED )
+			munmap(ctx->feed, ctx->map);
+		free(ctx);
+		return NULL;
+	}
+
+	ctx->ring = (uint8_t*)ctx->feed + sizeof(struct feed_t);
+	/* the seq may already be past the record at pos, never below */
+	ctx->pos  = __atomic_load_n(&ctx->feed->reserve, __ATOMIC_ACQUIRE);
+	ctx->seq  = __atomic_load_n(&ctx->feed->seq, __ATOMIC_ACQUIRE);
+
+	return ctx;
+}
+
+int p_undump_feed_close(struct feed_ctx *ctx)
+{
+	assert(ctx);
+
+	munmap(ctx->feed, ctx->map);
+	free(ctx);
+
+	return (0);
+}
+
+/* the file was replaced by a new piranha process */
+int p_undump_feed_replaced(struct feed_ctx *ctx)
+{
+	struct stat sb;
+
+	return stat(ctx->file, &sb) == -1 || sb.st_ino != ctx->ino;
+}
+
+/* copy the next record of the live feed, its dump record to record (at least
+ * sizeof(struct dump_msg) + 65535 bytes). Returns 1 with a record, 0 if none
+ * is available yet. An overrun reader starts again with the next record
+ * written and the records it lost are added to ctx->lost */
+int p_undump_feed_next(struct feed_ctx *ctx, struct feed_rec_t *rec, uint8_t *record)
+{
+	uint64_t size = ctx->feed->size;
+
+	while(1)
+	{
+		uint64_t reserve = __atomic_load_n(&ctx->feed->reserve, __ATOMIC_ACQUIRE);
+		uint64_t off  = ctx->pos % size;
+		uint64_t left = size - off;
+		struct feed_rec_t *r;
+		uint64_t seq;
+
+		if ( reserve - ctx->pos > size )
+		{
+			ctx->pos = reserve;
+			continue;
+		}
+
+		if ( reserve <= ctx->pos )
+			return 0;
+
+		if ( left < sizeof(struct feed_rec_t) )
+		{
+			ctx->pos += left;
+			continue;
+		}
+
+		r = (struct feed_rec_t*)(ctx->ring + off);
+
+		/* reserved but still being written */
+		if ( ( seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) ) == 0 )
+			return 0;
+
+		memcpy(rec, r, sizeof(*rec));
+
+		if ( rec->type == FEED_RECORD && rec->len <= left - sizeof(*rec) &&
+			rec->len <= sizeof(struct dump_msg) + 65535 )
+			memcpy(record, r + 1, rec->len);
+		else if ( rec->type != FEED_WRAP )
+			rec->type = FEED_WRAP + 1;
+
+		/* overwritten while it was copied */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if ( __atomic_load_n(&ctx->feed->reserve, __ATOMIC_RELAXED) - ctx->pos > size )
+			continue;
+
+		/* not a record, start again with the next one written */
+		if ( rec->type > FEED_WRAP )
+		{
+			ctx->pos = reserve;
+			continue;
+		}
+
+		if ( seq > ctx->seq )
+			ctx->lost += seq - ctx->seq;
+
+		ctx->seq = seq;
+
+		if ( rec->type == FEED_WRAP )
+		{
+			ctx->pos += left;
+			continue;
+		}
+
+		rec->seq = seq;
+		ctx->seq = seq + 1;
+		ctx->pos += FEED_ALIGN(sizeof(*rec) + rec->len);
+
+		return 1;
+	}
+}
@@ -1,6 +1,6 @@
 #!/bin/sh -e
 
-for proto in ipv4 ipv6
+for proto in ipv4 ipv6 records refresh
 do
 	for mode in H m j
 	do
@@ -22,3 +22,34 @@ do
 		rm -f ${OUT}
 	done
 done
+
+# stream server filters on the output of a binary subscriber
+for name in all peer prefix origin community largecommunity and
+do
+	case ${name} in
+		all)            FILTER="" ;;
+		peer)           FILTER="peer 127.0.0.3" ;;
+		prefix)         FILTER="prefix 10.1.0.0/16" ;;
+		origin)         FILTER="origin 3356 origin 174" ;;
+		community)      FILTER="community 65001:100" ;;
+		largecommunity) FILTER="community 1:2:3" ;;
+		and)            FILTER="prefix 10.0.0.0/8 community 65001:200" ;;
+	esac
+
+	IN="input_stream.bin"
+	OUT="test.out"
+	REF="output_stream_${name}.bin"
+
+	printf "Testing stream filter ${name}: "
+	../bin/ptoa -j -F "${FILTER}" -s ${IN} > ${OUT}
+	diff ${OUT} ${REF} > /dev/null && \
+	{
+		printf "OK\n";
+	} || { \
+		printf "ERROR\n";
+		printf "NOTE: ouput of ../bin/ptoa -j -F \"%s\" -s %s differs from %s\n" "${FILTER}" ${IN} ${REF};
+		diff ${OUT} ${REF} | sed "s/^/DIFF: /";
+		printf "\n";
+	}
+	rm -f ${OUT}
+done